@@ -0,0 +1,399 @@
+#include "autosave.h"
+#include <stdio.h>
+
+void autosave_init(Autosave* autosave, Circuit* root, const char* path, float interval)
+{
+	mem_zero(autosave, sizeof(Autosave));
+	autosave->root = root;
+	autosave->interval = interval;
+	autosave->saved_edits = autosave->root->layout_edits;
+	snprintf(autosave->path, sizeof(autosave->path), "%s", path);
+}
+
+u64 autosave_hash(u32* key)
+{
+	u64 hash = (u64)(size_t)key * 0x9E3779B97F4A7C15ull;
+	return hash ^ (hash >> 29);
+}
+
+Circuit* autosave_layout_find(Autosave* autosave, u32* key)
+{
+	if (autosave->layout_max == 0)
+		return NULL;
+
+	u32 mask = autosave->layout_max - 1;
+	for(u32 i=autosave_hash(key) & mask; autosave->layout_keys[i]; i = (i + 1) & mask)
+	{
+		if (autosave->layout_keys[i] == key)
+			return autosave->layout_copies[i];
+	}
+
+	return NULL;
+}
+
+void autosave_layout_insert(Autosave* autosave, u32* key, Circuit* copy)
+{
+	// Kept at most half full
+	if ((autosave->layout_num + 1) * 2 > autosave->layout_max)
+	{
+		u32** keys = autosave->layout_keys;
+		Circuit** copies = autosave->layout_copies;
+		u32 prev_max = autosave->layout_max;
+
+		autosave->layout_max = prev_max == 0 ? 64 : (prev_max << 1);
+		autosave->layout_keys = malloc(sizeof(u32*) * autosave->layout_max);
+		autosave->layout_copies = malloc(sizeof(Circuit*) * autosave->layout_max);
+		mem_zero(autosave->layout_keys, sizeof(u32*) * autosave->layout_max);
+		autosave->layout_num = 0;
+
+		for(u32 i=0; i<prev_max; ++i)
+		{
+			if (keys[i])
+				autosave_layout_insert(autosave, keys[i], copies[i]);
+		}
+
+		free(keys);
+		free(copies);
+	}
+
+	u32 mask = autosave->layout_max - 1;
+	u32 i = autosave_hash(key) & mask;
+	while(autosave->layout_keys[i])
+		i = (i + 1) & mask;
+
+	autosave->layout_keys[i] = key;
+	autosave->layout_copies[i] = copy;
+	autosave->layout_num++;
+}
+
+void autosave_queue(Autosave* autosave, const void* from, void* to, u64 size)
+{
+	if (autosave->copy_num >= autosave->copy_max)
+	{
+		autosave->copy_max = autosave->copy_max == 0 ? 64 : (autosave->copy_max << 1);
+		autosave->copies = realloc(autosave->copies, sizeof(Autosave_Copy) * autosave->copy_max);
+		assert(autosave->copies != NULL);
+	}
+
+	Autosave_Copy* copy = &autosave->copies[autosave->copy_num++];
+	copy->from = from;
+	copy->to = to;
+	copy->size = size;
+}
+
+// Allocates room for an array and queues up copying it there
+void* autosave_queue_array(Autosave* autosave, const void* from, u64 size)
+{
+	if (size == 0)
+		return NULL;
+
+	void* to = malloc(size);
+	assert(to != NULL);
+	autosave_queue(autosave, from, to, size);
+	return to;
+}
+
+// Gives copy the layout of live, to be filled in while copying. The wire lines are copied right away,
+// there's one for every row and column with wires on it
+void autosave_copy_layout(Autosave* autosave, Circuit* copy, Circuit* live)
+{
+	copy->gen_num = live->gen_num;
+	copy->free_slot = live->free_slot;
+	memcpy(copy->public_nodes, live->public_nodes, sizeof(copy->public_nodes));
+
+	// Pages are whole, like things_reserve makes them, but only the slots in use are copied
+	u32 left = live->thing_num;
+	for(u32 p=0; p<live->page_num; ++p)
+	{
+		u32 size = thing_page_size(p);
+		copy->thing_pages[p] = malloc(sizeof(Thing) * size);
+		autosave_queue(autosave, live->thing_pages[p], copy->thing_pages[p], sizeof(Thing) * min(left, size));
+		left -= min(left, size);
+	}
+
+	copy->page_num = live->page_num;
+	copy->thing_max = live->thing_max;
+
+	Spatial_Hash* spatial = &copy->spatial;
+	*spatial = live->spatial;
+	spatial->buckets = autosave_queue_array(autosave, live->spatial.buckets, sizeof(u32) * (u64)spatial->bucket_max);
+	spatial->entries = autosave_queue_array(autosave, live->spatial.entries, sizeof(Spatial_Entry) * (u64)spatial->entry_num);
+	spatial->entry_max = spatial->entry_num;
+	spatial->mapped = false;
+
+	Wire_Index* wires = &copy->wires;
+	*wires = live->wires;
+	if (wires->line_max)
+	{
+		wires->lines = malloc(sizeof(Wire_Line) * wires->line_max);
+		memcpy(wires->lines, live->wires.lines, sizeof(Wire_Line) * wires->line_max);
+	}
+
+	for(u32 i=0; i<wires->line_max; ++i)
+	{
+		Wire_Line* line = &wires->lines[i];
+		line->wire_num = line->used ? line->wire_num : 0;
+		line->wire_max = line->wire_num;
+		line->wires = autosave_queue_array(autosave, line->wires, sizeof(Wire) * line->wire_num);
+		line->mapped = false;
+	}
+}
+
+// Gives copy the same layout as owner, like circuit_share
+void autosave_share_layout(Circuit* copy, Circuit* owner)
+{
+	if (!owner->layout_refs)
+	{
+		owner->layout_refs = malloc(sizeof(u32));
+		*owner->layout_refs = 1;
+	}
+
+	(*owner->layout_refs)++;
+	copy->layout_refs = owner->layout_refs;
+
+	copy->gen_num = owner->gen_num;
+	copy->free_slot = owner->free_slot;
+	memcpy(copy->public_nodes, owner->public_nodes, sizeof(copy->public_nodes));
+	memcpy(copy->thing_pages, owner->thing_pages, sizeof(copy->thing_pages));
+	copy->page_num = owner->page_num;
+	copy->thing_max = owner->thing_max;
+	copy->spatial = owner->spatial;
+	copy->wires = owner->wires;
+}
+
+// Makes the copy of an instance and of the chips in it. Its thing_num stays 0 until the things are
+// there, so it can be cleared before that. Chip slots point at the live chip circuits until then too
+u32 autosave_add(Autosave* autosave, Circuit* live, u32 parent, u32 slot)
+{
+	Circuit* copy = circuit_make(live->name);
+	copy->parent_chip = live->parent_chip;
+
+	Circuit* owner = live->layout_refs ? autosave_layout_find(autosave, live->layout_refs) : NULL;
+	if (owner)
+	{
+		autosave_share_layout(copy, owner);
+	}
+	else
+	{
+		autosave_copy_layout(autosave, copy, live);
+		if (live->layout_refs)
+			autosave_layout_insert(autosave, live->layout_refs, copy);
+	}
+
+	// Only the state the file has, the flags are copied at the end
+	copy->thing_flags = malloc(sizeof(u8) * max(live->thing_max, 1));
+	copy->thing_circuits = autosave_queue_array(autosave, live->thing_circuits, sizeof(Circuit*) * (u64)live->thing_num);
+
+	if (autosave->instance_num >= autosave->instance_max)
+	{
+		autosave->instance_max = autosave->instance_max == 0 ? 64 : (autosave->instance_max << 1);
+		autosave->instances = realloc(autosave->instances, sizeof(Autosave_Instance) * autosave->instance_max);
+		assert(autosave->instances != NULL);
+	}
+
+	u32 index = autosave->instance_num++;
+	Autosave_Instance* instance = &autosave->instances[index];
+	instance->live = live;
+	instance->copy = copy;
+	instance->parent = parent;
+	instance->slot = slot;
+	instance->owner = owner == NULL;
+
+	for(u32 i=0; i<live->thing_num; ++i)
+	{
+		if (live->thing_circuits[i])
+			autosave_add(autosave, live->thing_circuits[i], index, i);
+	}
+
+	return index;
+}
+
+void autosave_begin(Autosave* autosave)
+{
+	assert(!autosave->snapshot);
+	autosave->requested = false;
+	autosave->edits = autosave->root->layout_edits;
+	autosave_add(autosave, autosave->root, ~0u, 0);
+	autosave->snapshot = autosave->instances[0].copy;
+}
+
+void autosave_reset(Autosave* autosave)
+{
+	autosave->snapshot = NULL;
+	autosave->instance_num = 0;
+	autosave->copy_num = 0;
+	autosave->copy_next = 0;
+	autosave->copy_offset = 0;
+	autosave->layout_num = 0;
+	if (autosave->layout_keys)
+		mem_zero(autosave->layout_keys, sizeof(u32*) * autosave->layout_max);
+}
+
+// Throws the copy in progress away. Its circuits don't have any things yet, so clearing one of them
+// leaves the chip instances in it alone, they're all cleared on their own
+void autosave_discard(Autosave* autosave)
+{
+	for(u32 i=0; i<autosave->instance_num; ++i)
+	{
+		circuit_clear(autosave->instances[i].copy);
+		circuit_free(autosave->instances[i].copy);
+	}
+
+	autosave_reset(autosave);
+}
+
+// Copies layouts until the budget is used up, returns whether all of them are there
+bool autosave_copy(Autosave* autosave, u64 budget)
+{
+	while(autosave->copy_next < autosave->copy_num && budget > 0)
+	{
+		Autosave_Copy* copy = &autosave->copies[autosave->copy_next];
+		u64 size = min(copy->size - autosave->copy_offset, budget);
+		memcpy((u8*)copy->to + autosave->copy_offset, (const u8*)copy->from + autosave->copy_offset, size);
+		autosave->copy_offset += size;
+		budget -= size;
+
+		if (autosave->copy_offset == copy->size)
+		{
+			autosave->copy_next++;
+			autosave->copy_offset = 0;
+		}
+	}
+
+	return autosave->copy_next == autosave->copy_num;
+}
+
+// Freeing the snapshot takes a while too, it's done here as well
+void autosave_write(void* data, u32 job)
+{
+	Autosave* autosave = data;
+	autosave->written = circuit_write_file(autosave->writing, autosave->path);
+
+	circuit_clear(autosave->writing);
+	circuit_free(autosave->writing);
+	autosave->writing = NULL;
+}
+
+// Takes the state of every instance, now that the layouts are complete, and starts writing
+void autosave_finish(Autosave* autosave)
+{
+	// Like circuit_save, whatever the netlist simulated goes into the things first
+	netlist_sync(&autosave->root->netlist);
+
+	for(u32 i=0; i<autosave->instance_num; ++i)
+	{
+		Autosave_Instance* instance = &autosave->instances[i];
+		Circuit* copy = instance->copy;
+		copy->thing_num = instance->live->thing_num;
+		memcpy(copy->thing_flags, instance->live->thing_flags, sizeof(u8) * copy->thing_num);
+		if (instance->parent == ~0u)
+			continue;
+
+		// Chips of the copied layout still point at the links of the live one
+		Autosave_Instance* parent = &autosave->instances[instance->parent];
+		parent->copy->thing_circuits[instance->slot] = copy;
+		copy->parent = parent->copy;
+		if (parent->owner)
+			chip_copy_links((Chip*)thing_at(parent->copy, instance->slot));
+	}
+
+	autosave->writing = autosave->snapshot;
+	autosave_reset(autosave);
+	autosave->task = thread_task_start(autosave_write, autosave);
+}
+
+// Waits for the writing thread
+void autosave_collect(Autosave* autosave)
+{
+	thread_task_join(autosave->task);
+	autosave->task = NULL;
+
+	if (autosave->written)
+		log("Saved to '%s'; %dB written", autosave->path, (u32)autosave->written);
+	else
+		msg_box("Failed to save circuit '%s'; the file couldn't be written", autosave->path);
+}
+
+void autosave_request(Autosave* autosave)
+{
+	autosave->requested = true;
+}
+
+void autosave_update(Autosave* autosave, float now)
+{
+	if (autosave->task)
+	{
+		if (!thread_task_done(autosave->task))
+			return;
+
+		autosave_collect(autosave);
+	}
+
+	// Starting takes this frame
+	if (!autosave->snapshot)
+	{
+		bool due = autosave->interval > 0 && now - autosave->last_save >= autosave->interval;
+		bool edited = autosave->root->layout_edits != autosave->saved_edits;
+		if (!autosave->requested && !(due && edited))
+			return;
+
+		autosave->last_save = now;
+		autosave->saved_edits = autosave->root->layout_edits;
+		autosave_begin(autosave);
+		return;
+	}
+
+	if (autosave->edits != autosave->root->layout_edits)
+	{
+		autosave->restarts++;
+		autosave_discard(autosave);
+		autosave->saved_edits = autosave->root->layout_edits;
+		autosave_begin(autosave);
+		return;
+	}
+
+	if (autosave_copy(autosave, AUTOSAVE_STEP_BYTES))
+		autosave_finish(autosave);
+}
+
+void autosave_flush(Autosave* autosave)
+{
+	if (autosave->task)
+		autosave_collect(autosave);
+
+	if (autosave->snapshot && autosave->edits != autosave->root->layout_edits)
+		autosave_discard(autosave);
+
+	if (!autosave->snapshot && autosave->requested)
+	{
+		autosave->saved_edits = autosave->root->layout_edits;
+		autosave_begin(autosave);
+	}
+
+	if (!autosave->snapshot)
+		return;
+
+	autosave_copy(autosave, ~(u64)0);
+	autosave_finish(autosave);
+	autosave_collect(autosave);
+}
+
+void autosave_mark_saved(Autosave* autosave)
+{
+	autosave->saved_edits = autosave->root->layout_edits;
+}
+
+void autosave_free(Autosave* autosave)
+{
+	if (autosave->task)
+		autosave_collect(autosave);
+
+	if (autosave->snapshot)
+		autosave_discard(autosave);
+
+	free(autosave->instances);
+	free(autosave->copies);
+	free(autosave->layout_keys);
+	free(autosave->layout_copies);
+	mem_zero(autosave, sizeof(Autosave));
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "circuit.h"
+#include "thread.h"
+
+// Autosave
+// Saves a root circuit on a thread of its own while it keeps being edited and simulated. The thread
+// writes a snapshot: a copy of every layout in the instance tree and of the state of every instance.
+// Copying the layouts of a big design takes longer than a frame, so every autosave_update copies at
+// most AUTOSAVE_STEP_BYTES of them. The simulation only reads layouts, so a copy spread over frames
+// is still consistent unless something in the tree was edited in between (see layout_edits in
+// Circuit), then it's thrown away and started over. State changes every tic but is only a byte per
+// thing, it's copied at the end in one go. Instances sharing a layout share its copy, so the file
+// stores it once.
+// Saves go through a temp file that replaces the old one when it's complete, see circuit_write_file.
+// Saves come every interval, as long as a layout was edited since the last one, or when requested.
+#define AUTOSAVE_STEP_BYTES (4 << 20)
+
+typedef struct
+{
+	const void* from;
+	void* to;
+	u64 size;
+} Autosave_Copy;
+
+typedef struct
+{
+	Circuit* live;
+	Circuit* copy;
+
+	// Instance this is a chip of and the slot of the chip, ~0 for the root
+	u32 parent;
+	u32 slot;
+
+	// The first copy of its layout, the others share it
+	bool owner;
+} Autosave_Instance;
+
+typedef struct
+{
+	Circuit* root;
+	char path[512];
+
+	// In milliseconds, 0 to only save when requested
+	float interval;
+	float last_save;
+	u32 saved_edits;
+	bool requested;
+
+	// Snapshot being copied, NULL while there's none. Its circuits don't know about their things until
+	// all of them are copied, see autosave_finish
+	Circuit* snapshot;
+	u32 edits;
+	Autosave_Instance* instances;
+	u32 instance_num;
+	u32 instance_max;
+	Autosave_Copy* copies;
+	u32 copy_num;
+	u32 copy_max;
+	u32 copy_next;
+	u64 copy_offset;
+
+	// Copies of shared layouts, by the layout_refs of the live layout
+	u32** layout_keys;
+	Circuit** layout_copies;
+	u32 layout_num;
+	u32 layout_max;
+
+	// Snapshot being written, it's freed by the thread writing it. Bytes written, 0 if it failed
+	Thread_Task* task;
+	Circuit* writing;
+	u64 written;
+
+	// Copies thrown away because of edits
+	u32 restarts;
+} Autosave;
+
+void autosave_init(Autosave* autosave, Circuit* root, const char* path, float interval);
+void autosave_free(Autosave* autosave);
+
+// Saves at the next update, whether or not anything was edited
+void autosave_request(Autosave* autosave);
+
+// Moves the save along, call once a frame. In milliseconds, like time_now
+void autosave_update(Autosave* autosave, float now);
+
+// Finishes the save in progress and any requested one, waiting for them to be written
+void autosave_flush(Autosave* autosave);
+
+// The circuit is what's in the file, like after loading it, so there's nothing to save
+void autosave_mark_saved(Autosave* autosave);
@@ -0,0 +1,1526 @@
+#include "bench.h"
+#include "circuit.h"
+#include "bitsim.h"
+#include "run.h"
+#include "vcd.h"
+#include "rewind.h"
+#include "journal.h"
+#include "circfile.h"
+#include "mapfile.h"
+#include "autosave.h"
+#include <stdio.h>
+#include <time.h>
+
+extern u32 tic_pop_count;
+
+#define BENCH_DEFAULT_THINGS 100000
+#define BENCH_MIN_SECONDS 1.0
+#define BENCH_SLICE_GATES 60
+#define BENCH_MEMO_ENTRIES (1 << 16)
+
+// Wall clock time, clock() would add up the time of every thread
+d32 bench_time()
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (d32)now.tv_sec + (d32)now.tv_nsec / 1000000000.0;
+}
+
+// Places a ring oscillator, an inverter whose output is wired back around to its own input
+// Takes up 3x2 cells and 5 things
+void bench_place_oscillator(Circuit* circ, Point origin)
+{
+	Thing_Id in = thing_id(circ, (Thing*)node_create(circ, origin));
+	inverter_create(circ, point_add(origin, point(1, 0)));
+	Thing_Id out = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(2, 0))));
+	Thing_Id turn = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(2, 1))));
+	Thing_Id back = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(0, 1))));
+
+	node_connect(circ, node_get(circ, out), node_get(circ, turn));
+	node_connect(circ, node_get(circ, turn), node_get(circ, back));
+	node_connect(circ, node_get(circ, back), node_get(circ, in));
+}
+
+// Places an inverter followed by a chain of delays, wired back around into a ring
+// Takes up (delay_num * 2 + 3)x2 cells
+void bench_place_ring(Circuit* circ, Point origin, u32 delay_num)
+{
+	Thing_Id in = thing_id(circ, (Thing*)node_create(circ, origin));
+	inverter_create(circ, point_add(origin, point(1, 0)));
+	Thing_Id out = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(2, 0))));
+	for(u32 i=0; i<delay_num; ++i)
+	{
+		delay_create(circ, point_add(origin, point(3 + i * 2, 0)));
+		out = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(4 + i * 2, 0))));
+	}
+
+	i32 end = 2 + delay_num * 2;
+	Thing_Id turn = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(end, 1))));
+	Thing_Id back = thing_id(circ, (Thing*)node_create(circ, point_add(origin, point(0, 1))));
+
+	node_connect(circ, node_get(circ, out), node_get(circ, turn));
+	node_connect(circ, node_get(circ, turn), node_get(circ, back));
+	node_connect(circ, node_get(circ, back), node_get(circ, in));
+}
+
+// Builds a square field of oscillators
+Circuit* bench_make_oscillators(u32 thing_count)
+{
+	Circuit* circ = circuit_make("BENCH");
+	things_reserve(circ, thing_count);
+
+	u32 osc_num = thing_count / 5;
+	u32 cols = 1;
+	while(cols * cols < osc_num)
+		cols++;
+
+	for(u32 i=0; i<osc_num; ++i)
+		bench_place_oscillator(circ, point((i % cols) * 4, (i / cols) * 3));
+
+	return circ;
+}
+
+void bench_tic_throughput(u32 thing_count)
+{
+	d32 begin = bench_time();
+	Circuit* circ = bench_make_oscillators(thing_count);
+	d32 build_time = bench_time() - begin;
+
+	// The first tic compiles the netlist
+	begin = bench_time();
+	circuit_tic(circ);
+	d32 compile_time = bench_time() - begin;
+
+	u32 tic_num = 0;
+	u64 eval_begin = circ->netlist.eval_count;
+	begin = bench_time();
+
+	d32 elapsed = 0.0;
+	while(elapsed < BENCH_MIN_SECONDS)
+	{
+		circuit_tic(circ);
+		tic_num++;
+		elapsed = bench_time() - begin;
+	}
+
+	u64 eval_num = circ->netlist.eval_count - eval_begin;
+	printf("tic_throughput: %u things, built in %.3fs, compiled in %.3fs (%u gates, %u levels)\n",
+		circ->thing_num, build_time, compile_time, circ->netlist.gate_num, circ->netlist.level_num);
+	printf("  %u tics in %.3fs, %.1f tics/s, %.0f gate evals/ms\n",
+		tic_num, elapsed, tic_num / elapsed, eval_num / elapsed / 1000.0);
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Ticks the event-driven engine (the dirty queue), which works directly on the things
+void bench_event_throughput(u32 thing_count)
+{
+	Circuit* circ = bench_make_oscillators(thing_count);
+
+	u32 tic_num = 0;
+	u32 pop_begin = tic_pop_count;
+	d32 begin = bench_time();
+
+	d32 elapsed = 0.0;
+	while(elapsed < BENCH_MIN_SECONDS)
+	{
+		// Subtic until the whole tic is done
+		u32 start_tic = tic;
+		while(tic == start_tic && circ->dirty_queues[circ->queue_index].count != 0)
+			circuit_subtic(circ);
+
+		tic_num++;
+		elapsed = bench_time() - begin;
+	}
+
+	u32 event_num = tic_pop_count - pop_begin;
+	printf("event_throughput: %u things, %u tics in %.3fs, %.1f tics/s, %.0f events/tic, %.0f events/ms\n",
+		circ->thing_num, tic_num, elapsed, tic_num / elapsed, (d32)event_num / tic_num, event_num / elapsed / 1000.0);
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Exhaustively tests a chip of inverters, one public input and one public output per inverter
+void bench_truth_table(u32 input_num)
+{
+	if (input_num > TRUTH_TABLE_MAX_INPUTS)
+		input_num = TRUTH_TABLE_MAX_INPUTS;
+
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+
+	for(u32 i=0; i<input_num; ++i)
+	{
+		node_toggle_public(chip_circ, node_create(chip_circ, point(0, i)));
+		inverter_create(chip_circ, point(1, i));
+	}
+	for(u32 i=0; i<input_num; ++i)
+		node_toggle_public(chip_circ, node_create(chip_circ, point(2, i)));
+
+	Truth_Table table;
+	d32 begin = bench_time();
+	chip_truth_table(circ, chip_get(circ, chip_id), &table);
+	d32 elapsed = bench_time() - begin;
+
+	// Output o is the inverse of input o
+	u32 error_num = 0;
+	for(u32 v=0; v<(1u << table.input_num); ++v)
+	{
+		for(u32 o=0; o<table.output_num; ++o)
+		{
+			if (truth_table_get(&table, v, o) == ((v >> o) & 1))
+				error_num++;
+		}
+	}
+
+	printf("truth_table: %u inputs, %u outputs, %u passes in %.3fs, %u errors\n",
+		table.input_num, table.output_num, table.pass_num, elapsed, error_num);
+
+	truth_table_free(&table);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Inverter chains, each fed by a ring oscillator placed after it, so the chains come first in the netlist.
+// Only the rings are cycles, a chain has to settle within the tic: its output is the inverse of its input
+void bench_cycle_break(u32 chain_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id* firsts = malloc(sizeof(Thing_Id) * chain_num);
+	Thing_Id* lasts = malloc(sizeof(Thing_Id) * chain_num);
+	for(u32 i=0; i<chain_num; ++i)
+	{
+		firsts[i] = thing_id(circ, (Thing*)node_create(circ, point(6, i * 3)));
+		for(u32 k=0; k<3; ++k)
+		{
+			inverter_create(circ, point(7 + k * 2, i * 3));
+			lasts[i] = thing_id(circ, (Thing*)node_create(circ, point(8 + k * 2, i * 3)));
+		}
+	}
+
+	for(u32 i=0; i<chain_num; ++i)
+	{
+		bench_place_oscillator(circ, point(0, i * 3));
+		node_connect(circ, node_find(circ, point(2, i * 3)), node_get(circ, firsts[i]));
+	}
+
+	d32 begin = bench_time();
+	circuit_tic(circ);
+	d32 compile_elapsed = bench_time() - begin;
+
+	u32 tic_num = 64;
+	u32 error_num = 0;
+	for(u32 t=0; t<tic_num; ++t)
+	{
+		circuit_tic(circ);
+		netlist_sync(&circ->netlist);
+		for(u32 i=0; i<chain_num; ++i)
+		{
+			if (thing_active(circ, node_get(circ, firsts[i])) == thing_active(circ, node_get(circ, lasts[i])))
+				error_num++;
+		}
+	}
+
+	printf("cycle_break: %u chains behind later rings, compiled in %.3fs, %u tics, %u errors\n",
+		chain_num, compile_elapsed, tic_num, error_num);
+
+	free(lasts);
+	free(firsts);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Copies a circuit holding many instances of the same chip, like yanking a hierarchical design
+void bench_chip_copy(u32 instance_num, u32 chip_thing_count)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+
+	u32 side = 1;
+	while(side * side * 5 < chip_thing_count)
+		side++;
+
+	for(u32 y=0; y<side; ++y)
+	{
+		for(u32 x=0; x<side && chip_circ->thing_num + 5 <= chip_thing_count; ++x)
+			bench_place_oscillator(chip_circ, point(x * 3, y * 2));
+	}
+
+	// Paste the chip over and over, every paste is another instance of its layout
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(0, 0), point(0, 0)));
+	for(u32 i=1; i<instance_num; ++i)
+	{
+		circuit_shift(clipboard, point(0, 8));
+		circuit_merge(circ, clipboard);
+	}
+
+	Circuit* copy = circuit_make("COPY");
+	u32 copy_num = 0;
+	d32 begin = bench_time();
+	d32 elapsed = 0.0;
+	while(elapsed < BENCH_MIN_SECONDS)
+	{
+		circuit_copy(copy, circ);
+		copy_num++;
+		elapsed = bench_time() - begin;
+	}
+
+	u32 thing_max = chip_circ->thing_max;
+	u32 layout_bytes = sizeof(Thing) * thing_max;
+	u32 instance_bytes = sizeof(Circuit) + (sizeof(u8) + sizeof(u32) + sizeof(Net_Id) + sizeof(u32) + sizeof(Circuit*)) * thing_max;
+	printf("chip_copy: %u instances of %u things, %.3fms per copy, %u layout bytes shared, %u bytes per instance\n",
+		instance_num, chip_circ->thing_num, elapsed * 1000.0 / copy_num, layout_bytes, instance_bytes);
+
+	circuit_clear(copy);
+	circuit_free(copy);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// FNV-1a over the state of a netlist, to check runs are bit-identical
+u64 bench_netlist_hash(Netlist* netlist)
+{
+	u64 hash = 0xCBF29CE484222325ull;
+	for(u32 g=0; g<netlist->gate_num; ++g)
+		hash = (hash ^ netlist->gate_state[g]) * 0x100000001B3ull;
+	for(u32 n=0; n<netlist->net_num; ++n)
+		hash = (hash ^ netlist->net_drive[n]) * 0x100000001B3ull;
+
+	return hash;
+}
+
+// Hash of which gates and nets are on, independent of the order gates were compiled in
+u64 bench_state_hash(Netlist* netlist)
+{
+	u64 hash = 0;
+	for(u32 g=0; g<netlist->gate_num; ++g)
+	{
+		if (!netlist->gate_state[g])
+			continue;
+
+		u64 key = ((u64)(size_t)netlist->gate_circ[g] ^ ((u64)netlist->gate_id[g].index << 48)) * 0x9E3779B97F4A7C15ull;
+		hash ^= key ^ (key >> 29);
+	}
+
+	for(u32 n=1; n<netlist->table_net_num; ++n)
+	{
+		if (netlist->net_drive[n])
+			hash ^= (n + 1) * 0xBF58476D1CE4E5B9ull;
+	}
+
+	return hash;
+}
+
+// Ticks a design of many independent chip instances on 1 to 16 threads
+void bench_tic_scaling(u32 instance_num)
+{
+	// Every chip is an oscillator feeding a chain of inverters and delays
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+
+	bench_place_oscillator(chip_circ, point(0, 0));
+	for(u32 i=0; i<32; ++i)
+	{
+		Point pos = point(3 + i * 2, 0);
+		if (i % 2)
+			delay_create(chip_circ, pos);
+		else
+			inverter_create(chip_circ, pos);
+
+		node_create(chip_circ, point_add(pos, point(1, 0)));
+	}
+
+	// Paste a row of chips, then paste rows of chips
+	u32 row_num = 1;
+	while(row_num * row_num < instance_num)
+		row_num++;
+
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(0, 0), point(0, 0)));
+	for(u32 x=1; x<row_num; ++x)
+	{
+		circuit_shift(clipboard, point(4, 0));
+		circuit_merge(circ, clipboard);
+	}
+
+	circuit_copy_rect(clipboard, circ, rect(point(0, 0), point(row_num * 4, 0)));
+	for(u32 y=1; y<row_num; ++y)
+	{
+		circuit_shift(clipboard, point(0, 6));
+		circuit_merge(circ, clipboard);
+	}
+
+	circuit_tic(circ);
+	Netlist* netlist = &circ->netlist;
+	u32 core_num = thread_core_num();
+	printf("tic_scaling: %u chips, %u gates in %u islands, %u cores\n",
+		row_num * row_num, netlist->gate_num, netlist->island_num, core_num);
+
+	// With a single core the runs can only show what the pool costs
+	if (core_num == 1)
+		printf("  one core, speedup can't be measured, the ratios are overhead\n");
+
+	u32 tic_num = 0;
+	u64 single_hash = 0;
+	d32 single_elapsed = 0.0;
+	for(u32 thread_num=1; thread_num<=16; thread_num<<=1)
+	{
+		// Every run starts from the same state, so their results can be compared.
+		// Things aren't synced while ticking, recompiling starts over from them
+		netlist_compile(netlist, circ);
+		netlist_set_thread_num(thread_num);
+
+		// The single threaded run decides how many tics every run does
+		d32 begin = bench_time();
+		d32 elapsed = 0.0;
+		if (thread_num == 1)
+		{
+			while(elapsed < BENCH_MIN_SECONDS)
+			{
+				circuit_tic(circ);
+				tic_num++;
+				elapsed = bench_time() - begin;
+			}
+		}
+		else
+		{
+			for(u32 i=0; i<tic_num; ++i)
+				circuit_tic(circ);
+
+			elapsed = bench_time() - begin;
+		}
+
+		u64 hash = bench_netlist_hash(netlist);
+		if (thread_num == 1)
+		{
+			single_hash = hash;
+			single_elapsed = elapsed;
+		}
+
+		printf("  %2u threads: %u tics in %.3fs, %.1f tics/s, %.2fx, %s\n",
+			thread_num, tic_num, elapsed, tic_num / elapsed, single_elapsed / elapsed,
+			hash == single_hash ? "identical" : "MISMATCH");
+	}
+
+	netlist_set_thread_num(1);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Runs rings of different lengths far ahead, together they repeat every lcm of their periods.
+// Checked against a plain run of a copy
+void bench_fast_forward(u32 tic_num)
+{
+	static const u32 ring_delays[] = { 3, 5, 7, 11, 13 };
+
+	Circuit* circ = circuit_make("BENCH");
+	for(u32 i=0; i<sizeof(ring_delays) / sizeof(*ring_delays); ++i)
+		bench_place_ring(circ, point(0, i * 3), ring_delays[i]);
+
+	Circuit* plain = circuit_make("PLAIN");
+	circuit_copy(plain, circ);
+
+	u32 start_tic = tic;
+	d32 begin = bench_time();
+	Run_Result result = circuit_run_to(circ, start_tic + tic_num);
+	d32 run_elapsed = bench_time() - begin;
+
+	tic = start_tic;
+	begin = bench_time();
+	for(u32 i=0; i<tic_num; ++i)
+		circuit_tic(plain);
+	d32 plain_elapsed = bench_time() - begin;
+
+	bool identical = netlist_hash(&circ->netlist) == netlist_hash(&plain->netlist);
+	printf("fast_forward: %u tics, ", tic_num);
+	if (result.period)
+		printf("cycle of %u tics from tic %u, ", result.period, result.cycle_start - start_tic);
+	else
+		printf("no cycle, ");
+
+	printf("simulated %u tics in %.3fs, plain run %.3fs, %.1fx, %s\n",
+		result.simulated, run_elapsed, plain_elapsed, plain_elapsed / run_elapsed, identical ? "identical" : "MISMATCH");
+
+	circuit_clear(plain);
+	circuit_free(plain);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Rows of identical slices, every slice feeding the next, with a ring driving the first one of a row.
+// Ticked gate by gate, then with the slices memoized
+void bench_memo_chips(u32 instance_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+
+	// A slice runs public node 0 through a chain of inverters and delays into public node 1
+	node_toggle_public(chip_circ, node_create(chip_circ, point(0, 0)));
+	Thing_Id out = { 0 };
+	for(u32 i=0; i<BENCH_SLICE_GATES; ++i)
+	{
+		Point pos = point(1 + i * 2, 0);
+		if (i % 6 == 5)
+			delay_create(chip_circ, pos);
+		else
+			inverter_create(chip_circ, pos);
+
+		out = thing_id(chip_circ, (Thing*)node_create(chip_circ, point_add(pos, point(1, 0))));
+	}
+
+	node_toggle_public(chip_circ, node_get(chip_circ, out));
+	chip_update(circ, chip_get(circ, chip_id));
+
+	u32 row_num = 1;
+	while(row_num * row_num < instance_num)
+		row_num++;
+
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(-1, 0), point(0, 3)));
+	for(u32 x=1; x<row_num; ++x)
+	{
+		circuit_shift(clipboard, point(6, 0));
+		circuit_merge(circ, clipboard);
+	}
+
+	circuit_copy_rect(clipboard, circ, rect(point(-1, 0), point(row_num * 6, 3)));
+	for(u32 y=1; y<row_num; ++y)
+	{
+		circuit_shift(clipboard, point(0, 6));
+		circuit_merge(circ, clipboard);
+	}
+
+	// Chain the slices of every row, link nodes are left of the chip
+	for(u32 y=0; y<row_num; ++y)
+	{
+		i32 row_y = y * 6;
+		bench_place_ring(circ, point(-40, row_y), 16);
+		node_connect(circ, node_find(circ, point(-38, row_y)), node_find(circ, point(-1, row_y + 1)));
+
+		for(u32 x=0; x+1<row_num; ++x)
+			node_connect(circ, node_find(circ, point(x * 6 - 1, row_y + 2)), node_find(circ, point(x * 6 + 5, row_y + 1)));
+	}
+
+	Netlist* netlist = &circ->netlist;
+	u32 start_tic = tic;
+	u32 tic_num = 0;
+	u64 plain_hash = 0;
+	d32 plain_elapsed = 0.0;
+	for(u32 memo=0; memo<2; ++memo)
+	{
+		// Things aren't synced while ticking, so both runs compile from the same state
+		netlist_set_memo(memo ? BENCH_MEMO_ENTRIES : 0);
+		circuit_invalidate_netlist(circ);
+		netlist_compile(netlist, circ);
+		tic = start_tic;
+
+		d32 begin = bench_time();
+		d32 elapsed = 0.0;
+		if (!memo)
+		{
+			while(elapsed < BENCH_MIN_SECONDS)
+			{
+				circuit_tic(circ);
+				tic_num++;
+				elapsed = bench_time() - begin;
+			}
+		}
+		else
+		{
+			for(u32 i=0; i<tic_num; ++i)
+				circuit_tic(circ);
+
+			elapsed = bench_time() - begin;
+		}
+
+		u64 hash = bench_state_hash(netlist);
+		if (!memo)
+		{
+			plain_hash = hash;
+			plain_elapsed = elapsed;
+			printf("memo_chips: %u slices of %u gates, %u gates\n", row_num * row_num, BENCH_SLICE_GATES, netlist->gate_num);
+			printf("  gate by gate: %u tics in %.3fs, %.1f tics/s\n", tic_num, elapsed, tic_num / elapsed);
+		}
+		else
+		{
+			Memo_Stats stats = netlist_memo_stats(netlist);
+			printf("  memoized: %u tics in %.3fs, %.1f tics/s, %.2fx, %u units, %u caches of %u entries in all, %s\n",
+				tic_num, elapsed, tic_num / elapsed, plain_elapsed / elapsed, stats.unit_num, stats.cache_num, stats.entry_num,
+				hash == plain_hash ? "identical" : "MISMATCH");
+			printf("  %.2f%% of lookups hit, %llu hits, %llu misses, %llu evictions, %llu quiet units skipped\n",
+				100.0 * stats.hits / max(stats.hits + stats.misses, 1), stats.hits, stats.misses, stats.evictions, stats.skips);
+		}
+	}
+
+	netlist_set_memo(0);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Chips of two separate inverters, public in 0 -> out 1 and in 2 -> out 3. Wired up outside so
+// that paths leave a chip and come back in: out 1 through an inverter into in 2 of the same chip,
+// or through in 0 -> out 1 of a second chip that feeds back its in 2 -> out 3. No gate is on a
+// cycle, a tic of these has to come out the same with memoization on and off
+void bench_memo_loops(u32 instance_num, u32 tic_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+	for(u32 i=0; i<2; ++i)
+	{
+		node_toggle_public(chip_circ, node_create(chip_circ, point(0, i * 2)));
+		inverter_create(chip_circ, point(1, i * 2));
+		node_toggle_public(chip_circ, node_create(chip_circ, point(2, i * 2)));
+	}
+
+	chip_update(circ, chip_get(circ, chip_id));
+
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(-1, 0), point(0, 4)));
+	for(u32 i=1; i<instance_num; ++i)
+	{
+		circuit_shift(clipboard, point(0, 8));
+		circuit_merge(circ, clipboard);
+	}
+
+	// Every fourth chip is left alone, fed by rings only
+	for(u32 i=0; i<instance_num; ++i)
+	{
+		i32 y = i * 8;
+		bench_place_ring(circ, point(-40, y), 3 + i % 5);
+		Node* ring = node_find(circ, point(-38, y));
+		if (i % 4 == 0)
+		{
+			node_connect(circ, ring, node_find(circ, point(-1, y + 1)));
+			node_create(circ, point(-4, y + 6));
+			inverter_create(circ, point(-3, y + 6));
+			node_create(circ, point(-2, y + 6));
+			node_connect(circ, node_find(circ, point(-1, y + 2)), node_find(circ, point(-4, y + 6)));
+			node_connect(circ, node_find(circ, point(-2, y + 6)), node_find(circ, point(-1, y + 3)));
+		}
+		else if (i % 4 == 1 && i + 1 < instance_num)
+		{
+			node_connect(circ, ring, node_find(circ, point(-1, y + 1)));
+			node_connect(circ, node_find(circ, point(-1, y + 2)), node_find(circ, point(-1, y + 9)));
+			node_connect(circ, node_find(circ, point(-1, y + 12)), node_find(circ, point(-1, y + 3)));
+		}
+		else if (i % 4 == 2)
+		{
+			node_connect(circ, ring, node_find(circ, point(-1, y + 3)));
+		}
+		else
+		{
+			node_connect(circ, ring, node_find(circ, point(-1, y + 1)));
+			node_connect(circ, ring, node_find(circ, point(-1, y + 3)));
+		}
+	}
+
+	Netlist* netlist = &circ->netlist;
+	u32 start_tic = tic;
+	u64 plain_hash = 0;
+	for(u32 memo=0; memo<2; ++memo)
+	{
+		netlist_set_memo(memo ? BENCH_MEMO_ENTRIES : 0);
+		circuit_invalidate_netlist(circ);
+		netlist_compile(netlist, circ);
+		tic = start_tic;
+
+		// Every tic goes into the hash, not only where they end up
+		u64 hash = 0;
+		for(u32 i=0; i<tic_num; ++i)
+		{
+			circuit_tic(circ);
+			hash = hash * 0x100000001B3ull ^ bench_state_hash(netlist);
+		}
+
+		if (!memo)
+			plain_hash = hash;
+		else
+			printf("memo_loops: %u chips, %u memoized, %u tics, %s\n", instance_num, netlist_memo_stats(netlist).unit_num,
+				tic_num, hash == plain_hash ? "identical" : "MISMATCH");
+	}
+
+	netlist_set_memo(0);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Collects the net of a single wire of node_num nodes
+void bench_net_chain(u32 node_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	things_reserve(circ, node_num);
+
+	Thing_Id prev = thing_id(circ, (Thing*)node_create(circ, point(0, 0)));
+	for(u32 i=1; i<node_num; ++i)
+	{
+		Thing_Id next = thing_id(circ, (Thing*)node_create(circ, point(i, 0)));
+		node_connect(circ, node_get(circ, prev), node_get(circ, next));
+		prev = next;
+	}
+
+	// Break it and collect it again, that's one traversal over every node
+	Node* start = node_find(circ, point(0, 0));
+	node_break_net(circ, start);
+
+	d32 begin = bench_time();
+	Net* net = node_net(circ, start);
+	d32 elapsed = bench_time() - begin;
+
+	printf("net_chain: %u nodes, collected %u nodes in %.3fs, %.1fns per node\n",
+		node_num, net->member_num, elapsed, elapsed * 1000000000.0 / net->member_num);
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Places thing_num things without reserving up front, then deletes every other one and places them again,
+// which has to reuse the deleted slots
+void bench_thing_churn(u32 thing_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	u32 side = 1;
+	while(side * side < thing_num)
+		side++;
+
+	d32 begin = bench_time();
+	for(u32 i=0; i<thing_num; ++i)
+		thing_create(circ, (i & 1) ? THING_Inverter : THING_Delay, point(i % side, i / side));
+	d32 place_time = bench_time() - begin;
+
+	begin = bench_time();
+	for(u32 i=0; i<thing_num; i += 2)
+		thing_delete(circ, thing_at(circ, i));
+	d32 delete_time = bench_time() - begin;
+
+	begin = bench_time();
+	for(u32 i=0; i<thing_num; i += 2)
+		thing_create(circ, THING_Delay, point(i % side, i / side));
+	d32 replace_time = bench_time() - begin;
+
+	printf("thing_churn: %u things placed in %.3fs, half deleted in %.3fs and placed again in %.3fs, %u slots\n",
+		thing_num, place_time, delete_time, replace_time, circ->thing_num);
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Pastes a block of block_count things into a field of board_count things, half of the block lands on existing things
+void bench_merge(u32 board_count, u32 block_count)
+{
+	Circuit* circ = bench_make_oscillators(board_count);
+	Circuit* block = bench_make_oscillators(block_count);
+
+	Rect bounds = thing_get_bbox(thing_at(block, 0));
+	THINGS_FOREACH(block, THING_All)
+	{
+		Rect bbox = thing_get_bbox(it);
+		bounds.max.x = max(bounds.max.x, bbox.max.x);
+	}
+
+	circuit_shift(block, point(bounds.max.x / 2, 0));
+	u32 before_num = circ->thing_num;
+
+	d32 begin = bench_time();
+	circuit_merge(circ, block);
+	d32 elapsed = bench_time() - begin;
+
+	u32 thing_num = 0;
+	THINGS_FOREACH(circ, THING_All)
+	{
+		thing_num++;
+	}
+
+	printf("merge: %u things into %u, %u things after, %.3fms\n",
+		block->thing_num, before_num, thing_num, elapsed * 1000.0);
+
+	circuit_clear(block);
+	circuit_free(block);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Hit-tests random cells against a field of wire_num wires, half horizontal and half vertical
+void bench_wire_hit(u32 wire_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	things_reserve(circ, wire_num * 2);
+
+	// Every wire spans 4 cells, a horizontal one on top of a vertical one in a 6x6 cell
+	u32 cols = 1;
+	while(cols * cols * 2 < wire_num)
+		cols++;
+
+	for(u32 i=0; i<wire_num; ++i)
+	{
+		Point origin = point((i / 2 % cols) * 6, (i / 2 / cols) * 6);
+		Point a = (i & 1) ? point_add(origin, point(0, 1)) : origin;
+		Point b = (i & 1) ? point_add(origin, point(0, 4)) : point_add(origin, point(4, 0));
+		node_connect(circ, node_create(circ, a), node_create(circ, b));
+	}
+
+	u32 test_num = 1000000;
+	u32 hit_num = 0;
+	u32 seed = 1;
+
+	d32 begin = bench_time();
+	for(u32 i=0; i<test_num; ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		Point cell = point((seed >> 8) % (cols * 6), (seed >> 20) % (cols * 6));
+		if (connection_find(circ, cell).a)
+			hit_num++;
+	}
+	d32 elapsed = bench_time() - begin;
+
+	printf("wire_hit: %u wires, %u hit-tests in %.3fs, %.1fns per test, %u hits\n",
+		wire_num, test_num, elapsed, elapsed * 1000000000.0 / test_num, hit_num);
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// A single row of wire_num short wires with a long one under all of them, hit-tested between the short
+// ones where only the long one is, then the short wires at the start of the row removed and put back
+void bench_wire_line(u32 wire_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	things_reserve(circ, wire_num * 2 + 2);
+
+	i32 length = wire_num * 4;
+	node_connect(circ, node_create(circ, point(-1, 0)), node_create(circ, point(length, 0)));
+	for(u32 i=0; i<wire_num; ++i)
+		node_connect(circ, node_create(circ, point(i * 4, 0)), node_create(circ, point(i * 4 + 2, 0)));
+
+	u32 test_num = 100000;
+	u32 hit_num = 0;
+	u32 seed = 1;
+
+	d32 begin = bench_time();
+	for(u32 i=0; i<test_num; ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		Wire* wires[4];
+		hit_num += wires_find(&circ->wires, point((seed >> 8) % wire_num * 4 + 3, 0), wires, 4);
+	}
+	d32 hit_time = bench_time() - begin;
+
+	u32 edit_num = min(wire_num, 10000);
+	begin = bench_time();
+	for(u32 i=0; i<edit_num; ++i)
+		node_disconnect(circ, node_find(circ, point(i * 4, 0)), node_find(circ, point(i * 4 + 2, 0)));
+	for(u32 i=0; i<edit_num; ++i)
+		node_connect(circ, node_find(circ, point(i * 4, 0)), node_find(circ, point(i * 4 + 2, 0)));
+	d32 edit_time = bench_time() - begin;
+
+	printf("wire_line: %u wires in a row, %u hit-tests in %.3fs, %.1fns per test, %u hits, %u wires removed and put back, %.1fns per edit\n",
+		wire_num, test_num, hit_time, hit_time * 1000000000.0 / test_num, hit_num,
+		edit_num, edit_time * 1000000000.0 / (edit_num * 2));
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Ticks chips with a public node at both ends of a chain while recording every public node. The oscillator
+// flips every probe every tic, the worst case. Ticking and sampling are timed apart in the same run, so
+// the overhead doesn't depend on how steady two separate runs are
+void bench_vcd(u32 instance_num, u32 tic_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip_create(circ, point(0, 0)));
+	Circuit* chip_circ = chip_circuit(circ, chip_get(circ, chip_id));
+
+	bench_place_oscillator(chip_circ, point(0, 0));
+	for(u32 i=0; i<32; ++i)
+	{
+		Point pos = point(3 + i * 2, 0);
+		if (i % 2)
+			delay_create(chip_circ, pos);
+		else
+			inverter_create(chip_circ, pos);
+
+		node_create(chip_circ, point_add(pos, point(1, 0)));
+	}
+
+	node_toggle_public(chip_circ, node_find(chip_circ, point(2, 0)));
+	node_toggle_public(chip_circ, node_find(chip_circ, point(3 + 31 * 2 + 1, 0)));
+
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(0, 0), point(0, 0)));
+	for(u32 i=1; i<instance_num; ++i)
+	{
+		circuit_shift(clipboard, point(0, 6));
+		circuit_merge(circ, clipboard);
+	}
+
+	circuit_tic(circ);
+
+	Vcd_Recorder vcd;
+	if (!vcd_open(&vcd, circ, "bench.vcd"))
+	{
+		printf("vcd: can't write bench.vcd\n");
+		return;
+	}
+
+	d32 tic_elapsed = 0;
+	d32 vcd_elapsed = 0;
+	for(u32 i=0; i<tic_num; ++i)
+	{
+		d32 begin = bench_time();
+		circuit_tic(circ);
+		d32 sample_begin = bench_time();
+		vcd_sample(&vcd);
+		d32 end = bench_time();
+
+		tic_elapsed += sample_begin - begin;
+		vcd_elapsed += end - sample_begin;
+	}
+
+	u32 probe_num = vcd.probe_num;
+	d32 begin = bench_time();
+	vcd_close(&vcd);
+	vcd_elapsed += bench_time() - begin;
+
+	FILE* file = fopen("bench.vcd", "rb");
+	fseek(file, 0, SEEK_END);
+	u32 size = ftell(file);
+	fclose(file);
+	remove("bench.vcd");
+
+	printf("vcd: %u chips, %u probes, %u tics in %.3fs, %.3fs sampling and writing (%+.1f%%), %.1fMB written\n",
+		instance_num, probe_num, tic_num, tic_elapsed, vcd_elapsed,
+		vcd_elapsed / tic_elapsed * 100.0, size / 1000000.0);
+
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Rings of different lengths, so the state doesn't repeat soon. Records every tic, then steps and seeks
+// back through the history, checking the state against the hash it had when it was simulated
+void bench_rewind(u32 ring_num, u32 tic_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	for(u32 i=0; i<ring_num; ++i)
+		bench_place_ring(circ, point(0, i * 3), 1 + i % 31);
+
+	circuit_tic(circ);
+
+	d32 begin = bench_time();
+	for(u32 i=0; i<tic_num; ++i)
+		circuit_tic(circ);
+	d32 plain_elapsed = bench_time() - begin;
+
+	Rewind rewind;
+	rewind_init(&rewind, 64 << 20, 256);
+	circ->rewind = &rewind;
+
+	u32 first = tic;
+	u64* hashes = malloc(sizeof(u64) * (tic_num + 1));
+	begin = bench_time();
+	for(u32 i=0; i<tic_num; ++i)
+	{
+		circuit_tic(circ);
+		hashes[tic - first] = netlist_hash(&circ->netlist);
+	}
+	d32 record_elapsed = bench_time() - begin;
+
+	u32 step_num = min(tic_num - 1, 1000);
+	u32 mismatches = 0;
+	begin = bench_time();
+	for(u32 i=0; i<step_num; ++i)
+	{
+		rewind_step(&rewind, circ, -1);
+		mismatches += netlist_hash(&circ->netlist) != hashes[tic - first];
+	}
+	d32 step_elapsed = bench_time() - begin;
+
+	begin = bench_time();
+	rewind_seek(&rewind, circ, rewind_first_tic(&rewind));
+	d32 seek_elapsed = bench_time() - begin;
+	mismatches += netlist_hash(&circ->netlist) != hashes[tic - first];
+	u32 seek_tic = tic;
+
+	printf("rewind: %u gates, %u tics in %.3fs plain, %.3fs recording (%+.1f%%), %u tics kept in %.1fMB\n",
+		circ->netlist.gate_num, tic_num, plain_elapsed, record_elapsed, (record_elapsed / plain_elapsed - 1.0) * 100.0,
+		rewind_last_tic(&rewind) - rewind_first_tic(&rewind) + 1, rewind_used_bytes(&rewind) / 1000000.0);
+	printf("        step back %.1fus per tic, seek back %u tics in %.3fms, %u mismatches\n",
+		step_elapsed / step_num * 1000000.0, first + tic_num - step_num - seek_tic, seek_elapsed * 1000.0, mismatches);
+
+	circ->rewind = NULL;
+	rewind_free(&rewind);
+	circuit_clear(circ);
+	circuit_free(circ);
+
+	// Rings in memoized chips, ticking on from a seek has to go the way it did the first time
+	netlist_set_memo(BENCH_MEMO_ENTRIES);
+	circ = circuit_make("MEMOIZED");
+	for(u32 i=0; i<ring_num / 8; ++i)
+	{
+		Chip* chip = chip_create(circ, point(0, i * 8));
+		bench_place_ring(chip_circuit(circ, chip), point(0, 0), 1 + i % 7);
+		chip_update(circ, chip);
+	}
+
+	circuit_tic(circ);
+	rewind_init(&rewind, 64 << 20, 256);
+	circ->rewind = &rewind;
+
+	u32 replay_num = min(tic_num, 1000);
+	first = tic;
+	for(u32 i=0; i<replay_num; ++i)
+	{
+		circuit_tic(circ);
+		hashes[tic - first] = netlist_hash(&circ->netlist);
+	}
+
+	rewind_seek(&rewind, circ, first + replay_num / 3);
+	u32 replay_mismatches = 0;
+	while(tic < first + replay_num)
+	{
+		circuit_tic(circ);
+		replay_mismatches += netlist_hash(&circ->netlist) != hashes[tic - first];
+	}
+
+	printf("        ticked on %u tics from a seek, %u memoized chips, %u mismatches\n",
+		replay_num - replay_num / 3, netlist_memo_stats(&circ->netlist).unit_num, replay_mismatches);
+
+	netlist_set_memo(0);
+	free(hashes);
+	circ->rewind = NULL;
+	rewind_free(&rewind);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+u64 bench_mix(u64 key)
+{
+	key *= 0x9E3779B97F4A7C15ull;
+	return key ^ (key >> 29);
+}
+
+u64 bench_point_key(Point pnt)
+{
+	return ((u64)(u32)pnt.x << 32) | (u32)pnt.y;
+}
+
+// Hash of the things, connections, link types and public slots of a layout, chips included,
+// independent of the order or slots things are in
+u64 bench_layout_hash(Circuit* circ)
+{
+	u64 hash = 0;
+	THINGS_FOREACH(circ, THING_All)
+	{
+		hash += bench_mix(bench_point_key(it->pos) ^ ((u64)it->type << 60));
+		if (it->type == THING_Chip)
+			hash += bench_mix(bench_layout_hash(chip_circuit(circ, (Chip*)it)) + 1);
+
+		if (it->type != THING_Node)
+			continue;
+
+		Node* node = (Node*)it;
+		hash += bench_mix(bench_point_key(node->pos) * 7 + node->link_type);
+		for(u32 i=0; i<4; ++i)
+		{
+			Node* other = node_get(circ, node->connections[i]);
+			if (other)
+				hash += bench_mix(bench_point_key(node->pos) * 31 + bench_mix(bench_point_key(other->pos)));
+		}
+	}
+
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		Node* node = node_get(circ, circ->public_nodes[i]);
+		if (node)
+			hash += bench_mix(bench_point_key(node->pos) + i + 7);
+	}
+
+	return hash;
+}
+
+// Makes edit_num random edits on a small field through the journal, the way the board does: placing,
+// connecting, deleting and making nodes public, and every so often pasting a ring and a chip.
+// Then undoes all of them and redoes them again, checking the layout on the way
+void bench_journal(u32 edit_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	bench_place_ring(clipboard, point(0, 0), 2);
+	node_toggle_public(clipboard, node_find(clipboard, point(0, 0)));
+	Chip* chip = chip_create(clipboard, point(0, 3));
+	Circuit* chip_circ = chip_circuit(clipboard, chip);
+	bench_place_oscillator(chip_circ, point(0, 0));
+	node_toggle_public(chip_circ, node_find(chip_circ, point(2, 0)));
+
+	Journal journal;
+	journal_init(&journal, 1u << 30);
+
+	u32 check_num = edit_num / 1000 + 1;
+	u64* hashes = malloc(sizeof(u64) * check_num);
+	u32* dones = malloc(sizeof(u32) * check_num);
+	hashes[0] = bench_layout_hash(circ);
+	dones[0] = 0;
+
+	i32 side = 64;
+	u32 seed = 1;
+	d32 begin = bench_time();
+	for(u32 i=0; i<edit_num; ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		Point pos = point((seed >> 8) % side, (seed >> 16) % side);
+		u32 kind = (seed >> 24) % 100;
+
+		journal_begin(&journal, circ);
+		Thing* thing = thing_find(circ, pos, THING_All);
+		if (i % 1000 == 999)
+		{
+			circuit_shift(clipboard, pos);
+			journal_merge(&journal, circ, clipboard);
+			circuit_shift(clipboard, point_inv(pos));
+		}
+		else if (kind < 40)
+		{
+			if (!thing)
+				journal_create(&journal, circ, kind < 30 ? THING_Node : kind < 35 ? THING_Inverter : THING_Delay, pos);
+		}
+		else if (kind < 70)
+		{
+			// Wire to a node further along the row or column
+			Point to = (kind & 1) ? point_add(pos, point(1 + kind % 5, 0)) : point_add(pos, point(0, 1 + kind % 5));
+			Node* a = node_find(circ, pos);
+			Node* b = node_find(circ, to);
+			if (a && b && a != b)
+				journal_connect(&journal, circ, a, b);
+		}
+		else if (kind < 90)
+		{
+			if (thing)
+				journal_delete(&journal, circ, thing);
+		}
+		else if (kind < 95)
+		{
+			Node* node = node_find(circ, pos);
+			if (node)
+				journal_toggle_public(&journal, circ, node);
+		}
+		else
+		{
+			// Only on free cells, pasting over things that overlap can resolve differently when redone
+			bool blocked = false;
+			for(i32 c=0; c<3 * 5; ++c)
+				blocked |= thing_find(circ, point_add(pos, point(c % 3, c / 3)), THING_All) != NULL;
+
+			if (!blocked)
+				journal_create(&journal, circ, THING_Chip, pos);
+		}
+		journal_end(&journal);
+
+		if (i % 1000 == 999)
+		{
+			hashes[(i + 1) / 1000] = bench_layout_hash(circ);
+			dones[(i + 1) / 1000] = journal.done;
+		}
+	}
+	d32 edit_elapsed = bench_time() - begin;
+
+	u32 group_num = journal.done;
+	u32 thing_num = 0;
+	THINGS_FOREACH(circ, THING_All)
+	{
+		thing_num++;
+	}
+
+	// Back to the start, checking every checkpoint on the way
+	u32 mismatches = 0;
+	begin = bench_time();
+	for(u32 c=check_num; c>0; --c)
+	{
+		while(journal.done > dones[c - 1])
+			journal_undo(&journal, circ);
+
+		mismatches += bench_layout_hash(circ) != hashes[c - 1];
+	}
+	d32 undo_elapsed = bench_time() - begin;
+
+	begin = bench_time();
+	for(u32 c=1; c<check_num; ++c)
+	{
+		while(journal.done < dones[c])
+			journal_redo(&journal, circ);
+
+		mismatches += bench_layout_hash(circ) != hashes[c];
+	}
+	d32 redo_elapsed = bench_time() - begin;
+
+	printf("journal: %u edits in %u groups in %.3fs, %u things after, %.1fMB journal\n",
+		edit_num, group_num, edit_elapsed, thing_num, journal.bytes / 1000000.0);
+	printf("         undo all in %.3fs, redo all in %.3fs, %u checkpoints, %u mismatches\n",
+		undo_elapsed, redo_elapsed, check_num, mismatches);
+
+	free(hashes);
+	free(dones);
+	journal_free(&journal);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Legacy writer, kept for migrating old files, see circuit_fread
+void circuit_fwrite(Circuit* circ, FILE* file);
+
+// Hash of the layout and the state of every instance in it
+u64 bench_instance_hash(Circuit* circ)
+{
+	u64 hash = bench_layout_hash(circ);
+	THINGS_FOREACH(circ, THING_All)
+	{
+		u8 state = circ->thing_flags[it->index] & (FLAG_Active | FLAG_Powered);
+		hash += bench_mix(bench_point_key(it->pos) ^ ((u64)state << 62));
+		if (it->type == THING_Chip)
+			hash += bench_mix(bench_instance_hash(chip_circuit(circ, (Chip*)it)) + 3);
+	}
+
+	return hash;
+}
+
+// Saves and loads a circuit in the legacy format and the current one, checking both load the same
+void bench_circfile_compare(Circuit* circ, const char* label)
+{
+	netlist_sync(&circ->netlist);
+	u64 hash = bench_instance_hash(circ);
+	Circuit* loaded = circuit_make("LOADED");
+
+	d32 begin = bench_time();
+	FILE* file = fopen("bench.circ", "wb");
+	if (!file)
+	{
+		printf("circfile: can't write bench.circ\n");
+		circuit_free(loaded);
+		return;
+	}
+	circuit_fwrite(circ, file);
+	u32 legacy_size = ftell(file);
+	fclose(file);
+	d32 legacy_save = bench_time() - begin;
+
+	begin = bench_time();
+	circuit_load(loaded, "bench.circ");
+	d32 legacy_load = bench_time() - begin;
+	bool legacy_match = bench_instance_hash(loaded) == hash;
+
+	begin = bench_time();
+	circuit_save(circ, "bench.circ");
+	d32 save = bench_time() - begin;
+
+	file = fopen("bench.circ", "rb");
+	fseek(file, 0, SEEK_END);
+	u32 size = ftell(file);
+	fclose(file);
+
+	// Freeing what the legacy load made isn't part of loading
+	circuit_clear(loaded);
+	begin = bench_time();
+	circuit_load(loaded, "bench.circ");
+	d32 load = bench_time() - begin;
+	bool match = bench_instance_hash(loaded) == hash;
+	remove("bench.circ");
+
+	// Legacy ids are 16 bit, bigger circuits can't come back the same
+	const char* legacy_result = legacy_match ? "identical" : circ->thing_num > 0xFFFF ? "too big for 16 bit ids" : "MISMATCH";
+	printf("  %s: legacy %.2fMB, save %.3fs, load %.3fs, %s\n",
+		label, legacy_size / 1000000.0, legacy_save, legacy_load, legacy_result);
+	printf("  %s: current %.3fMB, save %.3fs, load %.3fs, %s; %.1fx smaller, %.1fx faster load\n",
+		label, size / 1000000.0, save, load, match ? "identical" : "MISMATCH",
+		(d32)legacy_size / size, legacy_load / load);
+
+	circuit_clear(loaded);
+	circuit_free(loaded);
+}
+
+// A chip pasted over and over like bench_chip_copy, where the current format stores the layout once,
+// and flat fields of oscillators, where it can't share anything: one as big as the legacy format can
+// hold, and one of a million things, which is written raw
+void bench_circfile(u32 instance_num, u32 chip_thing_count)
+{
+	Circuit* circ = circuit_make("BENCH");
+	Chip* chip = chip_create(circ, point(0, 0));
+	Circuit* chip_circ = chip_circuit(circ, chip);
+
+	u32 side = 1;
+	while(side * side * 5 < chip_thing_count)
+		side++;
+
+	for(u32 y=0; y<side; ++y)
+	{
+		for(u32 x=0; x<side && chip_circ->thing_num + 5 <= chip_thing_count; ++x)
+			bench_place_oscillator(chip_circ, point(x * 3, y * 2));
+	}
+
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	circuit_copy_rect(clipboard, circ, rect(point(0, 0), point(0, 0)));
+	for(u32 i=1; i<instance_num; ++i)
+	{
+		circuit_shift(clipboard, point(0, 8));
+		circuit_merge(circ, clipboard);
+	}
+
+	// Some state to save
+	for(u32 i=0; i<3; ++i)
+		circuit_tic(circ);
+
+	printf("circfile: %u chips of %u things\n", instance_num, chip_circ->thing_num);
+	bench_circfile_compare(circ, "chips");
+
+	// Past CIRCFILE_RAW_MIN things a layout is written raw, to be mapped, not packed
+	static const u32 flat_nums[] = { 0x10000, 1000000 };
+	for(u32 f=0; f<sizeof(flat_nums) / sizeof(*flat_nums); ++f)
+	{
+		circuit_clear(circ);
+		u32 flat_side = 1;
+		while(flat_side * flat_side * 5 < flat_nums[f])
+			flat_side++;
+
+		for(u32 y=0; y<flat_side; ++y)
+		{
+			for(u32 x=0; x<flat_side && circ->thing_num + 5 <= flat_nums[f]; ++x)
+				bench_place_oscillator(circ, point(x * 3, y * 2));
+		}
+
+		for(u32 i=0; i<3; ++i)
+			circuit_tic(circ);
+
+		printf("circfile: flat, %u things\n", circ->thing_num);
+		bench_circfile_compare(circ, "flat");
+	}
+
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Loads a big flat design from a mapped file and from a copy of it. Mapped, only the pages that are
+// touched get read, the first tic after loading touches all of them
+void bench_mapped_load(u32 thing_num)
+{
+	Circuit* circ = circuit_make("BENCH");
+	u32 side = 1;
+	while(side * side * 5 < thing_num)
+		side++;
+
+	for(u32 y=0; y<side; ++y)
+	{
+		for(u32 x=0; x<side && circ->thing_num + 5 <= thing_num; ++x)
+			bench_place_oscillator(circ, point(x * 3, y * 2));
+	}
+
+	circuit_tic(circ);
+	d32 begin = bench_time();
+	circuit_save(circ, "bench.circ");
+	d32 save = bench_time() - begin;
+	netlist_sync(&circ->netlist);
+	u64 hash = bench_instance_hash(circ);
+
+	Circuit* loaded = circuit_make("LOADED");
+	begin = bench_time();
+	Mapped_File* file = mapped_file_open("bench.circ");
+	bool mapped = file && circfile_map(loaded, file);
+	d32 map = bench_time() - begin;
+	if (!file)
+	{
+		printf("mapped load: can't map bench.circ\n");
+		circuit_free(loaded);
+		circuit_clear(circ);
+		circuit_free(circ);
+		return;
+	}
+
+	u64 size = file->size;
+	bool map_match = mapped && bench_instance_hash(loaded) == hash;
+	circuit_dirty_all(loaded);
+	begin = bench_time();
+	circuit_tic(loaded);
+	d32 map_tic = bench_time() - begin;
+
+	// Same file, read and parsed from memory
+	begin = bench_time();
+	Circuit* copied = circuit_make("COPIED");
+	bool copy_match = circfile_read(copied, file->data, file->size) && bench_instance_hash(copied) == hash;
+	d32 copy = bench_time() - begin;
+	circuit_dirty_all(copied);
+	begin = bench_time();
+	circuit_tic(copied);
+	d32 copy_tic = bench_time() - begin;
+	mapped_file_release(file);
+
+	printf("mapped load: %u things, %.1f MB, saved in %.3f s\n", circ->thing_num, size / 1e6, save);
+	printf("  mapped: %.3f s, first tic %.3f s (%s)\n", map, map_tic, map_match ? "identical" : "MISMATCH");
+	printf("  copied: %.3f s, first tic %.3f s (%s), mapping is %.1fx faster\n", copy, copy_tic,
+		copy_match ? "identical" : "MISMATCH", copy / max(map, 1e-9));
+	remove("bench.circ");
+
+	circuit_clear(copied);
+	circuit_free(copied);
+	circuit_clear(loaded);
+	circuit_free(loaded);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+// Runs frames of a tic each, with a save in the background, until it's written. Edits on the
+// frames in edit_frames, which throw away the copy that's in progress. Returns the slowest update
+// Edits on the given frames place a node in edited, or paste into it when there's something to paste
+d32 bench_autosave_frames(Circuit* circ, Autosave* autosave, Circuit* edited, Circuit* paste,
+	u32 edit_frames, bool* consistent)
+{
+	autosave_request(autosave);
+	u32 restarts = autosave->restarts;
+	u32 frame = 0;
+	u64 hash = 0;
+	d32 slowest = 0;
+	d32 begin = bench_time();
+	while(frame == 0 || autosave->snapshot || autosave->task)
+	{
+		// The editor syncs every frame to draw
+		circuit_tic(circ);
+		if (frame < 32 && (edit_frames & (1u << frame)) && paste)
+		{
+			circuit_shift(paste, point(0, -4));
+			circuit_merge(edited, paste);
+		}
+		else if (frame < 32 && (edit_frames & (1u << frame)))
+			node_create(edited, point(-2 - (i32)frame * 2, -2));
+		netlist_sync(&circ->netlist);
+
+		bool copying = autosave->snapshot != NULL;
+		d32 update_begin = bench_time();
+		autosave_update(autosave, frame * 16.7f);
+		slowest = max(slowest, bench_time() - update_begin);
+
+		// The snapshot was completed this frame, the file has to have this state
+		if (copying && autosave->task)
+			hash = bench_instance_hash(circ);
+
+		frame++;
+	}
+
+	d32 total = bench_time() - begin;
+	Circuit* loaded = circuit_make("LOADED");
+	*consistent = circuit_load(loaded, "bench.circ") && bench_instance_hash(loaded) == hash;
+	printf("  %u frames, %.3f s, %u restarts, slowest update %.2f ms (%s)\n", frame, total,
+		autosave->restarts - restarts, slowest * 1000, *consistent ? "consistent" : "INCONSISTENT");
+
+	circuit_clear(loaded);
+	circuit_free(loaded);
+	return slowest;
+}
+
+void bench_autosave(u32 thing_num)
+{
+	// Flat, with chips sharing a layout on the side
+	Circuit* circ = circuit_make("BENCH");
+	Circuit* clipboard = circuit_make("CLIPBOARD");
+	Chip* chip = chip_create(clipboard, point(0, 0));
+	for(u32 i=0; i<8; ++i)
+		bench_place_oscillator(chip_circuit(clipboard, chip), point(0, i * 2));
+
+	for(u32 i=0; i<64; ++i)
+	{
+		circuit_shift(clipboard, point(0, i ? 8 : -8 * 64));
+		circuit_merge(circ, clipboard);
+	}
+
+	u32 side = 1;
+	while(side * side * 5 < thing_num)
+		side++;
+
+	for(u32 y=0; y<side; ++y)
+	{
+		for(u32 x=0; x<side && circ->thing_num + 5 <= thing_num; ++x)
+			bench_place_oscillator(circ, point(x * 3, y * 2));
+	}
+
+	circuit_tic(circ);
+	d32 begin = bench_time();
+	circuit_save(circ, "bench.circ");
+	d32 save = bench_time() - begin;
+	printf("autosave: %u things, circuit_save blocks for %.3f s\n", circ->thing_num, save);
+
+	Autosave autosave;
+	autosave_init(&autosave, circ, "bench.circ", 0);
+	bool consistent = false;
+	printf("  in the background:\n");
+	bench_autosave_frames(circ, &autosave, circ, NULL, 0, &consistent);
+	printf("  edited while copying:\n");
+	u32 edit_frames = (1 << 2) | (1 << 5) | (1 << 9);
+	bench_autosave_frames(circ, &autosave, circ, NULL, edit_frames, &consistent);
+
+	// Pasting fits in what the board has reserved, nothing is grown
+	Circuit* inverters = circuit_make("INVERTERS");
+	for(u32 i=0; i<5; ++i)
+		inverter_create(inverters, point(-8 - (i32)i * 2, 0));
+
+	printf("  pasted into while copying:\n");
+	bench_autosave_frames(circ, &autosave, circ, inverters, edit_frames, &consistent);
+
+	// Nothing the copy reads changes, it shouldn't start over
+	printf("  clipboard edited while copying:\n");
+	bench_autosave_frames(circ, &autosave, clipboard, inverters, edit_frames, &consistent);
+	autosave_free(&autosave);
+	remove("bench.circ");
+
+	circuit_clear(inverters);
+	circuit_free(inverters);
+	circuit_clear(clipboard);
+	circuit_free(clipboard);
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+void bench_run(i32 argc, char** argv)
+{
+	u32 thing_count = BENCH_DEFAULT_THINGS;
+	if (argc > 0)
+		thing_count = atoi(argv[0]);
+
+	bench_tic_throughput(thing_count);
+	bench_event_throughput(thing_count);
+	bench_truth_table(16);
+	bench_cycle_break(10000);
+	bench_chip_copy(256, 4096);
+	bench_tic_scaling(4096);
+	bench_fast_forward(10000000);
+	bench_memo_chips(1024);
+	bench_memo_loops(1024, 256);
+	bench_net_chain(10000);
+	bench_net_chain(100000);
+	bench_net_chain(1000000);
+	bench_thing_churn(1000000);
+	bench_merge(thing_count, thing_count / 10);
+	bench_wire_hit(500000);
+	bench_wire_line(1000);
+	bench_wire_line(100000);
+	bench_vcd(1024, 2000);
+	bench_rewind(10000, 5000);
+	bench_journal(100000);
+	bench_circfile(256, 4096);
+	bench_mapped_load(6000000);
+	bench_autosave(1000000);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "circuit.h"
+
+// Headless benchmarks, run with 'game.exe -bench [thing count]' or 'build/sim -bench [thing count]'
+void bench_run(i32 argc, char** argv);
+d32 bench_time();
+void bench_place_ring(Circuit* circ, Point origin, u32 delay_num);
+void bench_tic_throughput(u32 thing_count);
+void bench_truth_table(u32 input_num);
+void bench_cycle_break(u32 chain_num);
+void bench_event_throughput(u32 thing_count);
+void bench_chip_copy(u32 instance_num, u32 chip_thing_count);
+void bench_tic_scaling(u32 instance_num);
+void bench_fast_forward(u32 tic_num);
+void bench_memo_chips(u32 instance_num);
+void bench_memo_loops(u32 instance_num, u32 tic_num);
+void bench_net_chain(u32 node_num);
+void bench_thing_churn(u32 thing_num);
+void bench_merge(u32 board_count, u32 block_count);
+void bench_wire_hit(u32 wire_num);
+void bench_wire_line(u32 wire_num);
+void bench_vcd(u32 instance_num, u32 tic_num);
+void bench_rewind(u32 ring_num, u32 tic_num);
+void bench_journal(u32 edit_num);
+void bench_circfile(u32 instance_num, u32 chip_thing_count);
+void bench_mapped_load(u32 thing_num);
+void bench_autosave(u32 thing_num);
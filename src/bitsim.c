@@ -0,0 +1,222 @@
+#include "bitsim.h"
+#include "circuit.h"
+
+void bitsim_init(Bitsim* sim, Netlist* netlist)
+{
+	zero_t(*sim);
+	sim->netlist = netlist;
+
+	u32 gate_num = netlist->gate_num;
+	u32 net_num = netlist->net_num;
+
+	sim->gate_word = malloc(sizeof(u64) * (gate_num + 1));
+	sim->delay_next = malloc(sizeof(u64) * (gate_num + 1));
+	sim->net_force = malloc(sizeof(u64) * net_num);
+	mem_zero(sim->net_force, sizeof(u64) * net_num);
+
+	sim->driver_start = malloc(sizeof(u32) * (net_num + 1));
+	sim->drivers = malloc(sizeof(u32) * (gate_num + 1));
+	mem_zero(sim->driver_start, sizeof(u32) * (net_num + 1));
+
+	for(u32 g=0; g<gate_num; ++g)
+		sim->driver_start[netlist->gate_output[g] + 1]++;
+	for(u32 n=0; n<net_num; ++n)
+		sim->driver_start[n + 1] += sim->driver_start[n];
+
+	u32* driver_fill = malloc(sizeof(u32) * (net_num + 1));
+	memcpy(driver_fill, sim->driver_start, sizeof(u32) * (net_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+		sim->drivers[driver_fill[netlist->gate_output[g]]++] = g;
+
+	free(driver_fill);
+	bitsim_reset(sim);
+}
+
+void bitsim_free(Bitsim* sim)
+{
+	free(sim->gate_word);
+	free(sim->delay_next);
+	free(sim->net_force);
+	free(sim->driver_start);
+	free(sim->drivers);
+
+	zero_t(*sim);
+}
+
+void bitsim_reset(Bitsim* sim)
+{
+	mem_zero(sim->gate_word, sizeof(u64) * (sim->netlist->gate_num + 1));
+}
+
+u64 bitsim_net(Bitsim* sim, u32 net)
+{
+	u64 word = sim->net_force[net];
+	for(u32 d=sim->driver_start[net]; d<sim->driver_start[net + 1]; ++d)
+		word |= sim->gate_word[sim->drivers[d]];
+
+	return word;
+}
+
+u64 bitsim_tic_inverters(Bitsim* sim, u32 first, u32 last)
+{
+	u64 changed = 0;
+	for(u32 g=first; g<last; ++g)
+	{
+		u64 word = ~bitsim_net(sim, sim->netlist->gate_input[g]);
+		changed |= word ^ sim->gate_word[g];
+		sim->gate_word[g] = word;
+	}
+
+	return changed;
+}
+
+u64 bitsim_latch(Bitsim* sim, u32 first, u32 last)
+{
+	u64 changed = 0;
+	for(u32 g=first; g<last; ++g)
+	{
+		changed |= sim->delay_next[g] ^ sim->gate_word[g];
+		sim->gate_word[g] = sim->delay_next[g];
+	}
+
+	return changed;
+}
+
+u64 bitsim_tic(Bitsim* sim)
+{
+	Netlist* netlist = sim->netlist;
+	u64 changed = 0;
+
+	for(u32 i=0; i<netlist->island_num; ++i)
+	{
+		u32 delay_start = netlist->island_delay_start[i];
+		u32 end = netlist->island_start[i + 1];
+
+		// Inverters, in level order. Memo units are just simulated gate by gate, their delays read
+		// their input right after the unit's inverters, nothing else drives the nets they read
+		u32 g = netlist->island_start[i];
+		for(u32 m=netlist->island_memo_start[i]; m<netlist->island_memo_start[i + 1]; ++m)
+		{
+			Memo_Unit* unit = &netlist->memos[m];
+			changed |= bitsim_tic_inverters(sim, g, unit->delay_start);
+			for(g=unit->delay_start; g<unit->gate_end; ++g)
+				sim->delay_next[g] = bitsim_net(sim, netlist->gate_input[g]);
+		}
+
+		changed |= bitsim_tic_inverters(sim, g, delay_start);
+
+		// Delays latch at the end of the tic
+		for(u32 g=delay_start; g<end; ++g)
+			sim->delay_next[g] = bitsim_net(sim, netlist->gate_input[g]);
+
+		changed |= bitsim_latch(sim, delay_start, end);
+		for(u32 m=netlist->island_memo_start[i]; m<netlist->island_memo_start[i + 1]; ++m)
+			changed |= bitsim_latch(sim, netlist->memos[m].delay_start, netlist->memos[m].gate_end);
+	}
+
+	return changed;
+}
+
+// Lane pattern for input i, lane l is vector (pass * 64 + l)
+u64 truth_table_input_word(u32 input, u32 pass)
+{
+	static const u64 lane_patterns[6] =
+	{
+		0xAAAAAAAAAAAAAAAAull,
+		0xCCCCCCCCCCCCCCCCull,
+		0xF0F0F0F0F0F0F0F0ull,
+		0xFF00FF00FF00FF00ull,
+		0xFFFF0000FFFF0000ull,
+		0xFFFFFFFF00000000ull,
+	};
+
+	if (input < 6)
+		return lane_patterns[input];
+
+	return ((pass >> (input - 6)) & 1) ? ~0ull : 0ull;
+}
+
+bool chip_truth_table(Circuit* parent, Chip* chip, Truth_Table* table)
+{
+	zero_t(*table);
+
+	// Simulate a stand-alone copy, so the public nodes aren't linked to anything outside
+	Circuit* circ = circuit_make("TRUTH");
+	circuit_copy(circ, chip_circuit(parent, chip));
+
+	netlist_compile(&circ->netlist, circ);
+
+	Bitsim sim;
+	bitsim_init(&sim, &circ->netlist);
+
+	u32 input_nets[MAX_PUBLIC_NODES];
+	u32 output_nets[MAX_PUBLIC_NODES];
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		Node* node = node_get(circ, circ->public_nodes[i]);
+		if (!node)
+			continue;
+
+		u32 net = node_net_id(circ, node)->index;
+		if (sim.driver_start[net] == sim.driver_start[net + 1])
+		{
+			table->input_ports[table->input_num] = i;
+			input_nets[table->input_num++] = net;
+		}
+		else
+		{
+			table->output_ports[table->output_num] = i;
+			output_nets[table->output_num++] = net;
+		}
+	}
+
+	bool result = table->input_num <= TRUTH_TABLE_MAX_INPUTS;
+	if (result)
+	{
+		u32 vector_num = 1 << table->input_num;
+		table->pass_num = (vector_num + 63) / 64;
+		table->outputs = malloc(sizeof(u64) * (table->pass_num * table->output_num + 1));
+		table->unsettled = malloc(sizeof(u64) * table->pass_num);
+
+		for(u32 pass=0; pass<table->pass_num; ++pass)
+		{
+			bitsim_reset(&sim);
+			for(u32 i=0; i<table->input_num; ++i)
+				sim.net_force[input_nets[i]] = truth_table_input_word(i, pass);
+
+			u64 changed = 0;
+			for(u32 t=0; t<TRUTH_TABLE_MAX_TICS; ++t)
+			{
+				changed = bitsim_tic(&sim);
+				if (!changed)
+					break;
+			}
+
+			table->unsettled[pass] = changed;
+			for(u32 o=0; o<table->output_num; ++o)
+				table->outputs[pass * table->output_num + o] = bitsim_net(&sim, output_nets[o]);
+		}
+	}
+
+	bitsim_free(&sim);
+	circuit_clear(circ);
+	circuit_free(circ);
+
+	return result;
+}
+
+void truth_table_free(Truth_Table* table)
+{
+	if (table->outputs)
+		free(table->outputs);
+	if (table->unsettled)
+		free(table->unsettled);
+
+	zero_t(*table);
+}
+
+bool truth_table_get(Truth_Table* table, u32 vector, u32 output)
+{
+	u64 word = table->outputs[(vector / 64) * table->output_num + output];
+	return (word >> (vector % 64)) & 1;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "circuit.h"
+
+// Bit-parallel simulation
+// Runs a compiled netlist with one u64 per gate, so 64 independent input vectors are simulated at once.
+// Nets are the OR of the gates driving them, plus whatever is forced onto them from the outside.
+typedef struct
+{
+	Netlist* netlist;
+
+	u64* gate_word;
+	u64* delay_next;
+	u64* net_force;
+
+	// Gates driving every net, in CSR form
+	u32* driver_start;
+	u32* drivers;
+} Bitsim;
+
+void bitsim_init(Bitsim* sim, Netlist* netlist);
+void bitsim_free(Bitsim* sim);
+void bitsim_reset(Bitsim* sim);
+u64 bitsim_net(Bitsim* sim, u32 net);
+
+// Returns the lanes that changed this tic
+u64 bitsim_tic(Bitsim* sim);
+
+// Truth tables
+// Exercises every input combination of a chip, 64 combinations per pass.
+// Public nodes which aren't driven from inside the chip are inputs, the rest are outputs.
+#define TRUTH_TABLE_MAX_INPUTS 24
+#define TRUTH_TABLE_MAX_TICS 64
+
+typedef struct
+{
+	u32 input_num;
+	u32 output_num;
+	u8 input_ports[MAX_PUBLIC_NODES];
+	u8 output_ports[MAX_PUBLIC_NODES];
+
+	u32 pass_num;
+
+	// Bit l of outputs[pass * output_num + o] is output o for input vector (pass * 64 + l)
+	u64* outputs;
+	// Lanes that hadn't settled after TRUTH_TABLE_MAX_TICS tics
+	u64* unsettled;
+} Truth_Table;
+
+bool chip_truth_table(Circuit* parent, Chip* chip, Truth_Table* table);
+void truth_table_free(Truth_Table* table);
+bool truth_table_get(Truth_Table* table, u32 vector, u32 output);
@@ -3,8 +3,12 @@
 #include "circuit.h"
 #include "context.h"
 #include "prompt.h"
+#include "run.h"
+#include "trace.h"
 #include <stdlib.h>
 
+extern Thing_Type_Data type_data[];
+
 Circuit* clipboard;
 Thing_Id connect_node;
 Board board;
@@ -14,13 +18,74 @@ void board_init()
 	// Make the base circuit
 	board.edit_stack[0] = circuit_make("BASE");
 	clipboard = circuit_make("CLIPBOARD");
+
+	rewind_init(&board.rewind, REWIND_BUDGET, REWIND_KEYFRAME_INTERVAL);
+	board.edit_stack[0]->rewind = &board.rewind;
+	journal_init(&board.journal, JOURNAL_BUDGET);
+	autosave_init(&board.autosave, board.edit_stack[0], BOARD_PATH, AUTOSAVE_INTERVAL);
+}
+
+// Waits for a save that's being written, so the file isn't left half done
+void board_close()
+{
+	autosave_free(&board.autosave);
+}
+
+void board_sample()
+{
+	if (board.vcd.file)
+		vcd_sample(&board.vcd);
 }
 
 void board_tic()
 {
 	// Tick the top entry on the stack first, let it trickle down through chips
 	if (!board.debug)
+	{
 		circuit_tic(board.edit_stack[0]);
+		board_sample();
+	}
+
+	// Copies a slice of what it's saving every frame, the file is written on another thread
+	autosave_update(&board.autosave, time_now());
+}
+
+// Probes point at chip circuits, which go away when things are deleted or loaded over
+void board_stop_recording()
+{
+	if (!board.vcd.file)
+		return;
+
+	vcd_close(&board.vcd);
+	log("Stopped recording to '%s'", "res/wave.vcd");
+}
+
+void board_toggle_recording()
+{
+	if (board.vcd.file)
+	{
+		board_stop_recording();
+		return;
+	}
+
+	if (vcd_open(&board.vcd, board.edit_stack[0], "res/wave.vcd"))
+		log("Recording to '%s'", "res/wave.vcd");
+}
+
+// Steps through the recorded tics, pausing the simulation so it stays there.
+// Waves can't go back in time, so recording stops
+void board_step(i32 amount)
+{
+	board.debug = true;
+	board_stop_recording();
+	rewind_step(&board.rewind, board.edit_stack[0], amount);
+}
+
+void board_seek(u32 target)
+{
+	board.debug = true;
+	board_stop_recording();
+	rewind_seek(&board.rewind, board.edit_stack[0], target);
 }
 
 void cell_draw_off(Point pnt, i32 glyph, i32 fg_color, i32 bg_color)
@@ -63,70 +128,76 @@ void draw_edit_stack()
 	}
 }
 
-/*
-void draw_dirty_stack(Dirty_Stack* stack, Point offset, bool is_tic)
-{
-	Circuit* circ = board_get_edit_circuit();
-
-	cell_write_str(point_add(point(0, CELL_ROWS - 2), offset), "----------", CLR_WHITE, (is_tic ? CLR_ORNG_0 : CLR_BLACK));
-
-	static char debug_buff[50];
-	for(u32 i=0; i<stack->count; ++i)
-	{
-		bool top = (i == stack->count - 1);
-		Thing* thing = thing_get(circ, stack->list[i]);
-
-		if (thing)
-			sprintf(debug_buff, "%s (%d, %d)", thing_get_name(thing), thing->pos.x, thing->pos.y);
-		else
-			sprintf(debug_buff, "%s", "NULL");
-
-		Point pos = point(0, CELL_ROWS - 3 - i);
-		cell_write_str(point_add(pos, offset), debug_buff, CLR_WHITE, ((top && is_tic) ? CLR_BLUE_0 : CLR_BLACK));
-	}
-}
-
-void draw_dirty_stack_overlay(Dirty_Stack* stack)
+// Numbers the things of the edit circuit in the order they'll be cleaned
+void draw_dirty_queue_overlay(Dirty_Queue* queue)
 {
 	Circuit* circ = board_get_edit_circuit();
 
-	static char digit_buff[3];
-	for(u32 i=0; i<stack->count; ++i)
+	static char digit_buff[12];
+	for(u32 i=0; i<queue->count; ++i)
 	{
-		u32 stack_index = stack->count - i - 1;
-		Thing* thing = thing_get(circ, stack->list[stack_index]);
+		Dirty_Entry entry = dirty_queue_get(queue, i);
+		Thing* thing = entry.circ == circ ? thing_get(circ, entry.id) : NULL;
 		if (!thing)
 			continue;
 
-		sprintf(digit_buff, "%d", i);
+		sprintf(digit_buff, "%u", i);
 		cell_write_str_off(thing->pos, digit_buff, CLR_BLACK, CLR_WHITE);
 	}
 }
 
-*/
 void draw_debug()
 {
-	/*
-	static char debug_buff[50];
+	static char debug_buff[128];
 	Circuit* circ = board_get_edit_circuit();
+	Circuit* root = board.edit_stack[0];
+	Dirty_Queue* tic_queue = circuit_dirty_queue(root);
+
+	// Draw the next thing to be cleaned
+	Dirty_Entry next = dirty_queue_peek(tic_queue);
+	Thing* thing = next.circ == circ ? thing_get(circ, next.id) : NULL;
+	if (thing)
+		cell_draw_off(thing->pos, -1, CLR_WHITE, CLR_BLUE_0);
+
+	if (board.debug_overlay)
+		draw_dirty_queue_overlay(tic_queue);
+
+	// Stats of the last whole tic, from the bottom of the screen up
+	i32 row = CELL_ROWS - 1;
+	sprintf(debug_buff, "DEBUG TIC[%u] %u QUEUED", tic, tic_queue->count);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
+
+	sprintf(debug_buff, "REWIND TIC[%u..%u] %.1fMB", rewind_first_tic(&board.rewind), rewind_last_tic(&board.rewind),
+		rewind_used_bytes(&board.rewind) / 1000000.0);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
 
-	sprintf(debug_buff, "DEBUG TIC[%d]", tic);
-	cell_write_str(point(0, CELL_ROWS - 1), debug_buff, CLR_WHITE, CLR_BLACK);
+#if STATS
+	Tic_Stats* stats = &tic_stats_last;
+	sprintf(debug_buff, "LAST TIC[%u] %.3fms, %u pushed, queue peak %u",
+		stats->tic, stats->tic_ns / 1000000.0, stats->push_count, stats->queue_high_water);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
 
-	// Draw the next thing to be ticked
+	for(u32 i=0; i<STATS_TYPE_NUM; ++i)
 	{
-		Dirty_Stack* tic_stack = &circ->dirty_stacks[circ->stack_index];
-		Thing* thing = dirty_stack_peek(tic_stack, circ);
-		if (thing)
-			cell_draw_off(thing->pos, -1, CLR_WHITE, CLR_BLUE_0);
+		if (stats->clean_count[i] == 0)
+			continue;
+
+		sprintf(debug_buff, "  %s: %u cleaned in %.3fms", type_data[i].name, stats->clean_count[i], stats->clean_ns[i] / 1000000.0);
+		cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
 	}
 
-	draw_dirty_stack(&circ->dirty_stacks[0], point(0, 0), circ->stack_index == 0);
-	draw_dirty_stack(&circ->dirty_stacks[1], point(20, 0), circ->stack_index == 1);
+	sprintf(debug_buff, "NETS %u collected, %u nodes, longest %u, %u resolved",
+		stats->net_collect_count, stats->net_collect_nodes, stats->net_collect_longest, stats->net_resolve_nodes);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
 
-	if (board.debug_overlay)
-		draw_dirty_stack_overlay(&circ->dirty_stacks[circ->stack_index]);
-	*/
+	sprintf(debug_buff, "LINKS %u into chips, %u out of chips", stats->link_chip_count, stats->link_public_count);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
+
+	sprintf(debug_buff, "NETLIST %llu gate evals, compiled in %.3fms", stats->gate_evals, stats->compile_ns / 1000000.0);
+	cell_write_str(point(0, row--), debug_buff, CLR_WHITE, CLR_BLACK);
+#else
+	cell_write_str(point(0, row--), "STATS OFF, build with STATS=1", CLR_WHITE, CLR_BLACK);
+#endif
 }
 
 void draw_connection(Rect rect, bool state)
@@ -187,7 +258,7 @@ void draw_circuit(Circuit* circ)
 				Node* node = (Node*)it;
 				cell_draw_off(node->pos, GLPH_NODE, CLR_RED_1, -1);
 
-				if (thing_active(node))
+				if (thing_active(circ, node))
 					cell_draw_off(node->pos, -1, CLR_RED_0, -1);
 				if (node->link_type == LINK_Public)
 					cell_draw_off(node->pos, -1, -1, CLR_ORNG_1);
@@ -203,7 +274,7 @@ void draw_circuit(Circuit* circ)
 					u8 direction = get_direction(node->pos, other->pos);
 					cell_or_offset(node->pos, direction);
 
-					draw_connection(rect(node->pos, other->pos), node->flags & other->flags & FLAG_Active);
+					draw_connection(rect(node->pos, other->pos), thing_active(circ, node) && thing_active(circ, other));
 				}
 				break;
 			}
@@ -214,7 +285,7 @@ void draw_circuit(Circuit* circ)
 				Inverter* inv = (Inverter*)it;
 
 				i32 color = CLR_RED_1;
-				if (thing_active(inv))
+				if (thing_active(circ, inv))
 					color = CLR_RED_0;
 
 				cell_draw_off(inv->pos, '>', color, -1);
@@ -239,7 +310,7 @@ void draw_circuit(Circuit* circ)
 			case THING_Delay:
 			{
 				Delay* delay = (Delay*)it;
-				i32 color = thing_active(delay) ? CLR_RED_0 : CLR_RED_1;
+				i32 color = thing_active(circ, delay) ? CLR_RED_0 : CLR_RED_1;
 
 				cell_draw_off(delay->pos, 'o', color, -1);
 				break;
@@ -250,6 +321,9 @@ void draw_circuit(Circuit* circ)
 
 void board_draw()
 {
+	// Get the state of the last tics into the things
+	netlist_sync(&board.edit_stack[0]->netlist);
+
 	// Draw background!
 	{
 		Cell* cell_ptr = cells;
@@ -317,24 +391,35 @@ void board_draw()
 	}
 }
 
+void board_delete_thing(Circuit* circ, Thing* thing)
+{
+	if (thing->type == THING_Chip)
+		board_stop_recording();
+
+	journal_delete(&board.journal, circ, thing);
+}
+
 void delete_things(Circuit* circ, Thing** thing_arr, u32 count)
 {
+	journal_begin(&board.journal, circ);
 	for(u32 i=0; i<count; ++i)
 	{
-		thing_delete(circ, thing_arr[i]);
+		board_delete_thing(circ, thing_arr[i]);
 	}
+	journal_end(&board.journal);
 }
 
 void board_delete()
 {
 	Circuit* circ = board_get_edit_circuit();
+	journal_begin(&board.journal, circ);
 	if (board.visual)
 	{
 		Rect vis_rect = rect(board.cursor, board.vis_origin);
 		THINGS_FOREACH(circ, THING_All)
 		{
 			if (rect_rect_intersect(thing_get_bbox(it), vis_rect))
-				thing_delete(circ, it);
+				board_delete_thing(circ, it);
 		}
 
 		board.visual = false;
@@ -343,8 +428,9 @@ void board_delete()
 	{
 		Thing* thing = thing_find(circ, board.cursor, THING_All);
 		if (thing)
-			thing_delete(circ, thing);
+			board_delete_thing(circ, thing);
 	}
+	journal_end(&board.journal);
 }
 
 void board_place_node()
@@ -357,19 +443,20 @@ void board_place_node()
 		return;
 
 	Node* node = (Node*)thing;
+	journal_begin(&board.journal, circ);
 
 	// No node, create one
 	if (!node)
 	{
-		node = node_create(board_get_edit_circuit(), board.cursor);
+		node = (Node*)journal_create(&board.journal, circ, THING_Node, board.cursor);
 
 		// Split connections if there are any
 		Connection conn = connection_find(circ, board.cursor);
 		if (conn.a)
 		{
-			node_disconnect(circ, conn.a, conn.b);
-			node_connect(circ, conn.a, node);
-			node_connect(circ, conn.b, node);
+			journal_disconnect(&board.journal, circ, conn.a, conn.b);
+			journal_connect(&board.journal, circ, conn.a, node);
+			journal_connect(&board.journal, circ, conn.b, node);
 		}
 	}
 
@@ -381,22 +468,25 @@ void board_place_node()
 		if (node == connect_node_ptr)
 		{
 			connect_node = NULL_ID;
-			return;
 		}
-
-		node_connect(circ, connect_node_ptr, node);
-		connect_node = NULL_ID;
+		else
+		{
+			journal_connect(&board.journal, circ, connect_node_ptr, node);
+			connect_node = NULL_ID;
+		}
 	}
 	else
 	{
 		connect_node = thing_id(circ, (Thing*)node);
 	}
+
+	journal_end(&board.journal);
 }
 
 void board_split_connection(Connection conn, Point pos)
 {
 	Circuit* circ = board_get_edit_circuit();
-	node_disconnect(circ, conn.a, conn.b);
+	journal_disconnect(&board.journal, circ, conn.a, conn.b);
 
 	// For a horizontal connection, add in-betweeny nodes
 	if (conn.a->pos.x != conn.b->pos.x)
@@ -417,14 +507,14 @@ void board_split_connection(Connection conn, Point pos)
 		// Left in-betweeny
 		if (!node_find(circ, point_add(pos, point(-1, 0))))
 		{
-			Node* node = node_create(circ, point_add(pos, point(-1, 0)));
-			node_connect(circ, node, left_src);
+			Node* node = (Node*)journal_create(&board.journal, circ, THING_Node, point_add(pos, point(-1, 0)));
+			journal_connect(&board.journal, circ, node, left_src);
 		}
 		// Righy betweeny
 		if (!node_find(circ, point_add(pos, point(1, 0))))
 		{
-			Node* node = node_create(circ, point_add(pos, point(1, 0)));
-			node_connect(circ, node, right_src);
+			Node* node = (Node*)journal_create(&board.journal, circ, THING_Node, point_add(pos, point(1, 0)));
+			journal_connect(&board.journal, circ, node, right_src);
 		}
 	}
 }
@@ -439,11 +529,13 @@ void board_place_inverter()
 		return;
 
 	// Split connections if there are any
+	journal_begin(&board.journal, circ);
 	Connection conn = connection_find(circ, board.cursor);
 	if (conn.a)
 		board_split_connection(conn, board.cursor);
 
-	inverter_create(circ, pos);
+	journal_create(&board.journal, circ, THING_Inverter, pos);
+	journal_end(&board.journal);
 }
 
 void board_place_comment()
@@ -459,7 +551,9 @@ void board_place_chip()
 	if (thing_find(circ, pos, THING_All))
 		return;
 
-	chip_create(board_get_edit_circuit(), board.cursor);
+	journal_begin(&board.journal, circ);
+	journal_create(&board.journal, circ, THING_Chip, pos);
+	journal_end(&board.journal);
 }
 
 void board_place_delay()
@@ -472,11 +566,13 @@ void board_place_delay()
 		return;
 
 	// Split connections if there are any
+	journal_begin(&board.journal, circ);
 	Connection conn = connection_find(circ, board.cursor);
 	if (conn.a)
 		board_split_connection(conn, pos);
 
-	delay_create(board_get_edit_circuit(), board.cursor);
+	journal_create(&board.journal, circ, THING_Delay, pos);
+	journal_end(&board.journal);
 }
 
 void board_toggle_public()
@@ -486,7 +582,9 @@ void board_toggle_public()
 	if (!node)
 		return;
 
-	node_toggle_public(circ, node);
+	journal_begin(&board.journal, circ);
+	journal_toggle_public(&board.journal, circ, node);
+	journal_end(&board.journal);
 }
 
 void board_comment_write(char chr)
@@ -511,8 +609,13 @@ void cursor_move(i32 dx, i32 dy)
 void edit_stack_step_in()
 {
 	Chip* chip = chip_find(board_get_edit_circuit(), board.cursor);
-	if (chip)
-		board.edit_stack[++board.edit_index] = chip->circuit;
+	if (!chip)
+		return;
+
+	// Stepping in is where editing starts, so the chip gets its own copy of the layout
+	Circuit* chip_circ = chip_circuit(board_get_edit_circuit(), chip);
+	circuit_unshare(chip_circ);
+	board.edit_stack[++board.edit_index] = chip_circ;
 }
 
 void edit_stack_step_out()
@@ -525,15 +628,28 @@ void edit_stack_step_out()
 
 void board_save()
 {
-	circuit_save(board.edit_stack[0], "res/test.circ");
+	autosave_request(&board.autosave);
 }
 
 void board_load()
 {
-	circuit_load(board.edit_stack[0], "res/test.circ");
+	// A save that's still going finishes first, so what's loaded is what was saved last
+	autosave_flush(&board.autosave);
+
+	board_stop_recording();
+	journal_clear(&board.journal);
+	if (circuit_load(board.edit_stack[0], BOARD_PATH))
+		autosave_mark_saved(&board.autosave);
+
 	board.edit_index = 0;
 }
 
+void board_dump_trace()
+{
+	if (trace_dump("res/trace.json"))
+		log("Dumped trace to '%s'", "res/trace.json");
+}
+
 void board_yank()
 {
 	if (board.visual)
@@ -548,14 +664,53 @@ void board_yank()
 
 void board_put()
 {
+	Circuit* circ = board_get_edit_circuit();
 	Point shift = board.cursor;
 	circuit_shift(clipboard, shift);
-	circuit_merge(board_get_edit_circuit(), clipboard);
+
+	// The whole paste is one edit
+	journal_begin(&board.journal, circ);
+	journal_merge(&board.journal, circ, clipboard);
+	journal_end(&board.journal);
+
 	circuit_shift(clipboard, point_inv(shift));
 }
 
+// Undoing can take away chips, including the ones being edited or recorded
+void board_after_undo()
+{
+	connect_node = NULL_ID;
+	if (!board.journal.chip_deleted)
+		return;
+
+	board.journal.chip_deleted = false;
+	board.edit_index = 0;
+	board_stop_recording();
+}
+
+void board_undo(u32 count)
+{
+	for(u32 i=0; i<count && journal_undo(&board.journal, board.edit_stack[0]); ++i);
+	board_after_undo();
+}
+
+void board_redo(u32 count)
+{
+	for(u32 i=0; i<count && journal_redo(&board.journal, board.edit_stack[0]); ++i);
+	board_after_undo();
+}
+
 bool board_key_event(u32 code, char chr, u32 mods)
 {
+	if (!mods && chr >= '0' && chr <= '9' && (board.count > 0 || chr != '0'))
+	{
+		board.count = board.count * 10 + (chr - '0');
+		return true;
+	}
+
+	u32 count = board.count;
+	board.count = 0;
+
 	if (!mods)
 	{
 		switch(code)
@@ -594,8 +749,23 @@ bool board_key_event(u32 code, char chr, u32 mods)
 			case KEY_YANK: board_yank(); break;
 			case KEY_PUT: board_put(); break;
 
-			case KEY_SUBTIC: circuit_subtic(board.edit_stack[0]); break;
-			case KEY_TIC: circuit_tic(board.edit_stack[0]); break;
+			case KEY_SUBTIC: circuit_subtic(board.edit_stack[0]); board_sample(); break;
+			case KEY_TIC:
+			{
+				// With a count, run that many tics, skipping ahead once the circuit repeats itself
+				if (count > 0)
+					circuit_run_to(board.edit_stack[0], tic + count);
+				else
+					circuit_tic(board.edit_stack[0]);
+
+				board_sample();
+				break;
+			}
+
+			case KEY_UNDO: board_undo(max(count, 1)); break;
+
+			case KEY_STEP_BACK: board_step(-(i32)max(count, 1)); break;
+			case KEY_STEP_FORWARD: board_step(max(count, 1)); break;
 
 			default: return false;
 		}
@@ -611,6 +781,14 @@ bool board_key_event(u32 code, char chr, u32 mods)
 
 			case KEY_SAVE: board_save(); break;
 			case KEY_LOAD: board_load(); break;
+			case KEY_TRACE: board_dump_trace(); break;
+			case KEY_RECORD: board_toggle_recording(); break;
+
+			case KEY_UNDO: board_redo(max(count, 1)); break;
+
+			// Seek to the tic typed in front, or the oldest one there is
+			case KEY_STEP_BACK: board_seek(count); break;
+			case KEY_STEP_FORWARD: board_seek(count ? count : rewind_last_tic(&board.rewind)); break;
 
 			case KEY_DELETE: prompt_msg("Error", "This is an error"); break;
 
@@ -1,5 +1,9 @@
 #pragma once
 #include "circuit.h"
+#include "vcd.h"
+#include "rewind.h"
+#include "journal.h"
+#include "autosave.h"
 
 #define KEY_CANCEL 0x01
 #define KEY_PLACE_NODE 0x11
@@ -25,9 +29,19 @@
 #define KEY_VISUAL_MODE 0x2F
 #define KEY_TIC 0x34
 #define KEY_SUBTIC 0x33
+#define KEY_TRACE 0x14
+#define KEY_RECORD 0x13
+#define KEY_STEP_BACK 0x1A
+#define KEY_STEP_FORWARD 0x1B
+#define KEY_UNDO 0x16
 
 #define KEY_PROMPT 0x20
 #define EDIT_STACK_SIZE 8
+#define REWIND_BUDGET (64 << 20)
+#define REWIND_KEYFRAME_INTERVAL 256
+#define JOURNAL_BUDGET (64 << 20)
+#define AUTOSAVE_INTERVAL (60 * 1000.f)
+#define BOARD_PATH "res/test.circ"
 
 /* BOARD */
 typedef struct
@@ -41,12 +55,28 @@ typedef struct
 	Circuit* edit_stack[EDIT_STACK_SIZE];
 	i32 edit_index;
 
+	// Count typed in front of a command, like in vim
+	u32 count;
+
 	bool debug;
 	bool debug_overlay;
+
+	// Waveform recording of the base circuit, while the file is open
+	Vcd_Recorder vcd;
+
+	// Recent tics of the base circuit, to step back through
+	Rewind rewind;
+
+	// Edits, to undo and redo
+	Journal journal;
+
+	// Saves of the base circuit, written in the background
+	Autosave autosave;
 } Board;
 extern Board board;
 
 void board_init();
+void board_close();
 void board_tic();
 void board_draw();
 
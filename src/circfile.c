@@ -0,0 +1,1277 @@
+#include "circfile.h"
+#include "mapfile.h"
+#include <stdlib.h>
+
+// Writes to memory, or straight to a file if it has one
+typedef struct
+{
+	u8* data;
+	u64 size;
+	u64 max;
+	FILE* file;
+} Circfile_Writer;
+
+typedef struct
+{
+	const u8* data;
+	u64 size;
+	u64 at;
+	u32 bit;
+	bool error;
+} Circfile_Reader;
+
+// A layout that was written, with the layouts of its chips. Chips of a shared layout can still be
+// edited apart, so the same layout with other chip layouts is written again
+typedef struct
+{
+	void* key;
+	u64 hash;
+	u32 child_first;
+	u32 child_num;
+} Circfile_Def;
+
+// Raw data is left where it is until the file is written, at offset in THNG
+typedef struct
+{
+	const void* data;
+	u64 offset;
+	u64 size;
+	bool owned;
+} Circfile_Raw;
+
+typedef struct
+{
+	Circfile_Writer layouts;
+	Circfile_Writer strings;
+	Circfile_Writer state;
+	Circfile_Raw* raws;
+	u32 raw_num;
+	u32 raw_max;
+	u64 raw_size;
+	const char** names;
+	u32 name_num;
+	u32 name_max;
+
+	Circfile_Def* defs;
+	u32 def_num;
+	u32 def_max;
+
+	// Def index + 1, open addressing on the hash
+	u32* table;
+	u32 table_max;
+
+	// Layouts of the chips of the circuits being walked, and of the chips of every def
+	u32* stack;
+	u32 stack_num;
+	u32 stack_max;
+	u32* children;
+	u32 child_num;
+	u32 child_max;
+
+	// Instance state being packed
+	u8 state_bits;
+	u32 state_bit_num;
+} Circfile_Save;
+
+const u8 circfile_types[] = { THING_Node, THING_Inverter, THING_Chip, THING_Delay };
+const u8 circfile_zeros[CIRCFILE_RAW_ALIGN] = {0};
+
+/* WRITING */
+void circfile_reserve(Circfile_Writer* writer, u64 num)
+{
+	if (writer->size + num <= writer->max)
+		return;
+
+	while(writer->size + num > writer->max)
+		writer->max = writer->max == 0 ? 4096 : (writer->max << 1);
+
+	writer->data = realloc(writer->data, writer->max);
+	assert(writer->data != NULL);
+}
+
+void circfile_put(Circfile_Writer* writer, u32 value)
+{
+	circfile_reserve(writer, 5);
+	while(value >= 0x80)
+	{
+		writer->data[writer->size++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+
+	writer->data[writer->size++] = value;
+}
+
+// Zigzagged, so small negative numbers stay small
+void circfile_put_signed(Circfile_Writer* writer, i32 value)
+{
+	circfile_put(writer, ((u32)value << 1) ^ (u32)(value >> 31));
+}
+
+void circfile_put_bytes(Circfile_Writer* writer, const void* data, u64 size)
+{
+	if (size == 0)
+		return;
+
+	if (writer->file)
+	{
+		fwrite(data, 1, size, writer->file);
+		writer->size += size;
+		return;
+	}
+
+	circfile_reserve(writer, size);
+	memcpy(writer->data + writer->size, data, size);
+	writer->size += size;
+}
+
+void circfile_put_zeros(Circfile_Writer* writer, u64 size)
+{
+	if (writer->file)
+	{
+		for(u64 left = size; left; left -= min(left, sizeof(circfile_zeros)))
+			circfile_put_bytes(writer, circfile_zeros, min(left, sizeof(circfile_zeros)));
+
+		return;
+	}
+
+	circfile_reserve(writer, size);
+	mem_zero(writer->data + writer->size, size);
+	writer->size += size;
+}
+
+void circfile_put_u32(Circfile_Writer* writer, u32 value)
+{
+	circfile_put_bytes(writer, &value, sizeof(u32));
+}
+
+void circfile_put_chunk(Circfile_Writer* writer, u32 tag, Circfile_Writer* chunk)
+{
+	circfile_put_u32(writer, tag);
+	circfile_put_u32(writer, (u32)chunk->size);
+	circfile_put_bytes(writer, chunk->data, chunk->size);
+}
+
+u64 circfile_mix(u64 key)
+{
+	key *= 0x9E3779B97F4A7C15ull;
+	return key ^ (key >> 29);
+}
+
+u32 circfile_string(Circfile_Save* save, const char* name)
+{
+	for(u32 i=0; i<save->name_num; ++i)
+	{
+		if (strcmp(save->names[i], name) == 0)
+			return i;
+	}
+
+	if (save->name_num >= save->name_max)
+	{
+		save->name_max = save->name_max == 0 ? 8 : (save->name_max << 1);
+		save->names = realloc(save->names, sizeof(char*) * save->name_max);
+		assert(save->names != NULL);
+	}
+
+	u32 length = strlen(name);
+	circfile_put(&save->strings, length);
+	circfile_put_bytes(&save->strings, name, length);
+
+	save->names[save->name_num] = name;
+	return save->name_num++;
+}
+
+void circfile_push(u32** arr, u32* num, u32* max, u32 value)
+{
+	if (*num >= *max)
+	{
+		*max = *max == 0 ? 64 : (*max << 1);
+		*arr = realloc(*arr, sizeof(u32) * *max);
+		assert(*arr != NULL);
+	}
+
+	(*arr)[(*num)++] = value;
+}
+
+void circfile_write_node(Circfile_Writer* writer, Circuit* circ, Node* node)
+{
+	u32 mask = 0;
+	for(u32 c=0; c<4; ++c)
+	{
+		if (node_get(circ, node->connections[c]))
+			mask |= 1 << c;
+	}
+
+	circfile_put(writer, node->link_type | (mask << 2));
+	for(u32 c=0; c<4; ++c)
+	{
+		if (mask & (1 << c))
+			circfile_put_signed(writer, (i32)(node->connections[c].index - node->index));
+	}
+
+	if (node->link_type == LINK_Chip)
+	{
+		Chip* chip = chip_get(circ, node->link_chip);
+		Node* link = chip ? node_get(chip_circuit(circ, chip), node->link_node) : NULL;
+		circfile_put(writer, chip ? chip->index + 1 : 0);
+		circfile_put(writer, link ? link->index + 1 : 0);
+	}
+}
+
+void circfile_write_chip(Circfile_Writer* writer, Circuit* circ, Chip* chip, u32 def)
+{
+	circfile_put(writer, def);
+
+	u32 mask = 0;
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (node_get(circ, chip->link_nodes[i]))
+			mask |= 1u << i;
+	}
+
+	circfile_put(writer, mask);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (mask & (1u << i))
+			circfile_put_signed(writer, (i32)(chip->link_nodes[i].index - chip->index));
+	}
+}
+
+void circfile_write_packed(Circfile_Save* save, Circuit* circ, u32* chip_defs)
+{
+	Circfile_Writer* writer = &save->layouts;
+	u32 counts[4] = {0};
+	THINGS_FOREACH(circ, THING_All)
+	{
+		for(u32 t=0; t<4; ++t)
+			counts[t] += it->type == circfile_types[t];
+	}
+
+	u32 chip_i = 0;
+	for(u32 t=0; t<4; ++t)
+	{
+		circfile_put(writer, counts[t]);
+
+		u32 next = 0;
+		u32 generation = 0;
+		Point pos = point(0, 0);
+		THINGS_FOREACH(circ, circfile_types[t])
+		{
+			circfile_put(writer, it->index - next);
+			circfile_put_signed(writer, (i32)(it->generation - generation));
+			circfile_put_signed(writer, it->pos.x - pos.x);
+			circfile_put_signed(writer, it->pos.y - pos.y);
+			next = it->index + 1;
+			generation = it->generation;
+			pos = it->pos;
+
+			if (it->type == THING_Node)
+			{
+				circfile_write_node(writer, circ, (Node*)it);
+			}
+			else if (it->type == THING_Chip)
+			{
+				circfile_put(writer, it->size.x);
+				circfile_put(writer, it->size.y);
+				circfile_write_chip(writer, circ, (Chip*)it, chip_defs[chip_i++]);
+			}
+		}
+	}
+}
+
+// Pads raw data up to the next page of the file, returns which page that is
+u32 circfile_raw_page(Circfile_Save* save)
+{
+	save->raw_size = (save->raw_size + CIRCFILE_RAW_ALIGN - 1) / CIRCFILE_RAW_ALIGN * CIRCFILE_RAW_ALIGN;
+	return (u32)(save->raw_size / CIRCFILE_RAW_ALIGN);
+}
+
+void circfile_put_raw(Circfile_Save* save, const void* data, u64 size, bool owned)
+{
+	if (save->raw_num >= save->raw_max)
+	{
+		save->raw_max = save->raw_max == 0 ? 64 : (save->raw_max << 1);
+		save->raws = realloc(save->raws, sizeof(Circfile_Raw) * save->raw_max);
+		assert(save->raws != NULL);
+	}
+
+	Circfile_Raw* raw = &save->raws[save->raw_num++];
+	raw->data = data;
+	raw->offset = save->raw_size;
+	raw->size = size;
+	raw->owned = owned;
+	save->raw_size += size;
+}
+
+// Things and their indices as they are in memory, each at the start of a page of the file so they
+// can be mapped. Chips point to their links, even deleted ones, their pages are written through a
+// copy without the pointers
+void circfile_write_raw(Circfile_Save* save, Circuit* circ, u32* chip_defs)
+{
+	Circfile_Writer* writer = &save->layouts;
+	circfile_put(writer, circfile_raw_page(save));
+	circfile_put(writer, circ->free_slot);
+
+	u32 left = circ->thing_num;
+	for(u32 p=0; left; ++p)
+	{
+		u32 size = min(left, thing_page_size(p));
+		Thing* page = circ->thing_pages[p];
+		bool has_chips = false;
+		for(u32 k=0; k<size && !has_chips; ++k)
+			has_chips = page[k].type == THING_Chip;
+
+		if (has_chips)
+		{
+			page = malloc(sizeof(Thing) * size);
+			memcpy(page, circ->thing_pages[p], sizeof(Thing) * size);
+			for(u32 k=0; k<size; ++k)
+			{
+				if (page[k].type != THING_Chip)
+					continue;
+
+				// Deleted ones only need the next free slot
+				if (page[k].valid)
+				{
+					((Chip*)&page[k])->link_nodes = NULL;
+					continue;
+				}
+
+				u32 free_next = *thing_free_next(&page[k]);
+				mem_zero(page[k].data, sizeof(page[k].data));
+				*thing_free_next(&page[k]) = free_next;
+			}
+		}
+
+		circfile_put_raw(save, page, sizeof(Thing) * size, has_chips);
+		left -= size;
+	}
+
+	Spatial_Hash* spatial = &circ->spatial;
+	circfile_put(writer, spatial->bucket_max);
+	circfile_put(writer, spatial->entry_num);
+	circfile_put(writer, spatial->free_head);
+	circfile_put(writer, spatial->count);
+	circfile_put(writer, circfile_raw_page(save));
+	circfile_put_raw(save, spatial->buckets, sizeof(u32) * spatial->bucket_max, false);
+	circfile_put(writer, circfile_raw_page(save));
+	circfile_put_raw(save, spatial->entries, sizeof(Spatial_Entry) * spatial->entry_num, false);
+
+	// Lines without their pointers, then the wires of every line one after the other
+	Wire_Index* wires = &circ->wires;
+	Wire_Line* lines = malloc(sizeof(Wire_Line) * wires->line_max + 1);
+	mem_zero(lines, sizeof(Wire_Line) * wires->line_max);
+	for(u32 i=0; i<wires->line_max; ++i)
+	{
+		lines[i].coord = wires->lines[i].coord;
+		lines[i].vertical = wires->lines[i].vertical;
+		lines[i].used = wires->lines[i].used;
+		lines[i].wire_num = wires->lines[i].wire_num;
+		lines[i].root = wires->lines[i].root;
+	}
+
+	circfile_put(writer, wires->line_max);
+	circfile_put(writer, circfile_raw_page(save));
+	circfile_put_raw(save, lines, sizeof(Wire_Line) * wires->line_max, true);
+
+	circfile_put(writer, circfile_raw_page(save));
+	for(u32 i=0; i<wires->line_max; ++i)
+	{
+		if (wires->lines[i].used)
+			circfile_put_raw(save, wires->lines[i].wires, sizeof(Wire) * wires->lines[i].wire_num, false);
+	}
+
+	u32 chip_num = 0;
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		chip_num++;
+	}
+
+	circfile_put(writer, chip_num);
+	u32 next = 0;
+	u32 chip_i = 0;
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		circfile_put(writer, it->index - next);
+		next = it->index + 1;
+		circfile_write_chip(writer, circ, (Chip*)it, chip_defs[chip_i++]);
+	}
+}
+
+void circfile_write_layout(Circfile_Save* save, Circuit* circ, u32* chip_defs)
+{
+	Circfile_Writer* writer = &save->layouts;
+	circfile_put(writer, circfile_string(save, circ->name));
+	circfile_put(writer, circ->gen_num);
+	circfile_put(writer, circ->thing_num);
+
+	// Chunk sizes are 32 bit, past that layouts are packed again
+	bool raw = circ->thing_num >= CIRCFILE_RAW_MIN && save->raw_size + (u64)sizeof(Thing) * circ->thing_num < 0xF0000000;
+	circfile_put(writer, raw);
+	if (raw)
+		circfile_write_raw(save, circ, chip_defs);
+	else
+		circfile_write_packed(save, circ, chip_defs);
+
+	u32 mask = 0;
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (node_get(circ, circ->public_nodes[i]))
+			mask |= 1u << i;
+	}
+
+	circfile_put(writer, mask);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (mask & (1u << i))
+			circfile_put(writer, circ->public_nodes[i].index);
+	}
+}
+
+void circfile_table_insert(Circfile_Save* save, u32 def)
+{
+	u32 mask = save->table_max - 1;
+	u32 slot = save->defs[def].hash & mask;
+	while(save->table[slot])
+		slot = (slot + 1) & mask;
+
+	save->table[slot] = def + 1;
+}
+
+// Writes the layout of a circuit unless it was written already, returns its def index
+u32 circfile_def(Circfile_Save* save, Circuit* circ)
+{
+	// The layouts of the chips first, they're part of what makes two layouts the same
+	u32 first = save->stack_num;
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		u32 def = circfile_def(save, chip_circuit(circ, (Chip*)it));
+		circfile_push(&save->stack, &save->stack_num, &save->stack_max, def);
+	}
+
+	// Instances sharing a layout share its reference count
+	void* key = circ->layout_refs ? (void*)circ->layout_refs : (void*)circ;
+	u32 child_num = save->stack_num - first;
+	u64 hash = circfile_mix((u64)(size_t)key);
+	for(u32 i=0; i<child_num; ++i)
+		hash = circfile_mix(hash ^ save->stack[first + i]);
+
+	u32 mask = save->table_max - 1;
+	for(u32 slot = hash & mask; save->table[slot]; slot = (slot + 1) & mask)
+	{
+		Circfile_Def* def = &save->defs[save->table[slot] - 1];
+		if (def->key != key || def->hash != hash || def->child_num != child_num)
+			continue;
+
+		if (memcmp(&save->children[def->child_first], &save->stack[first], sizeof(u32) * child_num) == 0)
+		{
+			save->stack_num = first;
+			return save->table[slot] - 1;
+		}
+	}
+
+	circfile_write_layout(save, circ, &save->stack[first]);
+
+	if (save->def_num >= save->def_max)
+	{
+		save->def_max = save->def_max == 0 ? 64 : (save->def_max << 1);
+		save->defs = realloc(save->defs, sizeof(Circfile_Def) * save->def_max);
+		assert(save->defs != NULL);
+	}
+
+	Circfile_Def* def = &save->defs[save->def_num];
+	def->key = key;
+	def->hash = hash;
+	def->child_first = save->child_num;
+	def->child_num = child_num;
+	for(u32 i=0; i<child_num; ++i)
+		circfile_push(&save->children, &save->child_num, &save->child_max, save->stack[first + i]);
+
+	save->stack_num = first;
+
+	// Keep the table at most half full
+	if ((save->def_num + 1) * 2 > save->table_max)
+	{
+		free(save->table);
+		save->table_max <<= 1;
+		save->table = malloc(sizeof(u32) * save->table_max);
+		mem_zero(save->table, sizeof(u32) * save->table_max);
+		for(u32 i=0; i<save->def_num; ++i)
+			circfile_table_insert(save, i);
+	}
+
+	circfile_table_insert(save, save->def_num);
+	return save->def_num++;
+}
+
+// Every slot, dead ones too, so neither side has to look at the things
+void circfile_write_state(Circfile_Save* save, Circfile_Writer* writer, Circuit* circ)
+{
+	for(u32 i=0; i<circ->thing_num; ++i)
+	{
+		save->state_bits |= (circ->thing_flags[i] & (FLAG_Active | FLAG_Powered)) << save->state_bit_num;
+		save->state_bit_num += 2;
+		if (save->state_bit_num == 8)
+		{
+			circfile_put_bytes(writer, &save->state_bits, 1);
+			save->state_bits = 0;
+			save->state_bit_num = 0;
+		}
+	}
+
+	// Chips are the slots with an instance
+	for(u32 i=0; i<circ->thing_num; ++i)
+	{
+		if (circ->thing_circuits[i])
+			circfile_write_state(save, writer, circ->thing_circuits[i]);
+	}
+}
+
+void circfile_prepare(Circfile_Save* save, Circuit* circ)
+{
+	mem_zero(save, sizeof(Circfile_Save));
+	save->table_max = 64;
+	save->table = malloc(sizeof(u32) * save->table_max);
+	mem_zero(save->table, sizeof(u32) * save->table_max);
+
+	// The root comes out last, after every layout it's made of
+	circfile_def(save, circ);
+
+	circfile_write_state(save, &save->state, circ);
+	if (save->state_bit_num)
+		circfile_put_bytes(&save->state, &save->state_bits, 1);
+}
+
+void circfile_emit(Circfile_Save* save, Circfile_Writer* out)
+{
+	circfile_put_u32(out, CIRCFILE_MAGIC);
+	circfile_put_u32(out, CIRCFILE_VERSION);
+
+	Circfile_Writer chunk;
+	mem_zero(&chunk, sizeof(chunk));
+	circfile_put(&chunk, save->name_num);
+	circfile_put_bytes(&chunk, save->strings.data, save->strings.size);
+	circfile_put_chunk(out, CIRCFILE_TAG('S', 'T', 'R', 'S'), &chunk);
+
+	chunk.size = 0;
+	circfile_put(&chunk, save->def_num);
+	circfile_put_bytes(&chunk, save->layouts.data, save->layouts.size);
+	circfile_put_chunk(out, CIRCFILE_TAG('D', 'E', 'F', 'S'), &chunk);
+	free(chunk.data);
+
+	circfile_put_chunk(out, CIRCFILE_TAG('S', 'T', 'A', 'T'), &save->state);
+
+	// Padded so the raw data starts at a page of the file
+	if (save->raw_size)
+	{
+		u32 skip = (CIRCFILE_RAW_ALIGN - (out->size + 16) % CIRCFILE_RAW_ALIGN) % CIRCFILE_RAW_ALIGN;
+		circfile_put_u32(out, CIRCFILE_TAG('T', 'H', 'N', 'G'));
+		circfile_put_u32(out, (u32)(8 + skip + save->raw_size));
+		circfile_put_u32(out, skip);
+		circfile_put_u32(out, sizeof(Thing));
+		circfile_put_zeros(out, skip);
+
+		u64 at = 0;
+		for(u32 i=0; i<save->raw_num; ++i)
+		{
+			Circfile_Raw* raw = &save->raws[i];
+			circfile_put_zeros(out, raw->offset - at);
+			circfile_put_bytes(out, raw->data, raw->size);
+			at = raw->offset + raw->size;
+		}
+
+		circfile_put_zeros(out, save->raw_size - at);
+	}
+}
+
+void circfile_finish(Circfile_Save* save)
+{
+	for(u32 i=0; i<save->raw_num; ++i)
+	{
+		if (save->raws[i].owned)
+			free((void*)save->raws[i].data);
+	}
+
+	free(save->raws);
+	free(save->state.data);
+	free(save->layouts.data);
+	free(save->strings.data);
+	free(save->names);
+	free(save->defs);
+	free(save->table);
+	free(save->stack);
+	free(save->children);
+}
+
+u8* circfile_write(Circuit* circ, u64* out_size)
+{
+	Circfile_Save save;
+	circfile_prepare(&save, circ);
+
+	// One allocation for all of it, it can be most of a gigabyte
+	Circfile_Writer file;
+	mem_zero(&file, sizeof(file));
+	file.max = save.layouts.size + save.strings.size + save.state.size + save.raw_size + CIRCFILE_RAW_ALIGN + 64;
+	file.data = malloc(file.max);
+	assert(file.data != NULL);
+	circfile_emit(&save, &file);
+	circfile_finish(&save);
+
+	*out_size = file.size;
+	return file.data;
+}
+
+u64 circfile_fwrite(Circuit* circ, FILE* file)
+{
+	Circfile_Save save;
+	circfile_prepare(&save, circ);
+
+	Circfile_Writer writer;
+	mem_zero(&writer, sizeof(writer));
+	writer.file = file;
+	circfile_emit(&save, &writer);
+	circfile_finish(&save);
+	return writer.size;
+}
+/* READING */
+u32 circfile_get(Circfile_Reader* reader)
+{
+	u32 value = 0;
+	for(u32 shift = 0; shift < 35; shift += 7)
+	{
+		if (reader->at >= reader->size)
+			break;
+
+		u8 byte = reader->data[reader->at++];
+		value |= (u32)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+
+	reader->error = true;
+	return 0;
+}
+
+i32 circfile_get_signed(Circfile_Reader* reader)
+{
+	u32 value = circfile_get(reader);
+	return (i32)(value >> 1) ^ -(i32)(value & 1);
+}
+
+bool circfile_is_current(const u8* data, u64 size)
+{
+	u32 magic = 0;
+	if (size >= sizeof(u32))
+		memcpy(&magic, data, sizeof(u32));
+
+	return magic == CIRCFILE_MAGIC;
+}
+
+// Ids are read as indices first, with a generation of 1 until the things they point to are all there
+Thing_Id circfile_index_id(u32 index)
+{
+	Thing_Id id;
+	id.generation = 1;
+	id.index = index;
+	return id;
+}
+
+Thing_Id circfile_resolve(Circuit* circ, Thing_Id id, u8 type_mask)
+{
+	Thing_Id null_id;
+	zero_t(null_id);
+	if (id.generation == 0 || id.index >= circ->thing_num)
+		return null_id;
+
+	Thing* thing = thing_at(circ, id.index);
+	if (!thing->valid || !(thing->type & type_mask))
+		return null_id;
+
+	return thing_id(circ, thing);
+}
+
+bool circfile_read_node(Circfile_Reader* reader, Node* node)
+{
+	u32 header = circfile_get(reader);
+	node->link_type = header & 3;
+	for(u32 c=0; c<4; ++c)
+	{
+		if (header & (4 << c))
+			node->connections[c] = circfile_index_id(node->index + circfile_get_signed(reader));
+	}
+
+	if (node->link_type == LINK_Chip)
+	{
+		u32 chip = circfile_get(reader);
+		u32 link = circfile_get(reader);
+		if (chip)
+			node->link_chip = circfile_index_id(chip - 1);
+		if (link)
+			node->link_node = circfile_index_id(link - 1);
+	}
+
+	return node->link_type <= LINK_Chip;
+}
+
+// What's shared by the layouts of a file while it's read
+typedef struct
+{
+	Circuit** defs;
+	u32 version;
+
+	Circfile_Reader strings;
+	u64* string_at;
+	u32 string_num;
+
+	// Things of the raw layouts, in the mapped file if there is one
+	u8* things;
+	u64 things_size;
+	Mapped_File* map;
+} Circfile_Load;
+
+bool circfile_read_chip(Circfile_Reader* reader, Circfile_Load* load, u32 def, Circuit* circ, Chip* chip)
+{
+	u32 child = circfile_get(reader);
+
+	Thing_Id links[MAX_PUBLIC_NODES];
+	mem_zero(links, sizeof(links));
+	u32 mask = circfile_get(reader);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (mask & (1u << i))
+			links[i] = circfile_index_id(chip->index + circfile_get_signed(reader));
+	}
+
+	// Chips can only be made of layouts that came before
+	if (reader->error || child >= def)
+		return false;
+
+	chip->link_nodes = malloc(sizeof(Thing_Id) * MAX_PUBLIC_NODES);
+	memcpy(chip->link_nodes, links, sizeof(links));
+
+	Circuit* chip_circ = circuit_make("CHIP");
+	circuit_share(chip_circ, load->defs[child]);
+	chip_circ->parent = circ;
+	chip_circ->parent_chip = thing_id(circ, (Thing*)chip);
+	circ->thing_circuits[chip->index] = chip_circ;
+	return true;
+}
+
+bool circfile_read_packed(Circfile_Reader* reader, Circfile_Load* load, u32 def, u32 slot_num)
+{
+	Circuit* circ = load->defs[def];
+	things_reserve(circ, slot_num);
+	for(u32 i=0; i<slot_num; ++i)
+	{
+		Thing* thing = thing_at(circ, i);
+		mem_zero(thing, sizeof(Thing));
+		thing->index = i;
+	}
+
+	circ->thing_num = slot_num;
+
+	for(u32 t=0; t<4; ++t)
+	{
+		u32 count = circfile_get(reader);
+		if (count > slot_num)
+			return false;
+
+		u32 next = 0;
+		u32 generation = 0;
+		Point pos = point(0, 0);
+		for(u32 i=0; i<count; ++i)
+		{
+			u32 index = next + circfile_get(reader);
+			generation += (u32)circfile_get_signed(reader);
+			pos.x += circfile_get_signed(reader);
+			pos.y += circfile_get_signed(reader);
+			if (reader->error || index < next || index >= slot_num)
+				return false;
+
+			next = index + 1;
+			Thing* thing = thing_at(circ, index);
+			thing->generation = generation;
+			thing->type = circfile_types[t];
+			thing->pos = pos;
+			thing->size = point(1, 1);
+			circ->gen_num = max(circ->gen_num, generation);
+
+			bool read = true;
+			if (thing->type == THING_Node)
+			{
+				read = circfile_read_node(reader, (Node*)thing);
+			}
+			else if (thing->type == THING_Chip)
+			{
+				thing->size.x = circfile_get(reader);
+				thing->size.y = circfile_get(reader);
+				read = circfile_read_chip(reader, load, def, circ, (Chip*)thing);
+			}
+
+			if (!read || reader->error)
+				return false;
+
+			thing->valid = true;
+		}
+	}
+
+	return true;
+}
+
+// Raw data at a page of the THNG chunk, NULL if it doesn't fit
+u8* circfile_raw_at(Circfile_Load* load, u32 page, u64 size)
+{
+	u64 offset = (u64)page * CIRCFILE_RAW_ALIGN;
+	if (!load->things || offset > load->things_size || size > load->things_size - offset)
+		return NULL;
+
+	return load->things + offset;
+}
+
+// Arrays of a mapped file are used in place, otherwise they're copied
+void* circfile_raw_array(Circuit* circ, u8* data, u64 size)
+{
+	if (circ->map || size == 0)
+		return size ? data : NULL;
+
+	void* arr = malloc(size);
+	memcpy(arr, data, size);
+	return arr;
+}
+
+bool circfile_read_spatial(Circfile_Reader* reader, Circfile_Load* load, Circuit* circ)
+{
+	Spatial_Hash spatial;
+	mem_zero(&spatial, sizeof(spatial));
+	spatial.bucket_max = circfile_get(reader);
+	spatial.entry_num = circfile_get(reader);
+	spatial.entry_max = spatial.entry_num;
+	spatial.free_head = circfile_get(reader);
+	spatial.count = circfile_get(reader);
+	u32* buckets = (u32*)circfile_raw_at(load, circfile_get(reader), sizeof(u32) * (u64)spatial.bucket_max);
+	Spatial_Entry* entries = (Spatial_Entry*)circfile_raw_at(load, circfile_get(reader), sizeof(Spatial_Entry) * (u64)spatial.entry_num);
+	if (reader->error || !buckets || !entries || (spatial.bucket_max & (spatial.bucket_max - 1)) || spatial.free_head >= max(spatial.entry_num, 1))
+		return false;
+
+	// Lookups follow these without checking
+	for(u32 i=0; i<spatial.bucket_max; ++i)
+	{
+		if (buckets[i] >= spatial.entry_num)
+			return false;
+	}
+
+	for(u32 i=1; i<spatial.entry_num; ++i)
+	{
+		if (entries[i].next >= spatial.entry_num || (entries[i].thing >= circ->thing_num && entries[i].thing != (u32)~0))
+			return false;
+	}
+
+	spatial.buckets = circfile_raw_array(circ, (u8*)buckets, sizeof(u32) * (u64)spatial.bucket_max);
+	spatial.entries = circfile_raw_array(circ, (u8*)entries, sizeof(Spatial_Entry) * (u64)spatial.entry_num);
+	spatial.mapped = circ->map != NULL;
+	circ->spatial = spatial;
+	return true;
+}
+
+bool circfile_read_wires(Circfile_Reader* reader, Circfile_Load* load, Circuit* circ)
+{
+	u32 line_max = circfile_get(reader);
+	Wire_Line* lines = (Wire_Line*)circfile_raw_at(load, circfile_get(reader), sizeof(Wire_Line) * (u64)line_max);
+	u32 wires_page = circfile_get(reader);
+	if (reader->error || !lines || (line_max & (line_max - 1)))
+		return false;
+
+	// Lines are looked up until an unused one, there has to be one
+	u32 line_num = 0;
+	u64 wire_num = 0;
+	for(u32 i=0; i<line_max; ++i)
+	{
+		line_num += lines[i].used != 0;
+		wire_num += lines[i].used ? lines[i].wire_num : 0;
+	}
+
+	Wire* wires = (Wire*)circfile_raw_at(load, wires_page, sizeof(Wire) * wire_num);
+	if (!wires || (line_max && line_num * 2 > line_max))
+		return false;
+
+	// Trees are walked without checking
+	Wire* line_wires = wires;
+	for(u32 i=0; i<line_max; ++i)
+	{
+		u32 line_wire_num = lines[i].used ? lines[i].wire_num : 0;
+		if (lines[i].used && lines[i].root > line_wire_num)
+			return false;
+
+		for(u32 w=0; w<line_wire_num; ++w)
+		{
+			if (line_wires[w].left > line_wire_num || line_wires[w].right > line_wire_num)
+				return false;
+		}
+
+		line_wires += line_wire_num;
+	}
+
+	// Lines get their pointers, so they're always a copy
+	Wire_Index index;
+	mem_zero(&index, sizeof(index));
+	index.line_max = line_max;
+	index.line_num = line_num;
+	if (line_max)
+	{
+		index.lines = malloc(sizeof(Wire_Line) * line_max);
+		memcpy(index.lines, lines, sizeof(Wire_Line) * line_max);
+	}
+
+	for(u32 i=0; i<line_max; ++i)
+	{
+		Wire_Line* line = &index.lines[i];
+		line->used = line->used != 0;
+		line->wire_num = line->used ? line->wire_num : 0;
+		line->wire_max = line->wire_num;
+		line->root = line->used ? line->root : 0;
+		line->wires = circfile_raw_array(circ, (u8*)wires, sizeof(Wire) * line->wire_num);
+		line->mapped = circ->map && line->wires;
+		wires += line->wire_num;
+	}
+
+	circ->wires = index;
+	return true;
+}
+
+// The things and their indices are used where they are in the file, only what's written to gets copied
+bool circfile_read_raw(Circfile_Reader* reader, Circfile_Load* load, u32 def, u32 slot_num)
+{
+	Circuit* circ = load->defs[def];
+	u8* things = circfile_raw_at(load, circfile_get(reader), sizeof(Thing) * (u64)slot_num);
+	u32 free_slot = circfile_get(reader);
+	if (reader->error || !things || free_slot > slot_num)
+		return false;
+
+	things_map(circ, (Thing*)things, slot_num, load->map);
+	circ->thing_num = slot_num;
+	circ->free_slot = free_slot;
+	// Whatever doesn't check out is dropped, so clearing the circuit won't trip over it
+	bool read = true;
+	u32 chip_num = 0;
+	u32 deleted_num = 0;
+	u32 index = 0;
+	for(u32 p=0; index<slot_num; ++p)
+	{
+		u32 size = min(slot_num - index, thing_page_size(p));
+		for(u32 k=0; k<size; ++k)
+		{
+			Thing* thing = &circ->thing_pages[p][k];
+			u32 i = index + k;
+			if (!thing->valid)
+			{
+				deleted_num++;
+				continue;
+			}
+
+			bool known = thing->type == THING_Node || thing->type == THING_Inverter || thing->type == THING_Chip || thing->type == THING_Delay;
+			if (thing->index != i || !known || (thing->type == THING_Node && ((Node*)thing)->link_type > LINK_Chip))
+			{
+				thing->valid = false;
+				read = false;
+				continue;
+			}
+
+			if (thing->type == THING_Chip)
+			{
+				((Chip*)thing)->link_nodes = NULL;
+				chip_num++;
+			}
+
+			circ->gen_num = max(circ->gen_num, thing->generation);
+		}
+
+		index += size;
+	}
+
+	// Creating things follows the free slots without checking, they have to end within the deleted ones
+	u32 free_num = 0;
+	for(u32 slot=free_slot; read && slot; )
+	{
+		Thing* thing = slot <= slot_num ? thing_at(circ, slot - 1) : NULL;
+		if (!thing || thing->valid || free_num++ == deleted_num)
+			read = false;
+		else
+			slot = *thing_free_next(thing);
+	}
+
+	if (!read || !circfile_read_spatial(reader, load, circ))
+		return false;
+
+	// Version 3 wires are laid out differently, they're rebuilt once the chips are there
+	if (load->version < 4)
+	{
+		for(u32 i=0; i<3; ++i)
+			circfile_get(reader);
+	}
+	else if (!circfile_read_wires(reader, load, circ))
+	{
+		return false;
+	}
+
+	if (circfile_get(reader) != chip_num)
+		return false;
+
+	u32 next = 0;
+	for(u32 i=0; i<chip_num; ++i)
+	{
+		u32 index = next + circfile_get(reader);
+		if (reader->error || index < next || index >= slot_num)
+			return false;
+
+		next = index + 1;
+		Chip* chip = (Chip*)thing_at(circ, index);
+		if (!chip->valid || chip->type != THING_Chip || !circfile_read_chip(reader, load, def, circ, chip))
+			return false;
+
+		// Every thing is there already
+		for(u32 l=0; l<MAX_PUBLIC_NODES; ++l)
+			chip->link_nodes[l] = circfile_resolve(circ, chip->link_nodes[l], THING_Node);
+	}
+
+	if (load->version < 4)
+	{
+		THINGS_FOREACH(circ, THING_Node)
+		{
+			node_insert_wires(circ, (Node*)it);
+		}
+	}
+
+	return !reader->error;
+}
+
+bool circfile_read_layout(Circfile_Reader* reader, Circfile_Load* load, u32 def)
+{
+	Circuit* circ = load->defs[def];
+
+	u32 name = circfile_get(reader);
+	if (name < load->string_num)
+	{
+		Circfile_Reader string = load->strings;
+		string.at = load->string_at[name];
+		u32 length = circfile_get(&string);
+		length = min(length, sizeof(circ->name) - 1);
+		memcpy(circ->name, string.data + string.at, length);
+		circ->name[length] = 0;
+	}
+
+	circ->gen_num = circfile_get(reader);
+	u32 slot_num = circfile_get(reader);
+	u32 raw = load->version >= 3 ? circfile_get(reader) : 0;
+	if (reader->error || slot_num > (1u << 30) || raw > 1)
+		return false;
+
+	bool read = raw ? circfile_read_raw(reader, load, def, slot_num) : circfile_read_packed(reader, load, def, slot_num);
+	if (!read)
+		return false;
+
+	u32 mask = circfile_get(reader);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (mask & (1u << i))
+			circ->public_nodes[i] = circfile_index_id(circfile_get(reader));
+	}
+
+	if (reader->error)
+		return false;
+
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		circ->public_nodes[i] = circfile_resolve(circ, circ->public_nodes[i], THING_Node);
+
+	// Raw things have their generations and indices already
+	if (raw)
+		return true;
+
+	// Every thing is there now, ids can get their generations
+	THINGS_FOREACH(circ, THING_Node | THING_Chip)
+	{
+		if (it->type == THING_Chip)
+		{
+			Chip* chip = (Chip*)it;
+			for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+				chip->link_nodes[i] = circfile_resolve(circ, chip->link_nodes[i], THING_Node);
+
+			continue;
+		}
+
+		Node* node = (Node*)it;
+		for(u32 c=0; c<4; ++c)
+			node->connections[c] = circfile_resolve(circ, node->connections[c], THING_Node);
+
+		node->link_chip = circfile_resolve(circ, node->link_chip, THING_Chip);
+		Chip* chip = chip_get(circ, node->link_chip);
+		node->link_node = chip ? circfile_resolve(chip_circuit(circ, chip), node->link_node, THING_Node) : node->link_chip;
+	}
+
+	things_rebuild_free(circ);
+	circuit_reindex(circ);
+	return true;
+}
+
+void circfile_read_state(Circfile_Reader* reader, Circuit* circ, u32 version)
+{
+	for(u32 i=0; i<circ->thing_num; ++i)
+	{
+		// Version 2 only has the things that are there
+		if (version < 3 && !thing_at(circ, i)->valid)
+			continue;
+
+		if (reader->at >= reader->size)
+		{
+			reader->error = true;
+			return;
+		}
+
+		circ->thing_flags[i] = (reader->data[reader->at] >> reader->bit) & (FLAG_Active | FLAG_Powered);
+		reader->bit += 2;
+		if (reader->bit == 8)
+		{
+			reader->bit = 0;
+			reader->at++;
+		}
+	}
+
+	for(u32 i=0; i<circ->thing_num; ++i)
+	{
+		if (circ->thing_circuits[i])
+			circfile_read_state(reader, circ->thing_circuits[i], version);
+	}
+}
+
+bool circfile_load(Circuit* circ, u8* data, u64 size, Mapped_File* map)
+{
+	circuit_clear(circ);
+
+	Circfile_Load load;
+	mem_zero(&load, sizeof(load));
+	load.map = map;
+	if (!circfile_is_current(data, size) || size < 8)
+		return false;
+
+	// Older versions are a subset of the current one
+	memcpy(&load.version, data + 4, sizeof(u32));
+	if (load.version < 2 || load.version > CIRCFILE_VERSION)
+		return false;
+
+	Circfile_Reader layouts, state, things;
+	mem_zero(&layouts, sizeof(layouts));
+	mem_zero(&state, sizeof(state));
+	mem_zero(&things, sizeof(things));
+
+	for(u64 at = 8; at < size; )
+	{
+		if (size - at < 8)
+			return false;
+
+		u32 tag, chunk_size;
+		memcpy(&tag, data + at, sizeof(u32));
+		memcpy(&chunk_size, data + at + 4, sizeof(u32));
+		at += 8;
+		if (chunk_size > size - at)
+			return false;
+
+		Circfile_Reader* reader = NULL;
+		if (tag == CIRCFILE_TAG('S', 'T', 'R', 'S'))
+			reader = &load.strings;
+		else if (tag == CIRCFILE_TAG('D', 'E', 'F', 'S'))
+			reader = &layouts;
+		else if (tag == CIRCFILE_TAG('S', 'T', 'A', 'T'))
+			reader = &state;
+		else if (tag == CIRCFILE_TAG('T', 'H', 'N', 'G'))
+			reader = &things;
+
+		if (reader)
+		{
+			reader->data = data + at;
+			reader->size = chunk_size;
+		}
+
+		at += chunk_size;
+	}
+
+	// Raw things can only be used by a build that lays them out the same
+	if (things.data)
+	{
+		u32 skip = 0;
+		u32 thing_size = 0;
+		if (things.size >= 8)
+		{
+			memcpy(&skip, things.data, sizeof(u32));
+			memcpy(&thing_size, things.data + 4, sizeof(u32));
+		}
+
+		if (thing_size != sizeof(Thing) || skip > things.size - 8)
+			return false;
+
+		load.things = (u8*)things.data + 8 + skip;
+		load.things_size = things.size - 8 - skip;
+	}
+
+	// Where every string starts
+	Circfile_Reader* strings = &load.strings;
+	load.string_num = circfile_get(strings);
+	if (strings->error || load.string_num > strings->size)
+		return false;
+
+	load.string_at = malloc(sizeof(u64) * (load.string_num + 1));
+	for(u32 i=0; i<load.string_num; ++i)
+	{
+		load.string_at[i] = strings->at;
+		strings->at += circfile_get(strings);
+	}
+
+	bool loaded = !strings->error && strings->at <= strings->size;
+
+	u32 def_num = circfile_get(&layouts);
+	loaded &= !layouts.error && def_num > 0 && def_num <= layouts.size;
+
+	load.defs = malloc(sizeof(Circuit*) * (def_num + 1));
+	u32 made_num = 0;
+	for(u32 d=0; loaded && d<def_num; ++d)
+	{
+		load.defs[d] = d == def_num - 1 ? circ : circuit_make("CHIP");
+		made_num = d + 1;
+		loaded = circfile_read_layout(&layouts, &load, d);
+	}
+
+	if (loaded && state.data)
+	{
+		circfile_read_state(&state, circ, load.version);
+		loaded = !state.error;
+	}
+
+	// Nets count their drivers from the nodes
+	if (loaded)
+		circuit_update_driven(circ);
+
+	// The instances keep the layouts alive
+	for(u32 d=0; d<made_num; ++d)
+	{
+		if (load.defs[d] == circ)
+			continue;
+
+		circuit_clear(load.defs[d]);
+		circuit_free(load.defs[d]);
+	}
+
+	if (!loaded)
+		circuit_clear(circ);
+
+	free(load.defs);
+	free(load.string_at);
+	return loaded;
+}
+
+bool circfile_read(Circuit* circ, const u8* data, u64 size)
+{
+	// Nothing is kept pointing into the data without a mapped file
+	return circfile_load(circ, (u8*)data, size, NULL);
+}
+
+bool circfile_map(Circuit* circ, Mapped_File* file)
+{
+	return circfile_load(circ, file->data, file->size, file);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "circuit.h"
+
+// Circuit files
+// A header (magic and version) followed by chunks, each a four letter tag and a byte size, so readers
+// skip the chunks they don't know. Version 3 has:
+//   STRS  Names of circuits, referred to by index
+//   DEFS  Layouts. A layout shared by many chip instances is stored once, chips refer to the layout of
+//         their circuit by index. Layouts come before the ones using them, the root layout is the last
+//   STAT  State of every instance, 2 bits per slot (per thing in version 2), in the order the instance
+//         tree is walked
+//   THNG  Things of big layouts the way they are in memory, each starting at a page of the file, so a
+//         mapped file can be used in place (version 3). Only a build with the same Thing reads them.
+//         Their wire index is a tree since version 4, the sorted wires of version 3 are rebuilt
+// Layouts store their things by type. Numbers are varints. Positions and generations are stored as the
+// difference to the thing of the same type before them, other things as the difference between indices.
+// Ids keep all 32 bits, there's no limit on things besides memory.
+// Files without the header are the legacy format, a dump of thing records, see circuit_fread.
+#define CIRCFILE_MAGIC 0x5249437F // "\x7FCIR", a legacy file starts with a circuit name
+#define CIRCFILE_VERSION 4
+
+// Layouts with this many slots go into THNG, 88 bytes a thing instead of about 6 but nothing to parse
+#define CIRCFILE_RAW_MIN (1 << 18)
+#define CIRCFILE_RAW_ALIGN 4096
+
+#define CIRCFILE_TAG(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+bool circfile_is_current(const u8* data, u64 size);
+
+// Returns the whole file, to be freed by the caller
+u8* circfile_write(Circuit* circ, u64* out_size);
+
+// Same, written straight to the file without a copy of the things. Returns the bytes written
+u64 circfile_fwrite(Circuit* circ, FILE* file);
+
+// Replaces circ with the circuit in the file. Returns false if the file is damaged or too new,
+// circ is left empty then
+bool circfile_read(Circuit* circ, const u8* data, u64 size);
+
+// Same, but the things of big layouts stay in the file, which stays mapped for as long as they're used
+bool circfile_map(Circuit* circ, Mapped_File* file);
@@ -1,7 +1,12 @@
 #include "circuit.h"
+#include "trace.h"
+#include "rewind.h"
+#include "circfile.h"
+#include "mapfile.h"
 #include <stdlib.h>
 #include <stdio.h>
 /* CIRCUIT */
+
 Circuit* circuit_make(const char* name)
 {
 	Circuit* circ = malloc(sizeof(Circuit));
@@ -13,10 +18,53 @@ Circuit* circuit_make(const char* name)
 
 void circuit_clear(Circuit* circ)
 {
-	if (circ->things)
-		free(circ->things);
+	// Chip instances belong to this circuit, even if the layout they're in is shared
+	for(u32 i=0; circ->thing_circuits && i<circ->thing_num; ++i)
+	{
+		if (!circ->thing_circuits[i])
+			continue;
+
+		circuit_clear(circ->thing_circuits[i]);
+		circuit_free(circ->thing_circuits[i]);
+	}
+
+	// The layout is freed by the last instance using it
+	bool owns_layout = true;
+	if (circ->layout_refs)
+	{
+		owns_layout = --(*circ->layout_refs) == 0;
+		if (owns_layout)
+			free(circ->layout_refs);
+	}
+
+	if (owns_layout)
+	{
+		THINGS_FOREACH(circ, THING_Chip)
+		{
+			free(((Chip*)it)->link_nodes);
+		}
+
+		things_free_pages(circ);
+		spatial_free(&circ->spatial);
+		wire_index_free(&circ->wires);
+	}
 
+	things_free_state(circ);
+	net_table_free(&circ->nets);
+	netlist_free(&circ->netlist);
+	dirty_queue_free(&circ->dirty_queues[0]);
+	dirty_queue_free(&circ->dirty_queues[1]);
+
+	// The history stays attached, but what it recorded is gone. The edits keep counting, whatever
+	// is being copied from this tree is gone too
+	Rewind* rewind = circ->rewind;
+	if (rewind)
+		rewind_reset(rewind);
+
+	u32 layout_edits = circ->layout_edits;
 	mem_zero(circ, sizeof(Circuit));
+	circ->rewind = rewind;
+	circ->layout_edits = layout_edits + 1;
 }
 
 void circuit_free(Circuit* circ)
@@ -24,131 +72,420 @@ void circuit_free(Circuit* circ)
 	free(circ);
 }
 
-void circuit_subtic(Circuit* circ)
+Circuit* circuit_root(Circuit* circ)
 {
-	/*
-	Dirty_Stack* tic_stack = &circ->dirty_stacks[circ->stack_index];
-	if (tic_stack->count == 0)
-		return;
+	while(circ->parent)
+		circ = circ->parent;
+
+	return circ;
+}
+
+void circuit_edited(Circuit* circ)
+{
+	circuit_root(circ)->layout_edits++;
+}
+
+void circuit_dirty_all(Circuit* circ)
+{
+	circ->dirty_pending = false;
+	THINGS_FOREACH(circ, THING_All)
+	{
+		u32 index = it->index;
+		circ->thing_flags[index] &= ~FLAG_Dirty;
+		circ->thing_tics[index] = 0;
+		thing_set_dirty(circ, it);
+
+		if (it->type == THING_Chip)
+			circuit_dirty_all(chip_circuit(circ, (Chip*)it));
+	}
+}
+
+// Nothing is dirty afterwards, not even what a load left pending
+void circuit_clear_dirty(Circuit* circ)
+{
+	dirty_queue_clear(&circ->dirty_queues[0]);
+	dirty_queue_clear(&circ->dirty_queues[1]);
+	circ->dirty_pending = false;
+}
 
-	if (tic_stack->count != 0)
+Dirty_Queue* circuit_dirty_queue(Circuit* circ)
+{
+	if (circ->dirty_pending)
+		circuit_dirty_all(circ);
+
+	return &circ->dirty_queues[circ->queue_index];
+}
+
+void circuit_reindex(Circuit* circ)
+{
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+	spatial_free(&circ->spatial);
+	wire_index_free(&circ->wires);
+
+	THINGS_FOREACH(circ, THING_All)
 	{
-		Thing* thing = dirty_stack_pop(tic_stack, circ);
-		if (thing)
-			thing_clean(circ, thing);
+		spatial_insert(&circ->spatial, thing_get_bbox(it), it->index);
+
+		if (it->type == THING_Node)
+			node_insert_wires(circ, (Node*)it);
 	}
+}
+
+void circuit_subtic(Circuit* circ)
+{
+	// Subtics step through the dirty things one by one, which works on things, not the netlist
+	netlist_sync(&circ->netlist);
+
+	Dirty_Queue* tic_queue = circuit_dirty_queue(circ);
+	if (tic_queue->count == 0)
+		return;
 
-	// If we emptied our stack this subtic, advance tic
-	if (tic_stack->count == 0)
+	STATS_BEGIN(begin);
+	Dirty_Entry entry = dirty_queue_pop(tic_queue);
+	Thing* thing = thing_get(entry.circ, entry.id);
+	if (thing)
+		thing_clean(entry.circ, thing);
+
+	// The things changed behind the netlists back, recompile it next tic
+	circuit_invalidate_netlist(circ);
+	STATS_END(tic_ns, begin);
+
+	// If we emptied our queue this subtic, advance tic
+	if (tic_queue->count == 0)
 	{
-		circ->stack_index = !circ->stack_index;
+		circ->queue_index = !circ->queue_index;
+		STATS_END_TIC();
 		tic++;
+
+		if (circ->rewind)
+			rewind_record(circ->rewind, circ);
 	}
-	*/
 }
 
 void circuit_tic(Circuit* circ)
 {
-	/*
-	Dirty_Stack* tic_stack = &circ->dirty_stacks[circ->stack_index];
-	if (tic_stack->count == 0)
-		return;
-
-	while(tic_stack->count != 0)
+	TRACE_BEGIN(trace_begin);
+	STATS_BEGIN(begin);
+	Netlist* netlist = &circ->netlist;
+	if (!netlist->valid)
 	{
-		Thing* thing = dirty_stack_pop(tic_stack, circ);
-		if (thing)
-			thing_clean(circ, thing);
+		TRACE_BEGIN(trace_compile_begin);
+		STATS_BEGIN(compile_begin);
+		netlist_compile(netlist, circ);
+		STATS_END(compile_ns, compile_begin);
+		TRACE_END("netlist_compile", trace_compile_begin);
 	}
 
-	circ->stack_index = !circ->stack_index;
+	// The netlist evaluates every gate each tic, so whatever was dirty is covered
+	circuit_clear_dirty(circ);
+
+	netlist_tic(netlist);
+	STATS_END(tic_ns, begin);
+	STATS_END_TIC();
 	tic++;
-	*/
+
+	if (circ->rewind)
+		rewind_record(circ->rewind, circ);
+	TRACE_END("tic", trace_begin);
+}
+
+// Where a thing of the merged circuit ends up, NULL if it was dropped
+Thing_Id merge_remap(Circuit* other, Thing_Id* remap, Thing_Id id)
+{
+	if (!thing_get(other, id))
+		return NULL_ID;
+
+	return remap[id.index];
+}
+
+// Lowest existing thing overlapping the bbox, like the first one a linear search would find
+Thing* merge_find_overlap(Circuit* circ, Rect bbox)
+{
+	Spatial_Hash* hash = &circ->spatial;
+	Thing* found = NULL;
+
+	for(i32 y=bbox.min.y; y<=bbox.max.y; ++y)
+	{
+		for(i32 x=bbox.min.x; x<=bbox.max.x; ++x)
+		{
+			for(u32 entry = spatial_first(hash, point(x, y)); entry; entry = spatial_next(hash, entry))
+			{
+				Thing* thing = thing_at(circ, spatial_thing(hash, entry));
+				if (thing->valid && (!found || thing->index < found->index))
+					found = thing;
+			}
+		}
+	}
+
+	return found;
 }
 
 void circuit_merge(Circuit* circ, Circuit* other)
 {
+	TRACE_BEGIN(begin);
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+
 	// Make sure they actually fit..
 	things_reserve(circ, circ->thing_num + other->thing_num);
 
-	// Copy over all the things, at the end of the target list
-	memcpy(circ->things + circ->thing_num, other->things, sizeof(Thing) * (other->thing_num));
+	// Merged things can connect to or drive anything, so all nets have to be re-extracted
+	circuit_break_nets(circ);
+	circuit_invalidate_netlist(circ);
+
+	u32 base = circ->thing_num;
+	Thing_Id* remap = malloc(sizeof(Thing_Id) * (other->thing_num + 1));
+	mem_zero(remap, sizeof(Thing_Id) * (other->thing_num + 1));
 
-	// After that we have to update all of the connection ID's, since the indecies have been shifted
-	for(u32 i=circ->thing_num; i<circ->thing_num + other->thing_num; ++i)
+	// Spatial join, only the cells of the merged things are probed. Those landing on an existing thing
+	// are merged into it if they're the same type and dropped otherwise, everything else gets a new id
+	THINGS_FOREACH(other, THING_All)
 	{
+		Thing* existing = merge_find_overlap(circ, thing_get_bbox(it));
+		if (!existing)
+		{
+			remap[it->index].generation = ++circ->gen_num;
+			remap[it->index].index = base + it->index;
+		}
+		else if (existing->type == it->type)
+		{
+			remap[it->index] = thing_id(circ, existing);
+		}
+	}
+
+	// Copy over the things that made it, at the end of the target list, and point their ids to where things ended up
+	circ->thing_num += other->thing_num;
+	for(u32 i=0; i<other->thing_num; ++i)
+	{
+		Thing* thing = thing_at(circ, base + i);
+		Thing* other_thing = thing_at(other, i);
+		u32 index = base + i;
+
+		circ->thing_tics[index] = 0;
+		zero_t(circ->thing_nets[index]);
+		circ->thing_epochs[index] = 0;
+		circ->thing_circuits[index] = NULL;
+
+		if (!other_thing->valid || remap[i].index != index)
+		{
+			mem_zero(thing, sizeof(Thing));
+			thing->index = index;
+			circ->thing_flags[index] = 0;
+			continue;
+		}
+
+		*thing = *other_thing;
+		thing->index = index;
+		thing->generation = remap[i].generation;
+		spatial_insert(&circ->spatial, thing_get_bbox(thing), index);
+
 		// Re-dirty everything
-		Thing* thing = &circ->things[i];
-		thing->dirty = false;
+		circ->thing_flags[index] = other->thing_flags[i] & ~FLAG_Dirty;
 		thing_set_dirty(circ, thing);
 
+		Thing_Type_Data* type = thing_type_data(thing);
+		if (type->on_copy)
+			type->on_copy(circ, thing, other, other_thing);
+
 		if (thing->type == THING_Node)
 		{
 			Node* node = (Node*)thing;
 			for(u32 c=0; c<4; ++c)
-			{
-				// We can do this for all connections, since NULL connections have 0 generation anyways
-				node->connections[c].index += circ->thing_num;
-			}
+				node->connections[c] = merge_remap(other, remap, node->connections[c]);
+
+			if (node->link_type == LINK_Chip)
+				node->link_chip = merge_remap(other, remap, node->link_chip);
+		}
+		else if (thing->type == THING_Chip)
+		{
+			Chip* chip = (Chip*)thing;
+			chip_copy_links(chip);
+
+			for(u32 l=0; l<MAX_PUBLIC_NODES; ++l)
+				chip->link_nodes[l] = merge_remap(other, remap, chip->link_nodes[l]);
 		}
 	}
 
-	// Merge public nodes
-	memcpy(circ->public_nodes, other->public_nodes, sizeof(circ->public_nodes));
+	things_rebuild_free(circ);
 
-	// Avoid repeat generation
-	circ->gen_num = max(circ->gen_num, other->gen_num);
-	circ->thing_num += other->thing_num;
+	// Pasted nodes got the flags they had in other, and pasted sources can feed nodes that were there
+	for(u32 i=base; i<circ->thing_num; ++i)
+	{
+		Thing* thing = thing_at(circ, i);
+		if (!thing->valid)
+			continue;
 
-	static Thing* duplicates[4];
+		if (thing->type == THING_Node)
+		{
+			node_insert_wires(circ, (Node*)thing);
+			node_update_driven(circ, (Node*)thing);
+		}
+		else if (thing->type == THING_Inverter || thing->type == THING_Delay)
+		{
+			Node* target = node_find(circ, point_add(thing->pos, point(1, 0)));
+			if (target)
+				node_update_driven(circ, target);
+		}
+	}
 
-	// After all of this, merge all duplicates!
-	THINGS_FOREACH(circ, THING_All)
+	// Duplicates get merged into the thing they landed on, seeing the connections they would have had
+	THINGS_FOREACH(other, THING_All)
 	{
-		u32 dup_num = things_find(circ, thing_get_bbox(it), duplicates, 4);
+		Thing* existing = thing_get(circ, remap[it->index]);
+		if (!existing || existing->index >= base)
+			continue;
+
+		Thing merged = *it;
+		if (merged.type == THING_Node)
+		{
+			Node* node = (Node*)&merged;
+			for(u32 c=0; c<4; ++c)
+				node->connections[c] = merge_remap(other, remap, node->connections[c]);
+		}
+
+		Thing_Type_Data* type = thing_type_data(existing);
+		if (type->on_merge)
+			type->on_merge(circ, existing, &merged);
 
-		// Only one thing found, it is the original thing!
-		if (dup_num == 1)
+		thing_set_dirty(circ, existing);
+	}
+
+	// Public nodes keep their slot if it's free, otherwise they take the first free one
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		Node* node = node_get(circ, merge_remap(other, remap, other->public_nodes[i]));
+		if (!node || node->link_type == LINK_Chip)
 			continue;
 
-		for(u32 i=0; i<dup_num; ++i)
+		bool is_public = false;
+		u32 slot = MAX_PUBLIC_NODES;
+		for(u32 p=0; p<MAX_PUBLIC_NODES; ++p)
 		{
-			// This IS the thing we're merging...
-			if (duplicates[i] == it)
-				continue;
+			Node* pub_node = node_get(circ, circ->public_nodes[p]);
+			if (pub_node == node)
+				is_public = true;
+			else if (!pub_node && (slot == MAX_PUBLIC_NODES || p == i))
+				slot = p;
+		}
 
-			// Only merge stuff of the same type..
-			if (it->type == duplicates[i]->type)
-			{
-				Thing_Type_Data* type = thing_type_data(it);
-				if (type->on_merge)
-					type->on_merge(circ, it, duplicates[i]);
-			}
+		if (is_public)
+			continue;
 
-			thing_delete(circ, duplicates[i]);
+		// Out of public slots, it's just a node now
+		if (slot == MAX_PUBLIC_NODES)
+		{
+			node->link_type = LINK_None;
+			continue;
 		}
+
+		circ->public_nodes[slot] = thing_id(circ, (Thing*)node);
+		node->link_type = LINK_Public;
 	}
+
+	free(remap);
+	TRACE_END("merge", begin);
 }
 
-void circuit_copy(Circuit* circ, Circuit* other)
+// Makes circ a new instance of other, with the same state but nothing simulated yet.
+// The layout fields still point to the layout of other afterwards
+void circuit_copy_instance(Circuit* circ, Circuit* other)
 {
+	circuit_clear(circ);
+
+	Rewind* rewind = circ->rewind;
+	u32 layout_edits = circ->layout_edits;
 	memcpy(circ, other, sizeof(Circuit));
-	circ->things = malloc(sizeof(Thing) * other->thing_max);
-	memcpy(circ->things, other->things, sizeof(Thing) * other->thing_max);
+	zero_t(circ->dirty_queues);
+	zero_t(circ->nets);
+	zero_t(circ->netlist);
+	circ->rewind = rewind;
+	circ->layout_edits = layout_edits;
+
+	// Copies start out as their own root, chips re-parent their copies afterwards
+	circ->parent = NULL;
+	zero_t(circ->parent_chip);
+
+	things_alloc_state(circ);
+	memcpy(circ->thing_flags, other->thing_flags, sizeof(u8) * other->thing_max);
+}
 
+// Lets the things of a new instance copy whatever they need from the original (chip instances)
+void circuit_copy_things(Circuit* circ, Circuit* other)
+{
 	THINGS_FOREACH(circ, THING_All)
 	{
-		it->dirty = false;
-		it->tic = 0;
+		u32 index = it->index;
+		circ->thing_flags[index] &= ~FLAG_Dirty;
+
 		Thing_Type_Data* type = thing_type_data(it);
 		if (type->on_copy)
-		{
-			u32 index = it - circ->things;
-			Thing* other_thing = &other->things[index];
+			type->on_copy(circ, it, other, thing_at(other, index));
+	}
+}
 
-			type->on_copy(circ, it, other_thing);
-		}
+void circuit_copy(Circuit* circ, Circuit* other)
+{
+	circuit_copy_instance(circ, other);
+
+	circ->layout_refs = NULL;
+	things_copy_pages(circ);
+
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		chip_copy_links((Chip*)it);
+	}
+
+	zero_t(circ->spatial);
+	zero_t(circ->wires);
+	circuit_reindex(circ);
+
+	circuit_copy_things(circ, other);
+}
+
+void circuit_share(Circuit* circ, Circuit* other)
+{
+	if (!other->layout_refs)
+	{
+		other->layout_refs = malloc(sizeof(u32));
+		*other->layout_refs = 1;
 	}
+
+	(*other->layout_refs)++;
+
+	circuit_copy_instance(circ, other);
+	circuit_copy_things(circ, other);
+}
+
+void circuit_unshare(Circuit* circ)
+{
+	if (!circ->layout_refs)
+		return;
+
+	// Everyone else let go of the layout, so it's ours now
+	u32* refs = circ->layout_refs;
+	circ->layout_refs = NULL;
+	if (--(*refs) == 0)
+	{
+		free(refs);
+		return;
+	}
+
+	things_copy_pages(circ);
+
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		chip_copy_links((Chip*)it);
+	}
+
+	zero_t(circ->spatial);
+	zero_t(circ->wires);
+	circuit_reindex(circ);
+}
+
+bool circuit_is_shared(Circuit* circ)
+{
+	return circ->layout_refs && *circ->layout_refs > 1;
 }
 
 void circuit_copy_rect(Circuit* circ, Circuit* other, Rect copy_rect)
@@ -164,35 +501,133 @@ void circuit_copy_rect(Circuit* circ, Circuit* other, Rect copy_rect)
 
 void circuit_shift(Circuit* circ, Point amount)
 {
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+
 	THINGS_FOREACH(circ, THING_All)
 	{
 		it->pos = point_add(it->pos, amount);
 	}
+
+	circuit_reindex(circ);
 }
 
 #define fwrite_t(expr, file) (fwrite(&(expr), sizeof(expr), 1, file))
 #define fread_t(expr, file) (fread(&(expr), sizeof(expr), 1, file))
 
+// On-disk layout of a thing, from before the simulation state was moved out of the things
+typedef struct
+{
+	u32 generation;
+	u8 type;
+	bool valid;
+	bool dirty;
+	u8 flags;
+	u32 tic;
+
+	Point pos;
+	Point size;
+
+	u8 data[64];
+} Thing_Record;
+
+// Nodes used to keep their net in the thing as well
+typedef struct
+{
+	i32 recurse_id;
+
+	u8 link_type;
+	Thing_Id_Record link_node;
+	Thing_Id_Record link_chip;
+
+	Thing_Id_Record connections[4];
+	Net_Id net;
+} Node_Record;
+
+void thing_to_record(Circuit* circ, Thing* thing, Thing_Record* record)
+{
+	u32 index = thing->index;
+
+	zero_t(*record);
+	record->generation = id_record_generation(thing->generation);
+	record->type = thing->type;
+	record->valid = thing->valid;
+	record->flags = circ->thing_flags[index] & ~FLAG_Dirty;
+	record->pos = thing->pos;
+	record->size = thing->size;
+
+	if (thing->type == THING_Node)
+	{
+		Node* node = (Node*)thing;
+		Node_Record* node_record = (Node_Record*)record->data;
+		node_record->link_type = node->link_type;
+		node_record->link_node = id_to_record(node->link_node);
+		node_record->link_chip = id_to_record(node->link_chip);
+		for(u32 c=0; c<4; ++c)
+			node_record->connections[c] = id_to_record(node->connections[c]);
+	}
+	else if (thing->valid)
+	{
+		memcpy(record->data, thing->data, sizeof(thing->data));
+	}
+}
+
+void thing_from_record(Circuit* circ, Thing* thing, Thing_Record* record)
+{
+	u32 index = thing->index;
+
+	thing->generation = record->generation;
+	thing->type = record->type;
+	thing->valid = record->valid;
+	thing->pos = record->pos;
+	thing->size = record->size;
+
+	if (thing->type == THING_Node)
+	{
+		Node* node = (Node*)thing;
+		Node_Record* node_record = (Node_Record*)record->data;
+		node->link_type = node_record->link_type;
+		node->link_node = id_from_record(node_record->link_node);
+		node->link_chip = id_from_record(node_record->link_chip);
+		for(u32 c=0; c<4; ++c)
+			node->connections[c] = id_from_record(node_record->connections[c]);
+	}
+	else
+	{
+		memcpy(thing->data, record->data, sizeof(thing->data));
+	}
+
+	circ->thing_flags[index] = record->flags & ~FLAG_Dirty;
+	circ->thing_tics[index] = 0;
+}
+
 void circuit_fwrite(Circuit* circ, FILE* file)
 {
 	fwrite_t(circ->name, file);
-	fwrite_t(circ->gen_num, file);
+	u16 gen_num = id_record_generation(circ->gen_num);
+	fwrite_t(gen_num, file);
 
 	// Write things
 	fwrite_t(circ->thing_max, file);
 	fwrite_t(circ->thing_num, file);
 	for(u32 i=0; i<circ->thing_num; ++i)
 	{
-		Thing* thing = &circ->things[i];
+		Thing* thing = thing_at(circ, i);
 
-		fwrite(thing, sizeof(Thing), 1, file);
+		Thing_Record record;
+		thing_to_record(circ, thing, &record);
+		fwrite_t(record, file);
 		Thing_Type_Data* type = thing_type_data(thing);
 		if (type->on_save)
 			type->on_save(circ, thing, file);
 	}
 
 	// Write public nodes
-	fwrite_t(circ->public_nodes, file);
+	Thing_Id_Record public_nodes[MAX_PUBLIC_NODES];
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		public_nodes[i] = id_to_record(circ->public_nodes[i]);
+
+	fwrite_t(public_nodes, file);
 }
 
 void circuit_fread(Circuit* circ, FILE* file)
@@ -200,52 +635,130 @@ void circuit_fread(Circuit* circ, FILE* file)
 	circuit_clear(circ);
 
 	fread_t(circ->name, file);
-	fread_t(circ->gen_num, file);
+
+	// Generations were cut down to 16 bits, new ones continue after the highest one in the file
+	u16 gen_num = 0;
+	fread_t(gen_num, file);
+	circ->gen_num = gen_num;
 
 	// Read things
-	fread_t(circ->thing_max, file);
-	circ->things = malloc(sizeof(Thing) * circ->thing_max);
-	mem_zero(circ->things, sizeof(Thing) * circ->thing_max);
+	u32 thing_max = 0;
+	fread_t(thing_max, file);
+	things_reserve(circ, thing_max);
 
 	fread_t(circ->thing_num, file);
 	for(u32 i=0; i<circ->thing_num; ++i)
 	{
-		Thing* thing = &circ->things[i];
+		Thing* thing = thing_at(circ, i);
+		thing->index = i;
 
-		fread(thing, sizeof(Thing), 1, file);
+		Thing_Record record;
+		fread_t(record, file);
+		thing_from_record(circ, thing, &record);
 		Thing_Type_Data* type = thing_type_data(thing);
 		if (type->on_load)
 			type->on_load(circ, thing, file);
+
+		circ->gen_num = max(circ->gen_num, thing->generation);
 	}
 
 	// Read public nodes
-	fread_t(circ->public_nodes, file);
+	Thing_Id_Record public_nodes[MAX_PUBLIC_NODES];
+	fread_t(public_nodes, file);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		circ->public_nodes[i] = id_from_record(public_nodes[i]);
+
+	things_rebuild_free(circ);
+	circuit_reindex(circ);
+	circuit_forget_nets(circ);
+	circuit_update_driven(circ);
+}
+
+u64 circuit_write_file(Circuit* circ, const char* path)
+{
+	// The file being replaced can still be mapped by a loaded circuit, so it's never written over
+	char temp_path[512];
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	FILE* file = fopen(temp_path, "wb");
+	if (!file)
+		return 0;
+
+	u64 size = circfile_fwrite(circ, file);
+	bool written = !ferror(file);
+	written &= fclose(file) == 0;
+
+	if (!written || !mapped_file_replace(temp_path, path))
+	{
+		remove(temp_path);
+		return 0;
+	}
+
+	return size;
 }
 
 void circuit_save(Circuit* circ, const char* path)
 {
-	FILE* file = fopen(path, "wb");
-	assert(file != NULL);
+	TRACE_BEGIN(begin);
+	netlist_sync(&circ->netlist);
 
-	circuit_fwrite(circ, file);
-	u32 bytes_written = ftell(file);
+	u64 size = circuit_write_file(circ, path);
+	if (size)
+		log("Saved to '%s'; %dB written", path, (u32)size);
+	else
+		msg_box("Failed to save circuit '%s'; the file couldn't be written", path);
 
-	log("Saved to '%s'; %dB written", path, bytes_written);
-	fclose(file);
+	TRACE_END("save", begin);
 }
 
-void circuit_load(Circuit* circ, const char* path)
+bool circuit_load(Circuit* circ, const char* path)
 {
+	// Whatever layouts were there are gone, even if the file turns out empty
+	circuit_edited(circ);
+
 	FILE* file = fopen(path, "rb");
 	if (!file)
 	{
 		msg_box("Failed to load circuit '%s'; file not found", path);
-		return;
+		return false;
 	}
 
-	circuit_fread(circ, file);
+	TRACE_BEGIN(begin);
+	fseek(file, 0, SEEK_END);
 	u32 bytes_read = ftell(file);
-	fclose(file);
+	fseek(file, 0, SEEK_SET);
+
+	// Files in the current format are mapped, pages are read as they're touched. Legacy files are
+	// read record by record
+	u32 magic = 0;
+	fread_t(magic, file);
+	fseek(file, 0, SEEK_SET);
+
+	bool loaded = true;
+	if (magic == CIRCFILE_MAGIC)
+	{
+		fclose(file);
+		Mapped_File* map = mapped_file_open(path);
+		loaded = map && circfile_map(circ, map);
+		if (map)
+			mapped_file_release(map);
+	}
+	else
+	{
+		circuit_fread(circ, file);
+		fclose(file);
+	}
+
+	if (!loaded)
+	{
+		msg_box("Failed to load circuit '%s'; the file is damaged or from a newer version", path);
+		return false;
+	}
+
+	// Queues aren't saved, so everything has to be simulated again. Pushing every thing takes about as
+	// long as reading them and a netlist tic drops the queues right away, so it waits for a subtic
+	circ->dirty_pending = true;
+	TRACE_END("load", begin);
 
 	log("Loaded '%s'; %d bytes read", path, bytes_read);
+	return true;
 }
\ No newline at end of file
@@ -1,37 +1,91 @@
 #pragma once
 #include "tic.h"
+#include "spatial.h"
+#include "wire.h"
+#include "netlist.h"
 #include <stdio.h>
 
 #define MAX_PUBLIC_NODES 32
 
 typedef struct Thing Thing;
+typedef struct Rewind Rewind;
 
 /* CIRCUIT */
 typedef struct Circuit
 {
 	char name[20];
-	u16 gen_num;
+	u32 gen_num;
 
-	Thing* things;
+	// The layout (things, their spatial and wire index and public nodes) is shared between instances
+	// of the same chip until one of them gets edited, see circuit_share/circuit_unshare
+	Thing* thing_pages[THING_PAGE_MAX];
+	u32 page_num;
 	u32 thing_max;
 	u32 thing_num;
+	u32 free_slot; // Index + 1 of the first deleted slot below thing_num, 0 if there are none
+	Spatial_Hash spatial;
+	Wire_Index wires;
+	u32* layout_refs;
+
+	// The first mapped_pages pages point into a mapped file instead of being allocated, see things_map
+	Mapped_File* map;
+	u32 mapped_pages;
+
+	// Per-instance state of the things, indexed by thing index, see THING_IMPL
+	u8* thing_flags;
+	u32* thing_tics;
+	Net_Id* thing_nets;
+	u32* thing_epochs;
+	Circuit** thing_circuits;
 
 	Thing_Id public_nodes[MAX_PUBLIC_NODES];
 	Circuit* parent;
+	Thing_Id parent_chip;
+
+	// Only used on root circuits, chip circuits use the queues and nets of their root. After a load
+	// every thing is dirty, but the queues are only filled once something uses them, see circuit_dirty_queue
+	Dirty_Queue dirty_queues[2];
+	u8 queue_index;
+	bool dirty_pending;
+	Net_Table nets;
+	Netlist netlist;
+
+	// History recorded every tic, if someone attached one, see rewind.h
+	Rewind* rewind;
+
+	// Goes up with every edit of a layout in this tree, and when it's loaded over, only kept on the
+	// root. Layouts are only read by the simulation, so whoever copies them over several frames can
+	// tell from this whether they changed
+	u32 layout_edits;
 } Circuit;
 
 Circuit* circuit_make(const char* name);
 void circuit_clear(Circuit* circ);
 void circuit_free(Circuit* circ);
+Circuit* circuit_root(Circuit* circ);
+void circuit_edited(Circuit* circ);
+void circuit_dirty_all(Circuit* circ);
+void circuit_clear_dirty(Circuit* circ);
+
+// The queue the next subtic pops from, with everything dirty if the circuit was just loaded
+Dirty_Queue* circuit_dirty_queue(Circuit* circ);
+void circuit_reindex(Circuit* circ);
 
 void circuit_subtic(Circuit* circ);
 void circuit_tic(Circuit* circ);
 
 void circuit_merge(Circuit* circ, Circuit* other);
 void circuit_copy(Circuit* circ, Circuit* other);
+void circuit_share(Circuit* circ, Circuit* other);
+void circuit_unshare(Circuit* circ);
+bool circuit_is_shared(Circuit* circ);
 void circuit_copy_rect(Circuit* circ, Circuit* other, Rect copy_rect);
 void circuit_shift(Circuit* circ, Point amount);
 
 void circuit_save(Circuit* circ, const char* path);
-void circuit_load(Circuit* circ, const char* path);
+
+// Writes a file through a temp file, which replaces path once it's complete. Only reads circ, so it
+// can run on another thread while nothing changes circ. Returns the bytes written, 0 on failure
+u64 circuit_write_file(Circuit* circ, const char* path);
+bool circuit_load(Circuit* circ, const char* path);
 
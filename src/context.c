@@ -2,6 +2,7 @@
 #include "gl_bind.h"
 #include "board.h"
 #include "cells.h"
+#include "trace.h"
 
 #define KEY_CTRL 0x1D
 #define KEY_SHIFT 0x2A
@@ -19,6 +20,7 @@ bool is_open = false;
 u32 key_mod_flags = 0;
 const u32 window_style = (WS_OVERLAPPEDWINDOW | WS_SIZEBOX | WS_VISIBLE);
 i32 window_scale = 2;
+u64 open_time_ns = 0;
 
 // Structs for handing events
 // WM_KEYDOWN & WM_KEYUP
@@ -183,6 +185,8 @@ LRESULT CALLBACK wnd_proc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam)
 
 void context_open(const char* title, i32 x, i32 y, u32 width, u32 height)
 {
+	open_time_ns = trace_now_ns();
+
 	// Init opengl!
 	init_opengl();
 
@@ -304,5 +308,5 @@ void context_end_frame()
 
 float time_now()
 {
-	return 0.f;
+	return (trace_now_ns() - open_time_ns) / 1000000.f;
 }
\ No newline at end of file
@@ -22,5 +22,5 @@ void context_close();
 void context_begin_frame();
 void context_end_frame();
 
-// Current times since init in milliseconds
+// Current time since context_open in milliseconds
 float time_now();
\ No newline at end of file
@@ -1,11 +1,19 @@
 #include "debug.h"
-#include "winmin.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include "winmin.h"
+#endif
 
 char* parse_vargs(const char* format, va_list list)
 {
-	int msg_length = vsnprintf(NULL, 0, format, list);
+	// Measuring uses up the list on some platforms, so measure on a copy
+	va_list measure_list;
+	va_copy(measure_list, list);
+	int msg_length = vsnprintf(NULL, 0, format, measure_list);
+	va_end(measure_list);
 
 	char* msg_buffer = (char*)malloc(msg_length + 1);
 	vsprintf(msg_buffer, format, list);
@@ -32,14 +40,23 @@ void _msg_box(const char* title, const char* format, ...)
 	char* msg = parse_vargs(format, vl);
 	va_end(vl);
 
+#ifdef _WIN32
 	MessageBox(NULL, msg, title, MB_OK);
+#else
+	// Headless, there's nothing to show a box on
+	fprintf(stderr, "%s: %s\n", title, msg);
+#endif
 
 	free(msg);
 }
 
 bool _can_debug_break()
 {
+#ifdef _WIN32
 	return IsDebuggerPresent();
+#else
+	return false;
+#endif
 }
 
 void _debug_exit(i32 exit_code)
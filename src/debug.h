@@ -8,10 +8,16 @@ void _debug_exit(i32 exit_code);
 #define msg_box(format, ...) (_msg_box("Message", format, __VA_ARGS__))
 #define error(format, ...) ((_msg_box("ERROR", format, __VA_ARGS__), 0) || debug_break() || (_debug_exit(1), 0))
 
+#ifndef _MSC_VER
+#define __debugbreak() __builtin_trap()
+#endif
+
 #if DEBUG
 #define assert(expr) (!!(expr) || (error("Assert failed:\n\n%s(%d)\n%s", __FILE__, __LINE__, #expr), 0))
 #define debug_break() (_can_debug_break() && (__debugbreak(), 0))
 #define log(format, ...) (_debug_log(format, __VA_ARGS__))
 #else
 #define assert(expr) expr
+#define debug_break() 0
+#define log(format, ...)
 #endif
\ No newline at end of file
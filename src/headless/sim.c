@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "circuit.h"
+#include "bench.h"
+#include "suite.h"
+#include "run.h"
+#include "trace.h"
+#include "vcd.h"
+
+// Headless simulator, for batch and perf runs on machines without a display.
+// Only the simulation is built in, no window, OpenGL or cells, see the Makefile
+extern u32 tic_pop_count;
+
+void sim_usage()
+{
+	printf("usage: sim [-threads n] [-memo entries] [-events] [-trace trace.json] [-vcd waves.vcd] file.circ tic_count\n");
+	printf("       sim -run file.circ tic\n");
+	printf("       sim -bench [thing count]\n");
+	printf("       sim -suite [results.json]\n");
+}
+
+// Prints the states of the public nodes of the root circuit, in slot order
+void sim_print_public(Circuit* circ)
+{
+	u32 last = 0;
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (node_get(circ, circ->public_nodes[i]))
+			last = i + 1;
+	}
+
+	printf("  public nodes: ");
+	for(u32 i=0; i<last; ++i)
+	{
+		Node* node = node_get(circ, circ->public_nodes[i]);
+		putchar(node ? (thing_active(circ, node) ? '1' : '0') : '-');
+	}
+
+	printf(last ? "\n" : "none\n");
+}
+
+// Counters of the last tic, only there when built with STATS
+void sim_print_stats()
+{
+#if STATS
+	Tic_Stats* stats = &tic_stats_last;
+	printf("  last tic %u: %.3fms, %u pushed, queue peak %u\n", stats->tic, stats->tic_ns / 1000000.0, stats->push_count, stats->queue_high_water);
+	printf("  cleaned: %u nodes %.3fms, %u inverters %.3fms, %u delays %.3fms\n",
+		stats->clean_count[THING_Node], stats->clean_ns[THING_Node] / 1000000.0,
+		stats->clean_count[THING_Inverter], stats->clean_ns[THING_Inverter] / 1000000.0,
+		stats->clean_count[THING_Delay], stats->clean_ns[THING_Delay] / 1000000.0);
+	printf("  nets: %u collected, %u nodes, longest %u, %u resolved, links %u into chips, %u out of chips\n",
+		stats->net_collect_count, stats->net_collect_nodes, stats->net_collect_longest, stats->net_resolve_nodes,
+		stats->link_chip_count, stats->link_public_count);
+	printf("  netlist: %llu gate evals, compiled in %.3fms\n", stats->gate_evals, stats->compile_ns / 1000000.0);
+#endif
+}
+
+// Loads a circuit and ticks it tic_num times, on the netlist or on the event-driven engine
+bool sim_file(const char* path, u32 tic_num, bool events, const char* vcd_path)
+{
+	Circuit* circ = circuit_make("SIM");
+	if (!circuit_load(circ, path))
+	{
+		circuit_free(circ);
+		return false;
+	}
+
+	d32 begin = bench_time();
+	if (!events)
+		netlist_compile(&circ->netlist, circ);
+	d32 compile_time = bench_time() - begin;
+
+	// Records the public nodes of every circuit in the hierarchy
+	Vcd_Recorder vcd;
+	mem_zero(&vcd, sizeof(vcd));
+	if (vcd_path && !vcd_open(&vcd, circ, vcd_path))
+		printf("can't write waves to %s\n", vcd_path);
+
+	if (vcd.file)
+		vcd_sample(&vcd);
+
+	u64 eval_begin = circ->netlist.eval_count;
+	u32 pop_begin = tic_pop_count;
+	begin = bench_time();
+
+	for(u32 i=0; i<tic_num; ++i)
+	{
+		if (events)
+		{
+			// Subtic until the whole tic is done
+			u32 start_tic = tic;
+			while(tic == start_tic && circuit_dirty_queue(circ)->count != 0)
+				circuit_subtic(circ);
+		}
+		else
+		{
+			circuit_tic(circ);
+		}
+
+		if (vcd.file)
+			vcd_sample(&vcd);
+	}
+
+	d32 elapsed = bench_time() - begin;
+	netlist_sync(&circ->netlist);
+	vcd_close(&vcd);
+
+	printf("%s: %u things, %u tics in %.3fs, %.1f tics/s\n", path, circ->thing_num, tic_num, elapsed, tic_num / elapsed);
+	if (events)
+	{
+		u32 event_num = tic_pop_count - pop_begin;
+		printf("  event-driven, %u events, %.1f events/tic\n", event_num, tic_num ? (d32)event_num / tic_num : 0.0);
+	}
+	else
+	{
+		Netlist* netlist = &circ->netlist;
+		Memo_Stats memo = netlist_memo_stats(netlist);
+		printf("  netlist compiled in %.3fs, %u gates in %u islands, %llu gate evals, %u memo units, %llu memo hits, %llu misses, %llu skips\n",
+			compile_time, netlist->gate_num, netlist->island_num, netlist->eval_count - eval_begin, memo.unit_num, memo.hits, memo.misses, memo.skips);
+	}
+
+	sim_print_public(circ);
+	sim_print_stats();
+
+	circuit_clear(circ);
+	circuit_free(circ);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool events = false;
+	const char* trace_path = NULL;
+	const char* vcd_path = NULL;
+	i32 arg = 1;
+
+	for(; arg < argc && argv[arg][0] == '-'; ++arg)
+	{
+		if (strcmp(argv[arg], "-bench") == 0)
+		{
+			bench_run(argc - arg - 1, argv + arg + 1);
+			return 0;
+		}
+
+		if (strcmp(argv[arg], "-suite") == 0)
+		{
+			suite_run(argc - arg - 1, argv + arg + 1);
+			return 0;
+		}
+
+		if (strcmp(argv[arg], "-run") == 0 && arg + 2 < argc)
+		{
+			run_file(argv[arg + 1], atoi(argv[arg + 2]));
+			return 0;
+		}
+
+		if (strcmp(argv[arg], "-threads") == 0 && arg + 1 < argc)
+			netlist_set_thread_num(atoi(argv[++arg]));
+		else if (strcmp(argv[arg], "-memo") == 0 && arg + 1 < argc)
+			netlist_set_memo(atoi(argv[++arg]));
+		else if (strcmp(argv[arg], "-events") == 0)
+			events = true;
+		else if (strcmp(argv[arg], "-trace") == 0 && arg + 1 < argc)
+			trace_path = argv[++arg];
+		else if (strcmp(argv[arg], "-vcd") == 0 && arg + 1 < argc)
+			vcd_path = argv[++arg];
+		else
+		{
+			sim_usage();
+			return 1;
+		}
+	}
+
+	if (arg + 2 != argc)
+	{
+		sim_usage();
+		return 1;
+	}
+
+	bool loaded = sim_file(argv[arg], atoi(argv[arg + 1]), events, vcd_path);
+	if (trace_path && !trace_dump(trace_path))
+		printf("can't write trace to %s\n", trace_path);
+
+	return loaded ? 0 : 1;
+}
@@ -0,0 +1,811 @@
+#include "journal.h"
+#include "net.h"
+#include "wire.h"
+#include <stdlib.h>
+
+// Everything a deleted thing needs to be brought back
+#define JOURNAL_CONN_MAX 16
+
+typedef struct
+{
+	// Its own connections, then the ones other nodes have to it that it has no slot for
+	u32 conn_num;
+	Point conns[JOURNAL_CONN_MAX];
+	u32 directions[JOURNAL_CONN_MAX];
+	u32 link_type;
+	u32 slot;
+	bool has_chip;
+	Point chip_pos;
+	Thing_Id link_node;
+
+	u32 circuit;
+	Point size;
+	u32 link_mask;
+	Point links[MAX_PUBLIC_NODES];
+} Journal_Deleted;
+
+void journal_init(Journal* journal, u32 budget)
+{
+	mem_zero(journal, sizeof(Journal));
+	journal->budget = budget;
+}
+
+Journal_Group* journal_group(Journal* journal, u32 i)
+{
+	return &journal->groups[journal->group_first + i];
+}
+
+void journal_group_free(Journal_Group* group)
+{
+	for(u32 i=0; i<group->circuit_num; ++i)
+	{
+		circuit_clear(group->circuits[i]);
+		circuit_free(group->circuits[i]);
+	}
+
+	if (group->ops)
+		free(group->ops);
+	if (group->circuits)
+		free(group->circuits);
+
+	zero_t(*group);
+}
+
+// Drops the groups from i on, the ones that could be redone
+void journal_drop_after(Journal* journal, u32 i)
+{
+	while(journal->group_num > i)
+	{
+		Journal_Group* group = journal_group(journal, --journal->group_num);
+		journal->bytes -= group->bytes;
+		journal_group_free(group);
+	}
+
+	journal->done = min(journal->done, journal->group_num);
+}
+
+// Drops the oldest group, which is always one that's done
+void journal_drop_first(Journal* journal)
+{
+	assert(journal->done > 0);
+	Journal_Group* group = journal_group(journal, 0);
+	journal->bytes -= group->bytes;
+	journal_group_free(group);
+
+	journal->group_first++;
+	journal->group_num--;
+	journal->done--;
+}
+
+void journal_clear(Journal* journal)
+{
+	journal_drop_after(journal, 0);
+	journal->group_first = 0;
+	journal->recording = false;
+}
+
+void journal_free(Journal* journal)
+{
+	journal_clear(journal);
+
+	if (journal->groups)
+		free(journal->groups);
+	if (journal->offsets)
+		free(journal->offsets);
+
+	zero_t(*journal);
+}
+
+void journal_begin(Journal* journal, Circuit* circ)
+{
+	assert(!journal->recording);
+	journal_drop_after(journal, journal->done);
+
+	if (journal->group_first + journal->group_num >= journal->group_max)
+	{
+		// Move the groups back to the front when the dropped ones are at least half, grow otherwise
+		if (journal->group_first >= journal->group_max / 2 && journal->group_first > 0)
+		{
+			memmove(journal->groups, journal->groups + journal->group_first, sizeof(Journal_Group) * journal->group_num);
+			journal->group_first = 0;
+		}
+		else
+		{
+			journal->group_max = journal->group_max == 0 ? 64 : (journal->group_max << 1);
+			journal->groups = realloc(journal->groups, sizeof(Journal_Group) * journal->group_max);
+			assert(journal->groups != NULL);
+		}
+	}
+
+	Journal_Group* group = journal_group(journal, journal->group_num++);
+	mem_zero(group, sizeof(Journal_Group));
+
+	// Walk up to the root, then turn the path around
+	for(Circuit* it = circ; it->parent; it = it->parent)
+	{
+		assert(group->depth < JOURNAL_DEPTH_MAX);
+		group->path[group->depth++] = chip_get(it->parent, it->parent_chip)->pos;
+	}
+
+	for(u32 i=0; i<group->depth / 2; ++i)
+	{
+		Point swap = group->path[i];
+		group->path[i] = group->path[group->depth - 1 - i];
+		group->path[group->depth - 1 - i] = swap;
+	}
+
+	journal->done = journal->group_num;
+	journal->recording = true;
+}
+
+void journal_end(Journal* journal)
+{
+	assert(journal->recording);
+	journal->recording = false;
+
+	// Nothing changed, nothing to undo
+	Journal_Group* group = journal_group(journal, journal->group_num - 1);
+	if (group->op_size == 0)
+	{
+		journal_group_free(group);
+		journal->group_num--;
+		journal->done--;
+		return;
+	}
+
+	group->bytes += group->op_size + sizeof(Journal_Group);
+	journal->bytes += group->bytes;
+
+	while(journal->bytes > journal->budget && journal->group_num > 0)
+		journal_drop_first(journal);
+}
+
+/* ENCODING */
+void journal_put(Journal* journal, u32 value)
+{
+	assert(journal->recording);
+	Journal_Group* group = journal_group(journal, journal->group_num - 1);
+	if (group->op_size + 5 > group->op_max)
+	{
+		group->op_max = group->op_max == 0 ? 32 : (group->op_max << 1);
+		group->ops = realloc(group->ops, group->op_max);
+		assert(group->ops != NULL);
+	}
+
+	while(value >= 0x80)
+	{
+		group->ops[group->op_size++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+
+	group->ops[group->op_size++] = value;
+}
+
+// Coordinates are zigzagged, so small negative ones stay small
+void journal_put_point(Journal* journal, Point pnt)
+{
+	journal_put(journal, ((u32)pnt.x << 1) ^ (u32)(pnt.x >> 31));
+	journal_put(journal, ((u32)pnt.y << 1) ^ (u32)(pnt.y >> 31));
+}
+
+u32 journal_get(Journal_Group* group, u32* at)
+{
+	u32 value = 0;
+	for(u32 shift = 0; ; shift += 7)
+	{
+		u8 byte = group->ops[(*at)++];
+		value |= (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+}
+
+i32 journal_get_coord(Journal_Group* group, u32* at)
+{
+	u32 value = journal_get(group, at);
+	return (i32)(value >> 1) ^ -(i32)(value & 1);
+}
+
+Point journal_get_point(Journal_Group* group, u32* at)
+{
+	i32 x = journal_get_coord(group, at);
+	i32 y = journal_get_coord(group, at);
+	return point(x, y);
+}
+
+// Keeps a copy of a circuit in the group being recorded, returns its index
+u32 journal_save_circuit(Journal* journal, Circuit* circ)
+{
+	Journal_Group* group = journal_group(journal, journal->group_num - 1);
+	if (group->circuit_num >= group->circuit_max)
+	{
+		group->circuit_max = group->circuit_max == 0 ? 4 : (group->circuit_max << 1);
+		group->circuits = realloc(group->circuits, sizeof(Circuit*) * group->circuit_max);
+		assert(group->circuits != NULL);
+	}
+
+	Circuit* copy = circuit_make(circ->name);
+	circuit_copy(copy, circ);
+	group->circuits[group->circuit_num] = copy;
+
+	// Chips in the copy share their layouts with the original, only count the things themselves
+	group->bytes += copy->thing_num * (sizeof(Thing) + sizeof(u8) + sizeof(u32) * 3 + sizeof(Net_Id) + sizeof(Circuit*));
+	return group->circuit_num++;
+}
+
+/* EDITS */
+Thing* journal_make(Circuit* circ, u8 type, Point pos)
+{
+	switch(type)
+	{
+		case THING_Node: return (Thing*)node_create(circ, pos);
+		case THING_Inverter: return (Thing*)inverter_create(circ, pos);
+		case THING_Chip: return (Thing*)chip_create(circ, pos);
+		case THING_Delay: return (Thing*)delay_create(circ, pos);
+	}
+
+	return NULL;
+}
+
+// Thing of a type placed at pos, not just covering it. Chips can overlap
+Thing* journal_find(Circuit* circ, u8 type, Point pos)
+{
+	Spatial_Hash* hash = &circ->spatial;
+	Thing* found = NULL;
+	for(u32 entry = spatial_first(hash, pos); entry; entry = spatial_next(hash, entry))
+	{
+		Thing* thing = thing_at(circ, spatial_thing(hash, entry));
+		if (!thing->valid || thing->type != type || !point_eq(thing->pos, pos))
+			continue;
+
+		if (!found || thing->index < found->index)
+			found = thing;
+	}
+
+	return found;
+}
+
+void journal_remove(Journal* journal, Circuit* circ, u8 type, Point pos)
+{
+	Thing* thing = journal_find(circ, type, pos);
+	if (!thing)
+		return;
+
+	if (type == THING_Chip)
+		journal->chip_deleted = true;
+
+	thing_delete(circ, thing);
+}
+
+// A connection only goes one way when a node was out of slots. Bit 0 is a to b, bit 1 b to a
+u32 journal_direction(Circuit* circ, Node* a, Node* b)
+{
+	Thing_Id a_id = thing_id(circ, (Thing*)a);
+	Thing_Id b_id = thing_id(circ, (Thing*)b);
+	u32 direction = 0;
+	for(u32 i=0; i<4; ++i)
+	{
+		if (id_eq(a->connections[i], b_id))
+			direction |= 1;
+		if (id_eq(b->connections[i], a_id))
+			direction |= 2;
+	}
+
+	return direction;
+}
+
+void journal_set_direction(Circuit* circ, Node* a, Node* b, u32 direction)
+{
+	node_disconnect(circ, a, b);
+	if (direction == 0)
+		return;
+
+	// Connect both ways, then take back the way it didn't go
+	node_connect(circ, a, b);
+	for(u32 i=0; i<4; ++i)
+	{
+		if (!(direction & 1) && id_eq(a->connections[i], thing_id(circ, (Thing*)b)))
+			zero_t(a->connections[i]);
+		if (!(direction & 2) && id_eq(b->connections[i], thing_id(circ, (Thing*)a)))
+			zero_t(b->connections[i]);
+	}
+
+	node_break_net(circ, a);
+	thing_set_dirty(circ, (Thing*)b);
+}
+
+void journal_put_connection(Journal* journal, Node* a, Node* b, u32 before, u32 after)
+{
+	if (before == after)
+		return;
+
+	journal_put(journal, JOP_Connect);
+	journal_put_point(journal, a->pos);
+	journal_put_point(journal, b->pos);
+	journal_put(journal, before);
+	journal_put(journal, after);
+}
+
+// Hooks a link node back up to the public node of the chip it stands for
+void journal_link(Circuit* circ, Chip* chip, Node* node)
+{
+	Circuit* chip_circ = chip_circuit(circ, chip);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		if (!id_eq(chip_circ->public_nodes[i], node->link_node))
+			continue;
+
+		chip->link_nodes[i] = thing_id(circ, (Thing*)node);
+		node->link_chip = thing_id(circ, (Thing*)chip);
+		node_break_net(circ, node);
+		thing_set_dirty(circ, (Thing*)node);
+		return;
+	}
+}
+
+Thing* journal_create(Journal* journal, Circuit* circ, u8 type, Point pos)
+{
+	Thing* thing = journal_make(circ, type, pos);
+	journal_put(journal, JOP_Create);
+	journal_put(journal, type);
+	journal_put_point(journal, pos);
+	return thing;
+}
+
+void journal_delete(Journal* journal, Circuit* circ, Thing* thing)
+{
+	journal_put(journal, JOP_Delete);
+	journal_put(journal, thing->type);
+	journal_put_point(journal, thing->pos);
+
+	if (thing->type == THING_Node)
+	{
+		Node* node = (Node*)thing;
+		Node* conns[JOURNAL_CONN_MAX];
+		u32 conn_num = 0;
+		for(u32 i=0; i<4; ++i)
+		{
+			Node* other = node_get(circ, node->connections[i]);
+			if (other)
+				conns[conn_num++] = other;
+		}
+
+		// A connection to a node that was out of slots only goes one way, find those through the wires here
+		Thing_Id node_id = thing_id(circ, thing);
+		Wire* wires[JOURNAL_CONN_MAX];
+		u32 wire_num = wires_find(&circ->wires, node->pos, wires, JOURNAL_CONN_MAX);
+		for(u32 i=0; i<wire_num && conn_num < JOURNAL_CONN_MAX; ++i)
+		{
+			Thing_Id other_id = id_eq(wires[i]->a, node_id) ? wires[i]->b : wires[i]->a;
+			Node* other = node_get(circ, other_id);
+			if (!other || other == node || !journal_direction(circ, other, node))
+				continue;
+
+			bool listed = false;
+			for(u32 c=0; c<conn_num; ++c)
+				listed |= conns[c] == other;
+
+			if (!listed)
+				conns[conn_num++] = other;
+		}
+
+		journal_put(journal, conn_num);
+		for(u32 i=0; i<conn_num; ++i)
+		{
+			journal_put_point(journal, conns[i]->pos);
+			journal_put(journal, journal_direction(circ, node, conns[i]));
+		}
+
+		journal_put(journal, node->link_type);
+		if (node->link_type == LINK_Public)
+		{
+			journal_put(journal, node_public_slot(circ, node));
+		}
+		else if (node->link_type == LINK_Chip)
+		{
+			Chip* chip = chip_get(circ, node->link_chip);
+			journal_put(journal, chip != NULL);
+			if (chip)
+				journal_put_point(journal, chip->pos);
+
+			journal_put(journal, node->link_node.generation);
+			journal_put(journal, node->link_node.index);
+		}
+	}
+	else if (thing->type == THING_Chip)
+	{
+		Chip* chip = (Chip*)thing;
+		journal_put(journal, journal_save_circuit(journal, chip_circuit(circ, chip)));
+		journal_put_point(journal, chip->size);
+
+		u32 mask = 0;
+		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		{
+			if (node_get(circ, chip->link_nodes[i]))
+				mask |= 1u << i;
+		}
+
+		journal_put(journal, mask);
+		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		{
+			if (mask & (1u << i))
+				journal_put_point(journal, node_get(circ, chip->link_nodes[i])->pos);
+		}
+	}
+
+	thing_delete(circ, thing);
+}
+
+void journal_connect(Journal* journal, Circuit* circ, Node* a, Node* b)
+{
+	u32 before = journal_direction(circ, a, b);
+	node_connect(circ, a, b);
+	journal_put_connection(journal, a, b, before, journal_direction(circ, a, b));
+}
+
+void journal_disconnect(Journal* journal, Circuit* circ, Node* a, Node* b)
+{
+	u32 before = journal_direction(circ, a, b);
+	node_disconnect(circ, a, b);
+	journal_put_connection(journal, a, b, before, 0);
+}
+
+void journal_toggle_public(Journal* journal, Circuit* circ, Node* node)
+{
+	u32 prev_slot = node_public_slot(circ, node);
+	node_toggle_public(circ, node);
+	u32 slot = node_public_slot(circ, node);
+	if (slot == prev_slot)
+		return;
+
+	bool is_public = slot < MAX_PUBLIC_NODES;
+	journal_put(journal, JOP_Public);
+	journal_put_point(journal, node->pos);
+	journal_put(journal, is_public ? slot : prev_slot);
+	journal_put(journal, is_public);
+}
+
+// Whether node had a connection to other before the merge
+bool journal_had(Circuit* circ, Node* node, Node* other, u32* landed_at, Thing_Id* landed_conns)
+{
+	Thing_Id* conns = landed_at[node->index] ? &landed_conns[(landed_at[node->index] - 1) * 4] : node->connections;
+	for(u32 i=0; i<4; ++i)
+	{
+		if (id_eq(conns[i], thing_id(circ, (Thing*)other)))
+			return true;
+	}
+
+	return false;
+}
+
+void journal_merge(Journal* journal, Circuit* circ, Circuit* other)
+{
+	// Nodes the merge lands on get the connections of the nodes landing on them, remember what they had
+	u32 base = circ->thing_num;
+	u32 landed_num = 0;
+	Node** landed = malloc(sizeof(Node*) * (other->thing_num + 1));
+	Thing_Id* landed_conns = malloc(sizeof(Thing_Id) * 4 * (other->thing_num + 1));
+	u32* landed_slots = malloc(sizeof(u32) * (other->thing_num + 1));
+	u32* landed_at = malloc(sizeof(u32) * (base + 1));
+	mem_zero(landed_at, sizeof(u32) * (base + 1));
+	THINGS_FOREACH(other, THING_Node)
+	{
+		Node* existing = node_find(circ, it->pos);
+		if (!existing)
+			continue;
+
+		memcpy(&landed_conns[landed_num * 4], existing->connections, sizeof(Thing_Id) * 4);
+		landed_slots[landed_num] = node_public_slot(circ, existing);
+		landed[landed_num++] = existing;
+		landed_at[existing->index] = landed_num;
+	}
+
+	journal_put(journal, JOP_Merge);
+	journal_put(journal, journal_save_circuit(journal, other));
+	circuit_merge(circ, other);
+
+	// Whatever is new landed after all things that were there before
+	u32 created_num = 0;
+	for(u32 i=base; i<circ->thing_num; ++i)
+		created_num += thing_at(circ, i)->valid;
+
+	journal_put(journal, created_num);
+	for(u32 i=base; i<circ->thing_num; ++i)
+	{
+		Thing* thing = thing_at(circ, i);
+		if (!thing->valid)
+			continue;
+
+		journal_put(journal, thing->type);
+		journal_put_point(journal, thing->pos);
+	}
+
+	// Connections between two nodes that were there before don't go away with the new things
+	for(u32 i=0; i<landed_num; ++i)
+	{
+		Node* node = landed[i];
+		for(u32 c=0; c<4; ++c)
+		{
+			Node* conn = node_get(circ, node->connections[c]);
+			if (!conn || conn->index >= base || journal_had(circ, node, conn, landed_at, landed_conns))
+				continue;
+
+			// Both ways new, it was put down from the other side already
+			u32 direction = journal_direction(circ, node, conn);
+			bool conn_had = journal_had(circ, conn, node, landed_at, landed_conns);
+			if (!conn_had && (direction & 2) && landed_at[conn->index] && landed_at[conn->index] - 1 < i)
+				continue;
+
+			journal_put_connection(journal, node, conn, conn_had ? 2 : 0, direction);
+		}
+	}
+
+	// Nodes landed on can take the public slot of a node landing on them, or lose theirs
+	for(u32 i=0; i<landed_num; ++i)
+	{
+		Node* node = landed[i];
+		u32 slot = node_public_slot(circ, node);
+		if (landed_at[node->index] - 1 != i || slot == landed_slots[i])
+			continue;
+
+		bool is_public = slot < MAX_PUBLIC_NODES;
+		journal_put(journal, JOP_Public);
+		journal_put_point(journal, node->pos);
+		journal_put(journal, is_public ? slot : landed_slots[i]);
+		journal_put(journal, is_public);
+	}
+
+	free(landed);
+	free(landed_slots);
+	free(landed_conns);
+	free(landed_at);
+}
+
+/* UNDO */
+void journal_read_deleted(Journal_Group* group, u32* at, u8 type, Journal_Deleted* deleted)
+{
+	mem_zero(deleted, sizeof(Journal_Deleted));
+	if (type == THING_Node)
+	{
+		deleted->conn_num = journal_get(group, at);
+		for(u32 i=0; i<deleted->conn_num; ++i)
+		{
+			deleted->conns[i] = journal_get_point(group, at);
+			deleted->directions[i] = journal_get(group, at);
+		}
+
+		deleted->link_type = journal_get(group, at);
+		if (deleted->link_type == LINK_Public)
+		{
+			deleted->slot = journal_get(group, at);
+		}
+		else if (deleted->link_type == LINK_Chip)
+		{
+			deleted->has_chip = journal_get(group, at);
+			if (deleted->has_chip)
+				deleted->chip_pos = journal_get_point(group, at);
+
+			deleted->link_node.generation = journal_get(group, at);
+			deleted->link_node.index = journal_get(group, at);
+		}
+	}
+	else if (type == THING_Chip)
+	{
+		deleted->circuit = journal_get(group, at);
+		deleted->size = journal_get_point(group, at);
+		deleted->link_mask = journal_get(group, at);
+		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		{
+			if (deleted->link_mask & (1u << i))
+				deleted->links[i] = journal_get_point(group, at);
+		}
+	}
+}
+
+void journal_restore(Journal_Group* group, Circuit* circ, u8 type, Point pos, Journal_Deleted* deleted)
+{
+	Thing* thing = journal_make(circ, type, pos);
+	if (!thing)
+		return;
+
+	if (type == THING_Node)
+	{
+		Node* node = (Node*)thing;
+		for(u32 i=0; i<deleted->conn_num; ++i)
+		{
+			Node* other = node_find(circ, deleted->conns[i]);
+			if (other && other != node)
+				journal_set_direction(circ, node, other, deleted->directions[i]);
+		}
+
+		if (deleted->link_type == LINK_Public && deleted->slot < MAX_PUBLIC_NODES && !node_get(circ, circ->public_nodes[deleted->slot]))
+		{
+			node_set_public(circ, node, deleted->slot);
+		}
+		else if (deleted->link_type == LINK_Chip)
+		{
+			// The chip might come back later, it links up with its link nodes then
+			node->link_type = LINK_Chip;
+			node->link_node = deleted->link_node;
+			node_break_net(circ, node);
+
+			Chip* chip = deleted->has_chip ? (Chip*)journal_find(circ, THING_Chip, deleted->chip_pos) : NULL;
+			if (chip)
+				journal_link(circ, chip, node);
+		}
+	}
+	else if (type == THING_Chip)
+	{
+		Chip* chip = (Chip*)thing;
+		thing_resize(circ, thing, deleted->size);
+
+		Circuit* chip_circ = chip_circuit(circ, chip);
+		circuit_copy(chip_circ, group->circuits[deleted->circuit]);
+		chip_circ->parent = circ;
+		chip_circ->parent_chip = thing_id(circ, thing);
+
+		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		{
+			if (!(deleted->link_mask & (1u << i)))
+				continue;
+
+			Node* link = node_find(circ, deleted->links[i]);
+			if (link && link->link_type == LINK_Chip)
+				journal_link(circ, chip, link);
+		}
+	}
+}
+
+// Undoes or redoes the op at an offset, or just reads past it without a circuit. Returns the offset after it
+u32 journal_apply(Journal* journal, Journal_Group* group, Circuit* circ, u32 at, bool undo)
+{
+	u32 op = journal_get(group, &at);
+	switch(op)
+	{
+		case JOP_Create:
+		{
+			u8 type = journal_get(group, &at);
+			Point pos = journal_get_point(group, &at);
+			if (circ && undo)
+				journal_remove(journal, circ, type, pos);
+			else if (circ)
+				journal_make(circ, type, pos);
+
+			break;
+		}
+
+		case JOP_Delete:
+		{
+			u8 type = journal_get(group, &at);
+			Point pos = journal_get_point(group, &at);
+
+			Journal_Deleted deleted;
+			journal_read_deleted(group, &at, type, &deleted);
+			if (circ && undo)
+				journal_restore(group, circ, type, pos, &deleted);
+			else if (circ)
+				journal_remove(journal, circ, type, pos);
+
+			break;
+		}
+
+		case JOP_Connect:
+		{
+			Point a_pos = journal_get_point(group, &at);
+			Point b_pos = journal_get_point(group, &at);
+			u32 before = journal_get(group, &at);
+			u32 after = journal_get(group, &at);
+			Node* a = circ ? node_find(circ, a_pos) : NULL;
+			Node* b = circ ? node_find(circ, b_pos) : NULL;
+			if (a && b && a != b)
+				journal_set_direction(circ, a, b, undo ? before : after);
+
+			break;
+		}
+
+		case JOP_Public:
+		{
+			Point pos = journal_get_point(group, &at);
+			u32 slot = journal_get(group, &at);
+			bool is_public = journal_get(group, &at);
+			Node* node = circ ? node_find(circ, pos) : NULL;
+			if (!node)
+				break;
+
+			if (is_public != undo && node_get(circ, circ->public_nodes[slot]))
+				break;
+
+			node_set_public(circ, node, is_public != undo ? slot : MAX_PUBLIC_NODES);
+			break;
+		}
+
+		case JOP_Merge:
+		{
+			u32 index = journal_get(group, &at);
+			u32 created_num = journal_get(group, &at);
+			if (circ && !undo)
+				circuit_merge(circ, group->circuits[index]);
+
+			for(u32 i=0; i<created_num; ++i)
+			{
+				u8 type = journal_get(group, &at);
+				Point pos = journal_get_point(group, &at);
+				if (circ && undo)
+					journal_remove(journal, circ, type, pos);
+			}
+
+			break;
+		}
+
+		default: assert(false);
+	}
+
+	return at;
+}
+
+// Circuit the group edited, NULL if the chips on the way aren't there anymore
+Circuit* journal_circuit(Journal_Group* group, Circuit* root)
+{
+	Circuit* circ = root;
+	for(u32 i=0; i<group->depth; ++i)
+	{
+		Chip* chip = (Chip*)journal_find(circ, THING_Chip, group->path[i]);
+		if (!chip)
+			return NULL;
+
+		circ = chip_circuit(circ, chip);
+	}
+
+	// Copies made since might share the layout again
+	circuit_unshare(circ);
+	return circ;
+}
+
+bool journal_undo(Journal* journal, Circuit* root)
+{
+	assert(!journal->recording);
+	if (journal->done == 0)
+		return false;
+
+	Journal_Group* group = journal_group(journal, journal->done - 1);
+	Circuit* circ = journal_circuit(group, root);
+	if (!circ)
+		return false;
+
+	u32 op_num = 0;
+	for(u32 at = 0; at < group->op_size; at = journal_apply(journal, group, NULL, at, true))
+	{
+		if (op_num >= journal->offset_max)
+		{
+			journal->offset_max = journal->offset_max == 0 ? 64 : (journal->offset_max << 1);
+			journal->offsets = realloc(journal->offsets, sizeof(u32) * journal->offset_max);
+			assert(journal->offsets != NULL);
+		}
+
+		journal->offsets[op_num++] = at;
+	}
+
+	for(u32 i=op_num; i>0; --i)
+		journal_apply(journal, group, circ, journal->offsets[i - 1], true);
+
+	journal->done--;
+	return true;
+}
+
+bool journal_redo(Journal* journal, Circuit* root)
+{
+	assert(!journal->recording);
+	if (journal->done == journal->group_num)
+		return false;
+
+	Journal_Group* group = journal_group(journal, journal->done);
+	Circuit* circ = journal_circuit(group, root);
+	if (!circ)
+		return false;
+
+	for(u32 at = 0; at < group->op_size; )
+		at = journal_apply(journal, group, circ, at, false);
+
+	journal->done++;
+	return true;
+}
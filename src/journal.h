@@ -0,0 +1,80 @@
+#pragma once
+#include "circuit.h"
+
+// Journal
+// Undo and redo of layout edits. Every edit command is a group of small operations, stored as an
+// op code followed by varints. Things are referred to by type and position instead of id, since a
+// thing brought back by an undo gets a new id. Undoing a group applies the inverse of its operations
+// from last to first, redoing applies them again from first to last, so both take as long as the edit
+// did. Whatever can't be rebuilt from a few numbers (deleted chips, pasted circuits) is kept as a copy.
+// The circuit a group edited is found from the root through the positions of the chips it's in.
+// The oldest groups are dropped when the journal holds more than its budget.
+// Pastes are redone with circuit_merge, over things that overlap each other they can land differently.
+// Edits go through journal_create/delete/connect/..., between journal_begin and journal_end.
+#define JOURNAL_DEPTH_MAX 8
+
+enum Journal_Op
+{
+	JOP_Create,
+	JOP_Delete,
+	JOP_Connect,
+	JOP_Public,
+	JOP_Merge,
+};
+
+typedef struct
+{
+	// Positions of the chips from the root down to the edited circuit
+	u32 depth;
+	Point path[JOURNAL_DEPTH_MAX];
+
+	u8* ops;
+	u32 op_size;
+	u32 op_max;
+
+	Circuit** circuits;
+	u32 circuit_num;
+	u32 circuit_max;
+
+	// Counted against the budget, copies included
+	u32 bytes;
+} Journal_Group;
+
+typedef struct
+{
+	u32 budget;
+	u32 bytes;
+
+	// Groups [group_first, group_first + done) can be undone, the ones after that redone
+	Journal_Group* groups;
+	u32 group_first;
+	u32 group_num;
+	u32 group_max;
+	u32 done;
+	bool recording;
+
+	// Set when undoing or redoing deleted a chip, so whoever holds on to chip circuits can let go
+	bool chip_deleted;
+
+	// Where the ops of a group start, to go through them backwards
+	u32* offsets;
+	u32 offset_max;
+} Journal;
+
+void journal_init(Journal* journal, u32 budget);
+void journal_free(Journal* journal);
+void journal_clear(Journal* journal);
+
+void journal_begin(Journal* journal, Circuit* circ);
+void journal_end(Journal* journal);
+
+Thing* journal_create(Journal* journal, Circuit* circ, u8 type, Point pos);
+void journal_delete(Journal* journal, Circuit* circ, Thing* thing);
+void journal_connect(Journal* journal, Circuit* circ, Node* a, Node* b);
+void journal_disconnect(Journal* journal, Circuit* circ, Node* a, Node* b);
+void journal_toggle_public(Journal* journal, Circuit* circ, Node* node);
+void journal_merge(Journal* journal, Circuit* circ, Circuit* other);
+
+// Returns false when there's nothing to undo or redo
+bool journal_undo(Journal* journal, Circuit* root);
+bool journal_redo(Journal* journal, Circuit* root);
@@ -5,9 +5,34 @@
 #include "cells.h"
 #include "board.h"
 #include "gl_bind.h"
+#include "bench.h"
+#include "suite.h"
+#include "run.h"
+#include "trace.h"
 
-int main()
+int main(int argc, char** argv)
 {
+	// Headless benchmark run, doesn't need a window
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+	{
+		bench_run(argc - 2, argv + 2);
+		return 0;
+	}
+
+	// Reference circuits with their results as JSON, 'game.exe -suite [file.json]'
+	if (argc > 1 && strcmp(argv[1], "-suite") == 0)
+	{
+		suite_run(argc - 2, argv + 2);
+		return 0;
+	}
+
+	// Headless run of a saved circuit, 'game.exe -run file tic'
+	if (argc > 3 && strcmp(argv[1], "-run") == 0)
+	{
+		run_file(argv[2], atoi(argv[3]));
+		return 0;
+	}
+
 	_chdir("..\\..");
 
 	context_open("Console Game", 100, 100, CELL_COLS, CELL_ROWS);
@@ -16,16 +41,32 @@ int main()
 
 	while(context_is_open())
 	{
+		TRACE_BEGIN(frame_begin);
+		TRACE_BEGIN(begin);
 		context_begin_frame();
+		TRACE_END("begin_frame", begin);
 
 		glClearColor(0.1f, 0.1f, 0.1f, 1.f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
+		TRACE_BEGIN(tic_begin);
 		board_tic();
+		TRACE_END("board_tic", tic_begin);
+
+		TRACE_BEGIN(draw_begin);
 		board_draw();
+		TRACE_END("board_draw", draw_begin);
+
+		TRACE_BEGIN(render_begin);
 		cells_render();
+		TRACE_END("cells_render", render_begin);
 
+		TRACE_BEGIN(end_begin);
 		context_end_frame();
+		TRACE_END("end_frame", end_begin);
+		TRACE_END("frame", frame_begin);
 	}
+
+	board_close();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "mapfile.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+Mapped_File* mapped_file_open(const char* path)
+{
+	// Shared for deleting, so the file can be replaced while it's mapped
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+	CloseHandle(handle);
+	if (!mapping)
+		return NULL;
+
+	u8* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (!data)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+
+	Mapped_File* file = malloc(sizeof(Mapped_File));
+	file->data = data;
+	file->size = size.QuadPart;
+	file->refs = 1;
+	file->handle = mapping;
+	return file;
+}
+
+void mapped_file_unmap(Mapped_File* file)
+{
+	UnmapViewOfFile(file->data);
+	CloseHandle(file->handle);
+}
+
+bool mapped_file_replace(const char* from, const char* to)
+{
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Mapped_File* mapped_file_open(const char* path)
+{
+	i32 fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	// The mapping stays valid after the file is closed
+	struct stat info;
+	u8* data = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+		data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	Mapped_File* file = malloc(sizeof(Mapped_File));
+	file->data = data;
+	file->size = info.st_size;
+	file->refs = 1;
+	file->handle = NULL;
+	return file;
+}
+
+void mapped_file_unmap(Mapped_File* file)
+{
+	munmap(file->data, file->size);
+}
+
+// Replacing the directory entry leaves the mapped file alone, truncating it in place wouldn't
+bool mapped_file_replace(const char* from, const char* to)
+{
+	return rename(from, to) == 0;
+}
+#endif
+
+void mapped_file_retain(Mapped_File* file)
+{
+	file->refs++;
+}
+
+void mapped_file_release(Mapped_File* file)
+{
+	assert(file->refs > 0);
+	if (--file->refs > 0)
+		return;
+
+	mapped_file_unmap(file);
+	free(file);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Mapped files
+// A file mapped into memory copy-on-write: its pages are read in when they're first touched, and a
+// page that gets written becomes a private copy, the file itself never changes. Whoever keeps
+// pointers into the data keeps a reference, the file is unmapped when the last one is released.
+// A mapped file can still be replaced (see mapped_file_replace), the mapping keeps the old contents.
+typedef struct Mapped_File
+{
+	u8* data;
+	u64 size;
+	u32 refs;
+	void* handle;
+} Mapped_File;
+
+// Returns NULL if the file can't be opened or is empty
+Mapped_File* mapped_file_open(const char* path);
+void mapped_file_retain(Mapped_File* file);
+void mapped_file_release(Mapped_File* file);
+
+// Renames from to to, over whatever is there, even if it's mapped
+bool mapped_file_replace(const char* from, const char* to);
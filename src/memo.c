@@ -0,0 +1,575 @@
+#include "memo.h"
+#include "circuit.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+u32 bit_index(u64 bits)
+{
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return index;
+}
+#else
+#define bit_index(bits) ((u32)__builtin_ctzll(bits))
+#endif
+
+// Owners of nets while validating, besides units and MEMO_None
+#define NET_Undriven (~0u - 1)
+#define NET_Mixed (~0u - 2)
+
+u32 memo_cache_entries = 0;
+
+void netlist_set_memo(u32 cache_entries)
+{
+	memo_cache_entries = cache_entries;
+}
+
+u64 memo_mask(u32 bit_num)
+{
+	return bit_num >= 64 ? ~0ull : (1ull << bit_num) - 1;
+}
+
+/* CACHE */
+u32 memo_cache_set(Memo_Cache* cache, u64 inputs, u64 state)
+{
+	u64 key = (inputs * 0x9E3779B97F4A7C15ull) ^ state;
+	key *= 0xBF58476D1CE4E5B9ull;
+	return (u32)(key >> 32) & (cache->set_num - 1);
+}
+
+Memo_Entry* memo_cache_find(Memo_Cache* cache, u64 inputs, u64 state)
+{
+	if (!cache->entries)
+		return NULL;
+
+	Memo_Entry* set = cache->entries + memo_cache_set(cache, inputs, state) * MEMO_WAYS;
+	for(u32 w=0; w<MEMO_WAYS; ++w)
+	{
+		if (set[w].used && set[w].inputs == inputs && set[w].state == state)
+		{
+			set[w].used = ++cache->clock;
+			return &set[w];
+		}
+	}
+
+	return NULL;
+}
+
+void memo_cache_insert(Memo_Cache* cache, u64 inputs, u64 state, u64 next)
+{
+	if (cache->set_num == 0)
+		return;
+
+	// Allocated on the first miss, most caches of a big design never see one after warming up anyway
+	if (!cache->entries)
+	{
+		cache->entries = malloc(sizeof(Memo_Entry) * cache->set_num * MEMO_WAYS);
+		mem_zero(cache->entries, sizeof(Memo_Entry) * cache->set_num * MEMO_WAYS);
+	}
+
+	// Unused entries have the oldest stamp
+	Memo_Entry* set = cache->entries + memo_cache_set(cache, inputs, state) * MEMO_WAYS;
+	Memo_Entry* victim = &set[0];
+	for(u32 w=1; w<MEMO_WAYS; ++w)
+	{
+		if (set[w].used < victim->used)
+			victim = &set[w];
+	}
+
+	if (victim->used)
+		cache->evictions++;
+
+	victim->inputs = inputs;
+	victim->state = state;
+	victim->next = next;
+	victim->used = ++cache->clock;
+}
+
+/* COMPILING */
+u32 memo_gate_count(Circuit* circ)
+{
+	u32 gate_num = 0;
+	THINGS_FOREACH(circ, THING_Inverter | THING_Delay | THING_Chip)
+	{
+		if (it->type == THING_Chip)
+			gate_num += memo_gate_count(chip_circuit(circ, (Chip*)it));
+		else
+			gate_num++;
+	}
+
+	return gate_num;
+}
+
+// Chips small enough to become a unit, whether it really can is decided by memo_validate
+bool memo_chip_candidate(Circuit* circ)
+{
+	if (memo_cache_entries == 0)
+		return false;
+
+	u32 gate_num = memo_gate_count(circ);
+	return gate_num > 0 && gate_num <= MEMO_MAX_GATES;
+}
+
+// A unit has to be a function of its inputs and state, so every net read inside of it has to be
+// driven entirely from inside, or entirely from outside. Units that aren't get evaluated gate by gate.
+// Runs on the collected gates, where the gates of a unit are still next to each other
+void memo_validate(Netlist* netlist)
+{
+	u32 gate_num = netlist->gate_num;
+	u32 net_num = netlist->net_num;
+	u32 memo_num = netlist->memo_num;
+	u32* gate_memo = netlist->gate_memo;
+	if (memo_num == 0)
+		return;
+
+	u32* owner = malloc(sizeof(u32) * net_num);
+	for(u32 n=0; n<net_num; ++n)
+		owner[n] = NET_Undriven;
+
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u32 out = netlist->gate_output[g];
+		if (owner[out] == NET_Undriven)
+			owner[out] = gate_memo[g];
+		else if (owner[out] != gate_memo[g])
+			owner[out] = NET_Mixed;
+	}
+
+	// Nets driven by the unit currently being checked
+	u32* driven_by = malloc(sizeof(u32) * net_num);
+	memset(driven_by, 0xFF, sizeof(u32) * net_num);
+
+	bool* invalid = malloc(memo_num);
+	memset(invalid, false, memo_num);
+
+	u32 first = 0;
+	while(first < gate_num)
+	{
+		u32 unit = gate_memo[first];
+		u32 last = first + 1;
+		while(last < gate_num && gate_memo[last] == unit)
+			last++;
+
+		if (unit != MEMO_None)
+		{
+			for(u32 g=first; g<last; ++g)
+				driven_by[netlist->gate_output[g]] = unit;
+
+			for(u32 g=first; g<last; ++g)
+			{
+				u32 in = netlist->gate_input[g];
+				if (driven_by[in] == unit && owner[in] != unit)
+					invalid[unit] = true;
+			}
+		}
+
+		first = last;
+	}
+
+	memo_drop(netlist, invalid);
+	free(invalid);
+	free(driven_by);
+	free(owner);
+}
+
+// Turns the units set in dropped back into plain gates and renumbers the rest.
+// Returns whether any were dropped
+bool memo_drop(Netlist* netlist, bool* dropped)
+{
+	u32 memo_num = netlist->memo_num;
+	u32* gate_memo = netlist->gate_memo;
+
+	u32* remap = malloc(sizeof(u32) * (memo_num + 1));
+	netlist->memo_num = 0;
+	for(u32 u=0; u<memo_num; ++u)
+		remap[u] = dropped[u] ? MEMO_None : netlist->memo_num++;
+
+	for(u32 g=0; g<netlist->gate_num; ++g)
+	{
+		if (gate_memo[g] != MEMO_None)
+			gate_memo[g] = remap[gate_memo[g]];
+	}
+
+	free(remap);
+	return netlist->memo_num != memo_num;
+}
+
+// Orders the gates of a unit, [first, last) in collected order. Inverters are sorted like netlist_levelize
+// does, delays go last. Units are at most 64 gates, so just keep sweeping for inverters that are ready.
+// Returns the number of gates written to order
+u32 memo_order_unit(Netlist* netlist, bool* is_inverter, u32 first, u32 last, u32* order)
+{
+	u32 order_num = 0;
+	u32 inverter_num = 0;
+	for(u32 g=first; g<last; ++g)
+		inverter_num += is_inverter[g];
+
+	u64 placed = 0;
+	while(order_num < inverter_num)
+	{
+		bool progress = false;
+		for(u32 g=first; g<last; ++g)
+		{
+			if (!is_inverter[g] || (placed & (1ull << (g - first))))
+				continue;
+
+			bool ready = true;
+			for(u32 h=first; h<last && ready; ++h)
+			{
+				if (is_inverter[h] && !(placed & (1ull << (h - first))) && netlist->gate_output[h] == netlist->gate_input[g])
+					ready = false;
+			}
+
+			if (ready)
+			{
+				order[order_num++] = g;
+				placed |= 1ull << (g - first);
+				progress = true;
+			}
+		}
+
+		// Stuck on a cycle, force the first inverter left
+		if (!progress)
+		{
+			u32 g = first;
+			while(!is_inverter[g] || (placed & (1ull << (g - first))))
+				g++;
+
+			order[order_num++] = g;
+			placed |= 1ull << (g - first);
+		}
+	}
+
+	for(u32 g=first; g<last; ++g)
+	{
+		if (!is_inverter[g])
+			order[order_num++] = g;
+	}
+
+	return order_num;
+}
+
+// Mixes a value into a shape hash, FNV-1a style
+u64 memo_shape_mix(u64 shape, u32 value)
+{
+	return (shape ^ value) * 0x100000001B3ull;
+}
+
+// Builds the units from the final gate order: their inputs, shapes, caches and packed states
+void memo_build(Netlist* netlist)
+{
+	u32 gate_num = netlist->gate_num;
+	u32 net_num = netlist->net_num;
+	u32* gate_memo = netlist->gate_memo;
+
+	netlist->island_memo_start = malloc(sizeof(u32) * (netlist->island_num + 1));
+	mem_zero(netlist->island_memo_start, sizeof(u32) * (netlist->island_num + 1));
+	if (netlist->memo_num == 0)
+		return;
+
+	netlist->memos = malloc(sizeof(Memo_Unit) * netlist->memo_num);
+	netlist->memo_inputs = malloc(sizeof(u32) * (gate_num + 1));
+	mem_zero(netlist->memos, sizeof(Memo_Unit) * netlist->memo_num);
+
+	// Nets are stamped with the unit that drives them and the unit that numbered them, so nothing needs clearing
+	u32* net_drivers = malloc(sizeof(u32) * net_num);
+	u32* net_inside = malloc(sizeof(u32) * net_num);
+	u32* net_seen = malloc(sizeof(u32) * net_num);
+	u32* net_local = malloc(sizeof(u32) * net_num);
+	mem_zero(net_drivers, sizeof(u32) * net_num);
+	memset(net_inside, 0xFF, sizeof(u32) * net_num);
+	memset(net_seen, 0xFF, sizeof(u32) * net_num);
+	for(u32 g=0; g<gate_num; ++g)
+		net_drivers[netlist->gate_output[g]]++;
+
+	u32 memo_index = 0;
+	u32 input_index = 0;
+	u32 island = 0;
+	u32 island_first_cache = 0;
+	u32 cache_max = 0;
+
+	u32 g = 0;
+	while(g < gate_num)
+	{
+		if (gate_memo[g] == MEMO_None)
+		{
+			g++;
+			continue;
+		}
+
+		u32 first = g;
+		while(g < gate_num && gate_memo[g] == gate_memo[first])
+			g++;
+
+		Memo_Unit* unit = &netlist->memos[memo_index];
+		unit->gate_start = first;
+		unit->gate_end = g;
+		unit->delay_start = g;
+		for(u32 h=first; h<g; ++h)
+		{
+			Thing* thing = thing_get(netlist->gate_circ[h], netlist->gate_id[h]);
+			if (thing->type == THING_Delay)
+			{
+				unit->delay_start = h;
+				break;
+			}
+		}
+
+		while(first >= netlist->island_start[island + 1])
+		{
+			island++;
+			island_first_cache = netlist->memo_cache_num;
+		}
+
+		netlist->island_memo_start[island + 1]++;
+
+		// Nets driven inside get a local number in order of appearance, inputs get their bit,
+		// so instances wired up the same way end up with the same shape
+		for(u32 h=first; h<g; ++h)
+			net_inside[netlist->gate_output[h]] = memo_index;
+
+		u64 shape = 0xCBF29CE484222325ull;
+		shape = memo_shape_mix(shape, g - first);
+		shape = memo_shape_mix(shape, unit->delay_start - first);
+
+		u32 local_num = 0;
+		unit->input_start = input_index;
+		for(u32 h=first; h<g; ++h)
+		{
+			u32 in = netlist->gate_input[h];
+			u32 out = netlist->gate_output[h];
+
+			if (net_drivers[in] == 0)
+			{
+				shape = memo_shape_mix(shape, 0);
+			}
+			else if (net_inside[in] == memo_index)
+			{
+				if (net_seen[in] != memo_index)
+				{
+					net_seen[in] = memo_index;
+					net_local[in] = local_num++;
+				}
+
+				shape = memo_shape_mix(shape, 1);
+				shape = memo_shape_mix(shape, net_local[in]);
+			}
+			else
+			{
+				if (net_seen[in] != memo_index)
+				{
+					net_seen[in] = memo_index;
+					net_local[in] = unit->input_num++;
+					netlist->memo_inputs[input_index++] = in;
+				}
+
+				shape = memo_shape_mix(shape, 2);
+				shape = memo_shape_mix(shape, net_local[in]);
+			}
+
+			if (net_seen[out] != memo_index)
+			{
+				net_seen[out] = memo_index;
+				net_local[out] = local_num++;
+			}
+
+			shape = memo_shape_mix(shape, net_local[out]);
+
+			if (netlist->gate_state[h])
+				unit->state |= 1ull << (h - first);
+		}
+
+		unit->next = unit->state;
+
+		// Share a cache with the units of this island that have the same shape
+		unit->cache = MEMO_None;
+		for(u32 c=island_first_cache; c<netlist->memo_cache_num; ++c)
+		{
+			if (netlist->memo_caches[c].shape == shape)
+			{
+				unit->cache = c;
+				break;
+			}
+		}
+
+		if (unit->cache == MEMO_None)
+		{
+			if (netlist->memo_cache_num >= cache_max)
+			{
+				cache_max = cache_max ? cache_max * 2 : 16;
+				netlist->memo_caches = realloc(netlist->memo_caches, sizeof(Memo_Cache) * cache_max);
+			}
+
+			unit->cache = netlist->memo_cache_num++;
+			Memo_Cache* cache = &netlist->memo_caches[unit->cache];
+			zero_t(*cache);
+			cache->shape = shape;
+			cache->island = island;
+		}
+
+		memo_index++;
+	}
+
+	assert(memo_index == netlist->memo_num);
+	for(u32 i=0; i<netlist->island_num; ++i)
+		netlist->island_memo_start[i + 1] += netlist->island_memo_start[i];
+
+	// Every cache gets the same share of the budget, in whole sets, a power of two of them
+	u32 share_sets = memo_cache_entries / MEMO_WAYS / netlist->memo_cache_num;
+	u32 set_num = 0;
+	if (share_sets > 0)
+	{
+		set_num = 1;
+		while(set_num * 2 <= share_sets)
+			set_num *= 2;
+	}
+
+	for(u32 c=0; c<netlist->memo_cache_num; ++c)
+		netlist->memo_caches[c].set_num = set_num;
+
+	free(net_local);
+	free(net_seen);
+	free(net_inside);
+	free(net_drivers);
+}
+
+void memo_free(Netlist* netlist)
+{
+	for(u32 c=0; c<netlist->memo_cache_num; ++c)
+	{
+		if (netlist->memo_caches[c].entries)
+			free(netlist->memo_caches[c].entries);
+	}
+
+	if (netlist->memo_caches)
+		free(netlist->memo_caches);
+	if (netlist->memos)
+		free(netlist->memos);
+	if (netlist->island_memo_start)
+		free(netlist->island_memo_start);
+	if (netlist->memo_inputs)
+		free(netlist->memo_inputs);
+	if (netlist->gate_memo)
+		free(netlist->gate_memo);
+}
+
+Memo_Stats netlist_memo_stats(Netlist* netlist)
+{
+	Memo_Stats stats;
+	zero_t(stats);
+
+	stats.unit_num = netlist->memo_num;
+	stats.cache_num = netlist->memo_cache_num;
+	for(u32 c=0; c<netlist->memo_cache_num; ++c)
+	{
+		Memo_Cache* cache = &netlist->memo_caches[c];
+		stats.entry_num += cache->set_num * MEMO_WAYS;
+		stats.hits += cache->hits;
+		stats.misses += cache->misses;
+		stats.skips += cache->skips;
+		stats.evictions += cache->evictions;
+	}
+
+	return stats;
+}
+
+/* TICKING */
+// Flips the gates of a unit whose bit is set, like netlist_tic_islands would
+void memo_flip(Netlist* netlist, Memo_Unit* unit, u64 flips, u64* hash)
+{
+	while(flips)
+	{
+		u32 g = unit->gate_start + bit_index(flips);
+		flips &= flips - 1;
+
+		u8 state = !netlist->gate_state[g];
+		netlist->gate_state[g] = state;
+		netlist->net_drive[netlist->gate_output[g]] += state ? 1 : -1;
+		*hash ^= netlist->gate_key[g];
+	}
+}
+
+void memo_eval(Netlist* netlist, Memo_Unit* unit, u64* hash)
+{
+	u32* net_drive = netlist->net_drive;
+	u64 inputs = 0;
+	for(u32 i=0; i<unit->input_num; ++i)
+		inputs |= (u64)(net_drive[netlist->memo_inputs[unit->input_start + i]] != 0) << i;
+
+	// Nothing changed last tic and the inputs are the same, so nothing changes now either
+	Memo_Cache* cache = &netlist->memo_caches[unit->cache];
+	if (unit->quiet && inputs == unit->inputs)
+	{
+		cache->skips++;
+		return;
+	}
+
+	u64 inverter_mask = memo_mask(unit->delay_start - unit->gate_start);
+	u64 next = 0;
+
+	Memo_Entry* entry = memo_cache_find(cache, inputs, unit->state);
+	if (entry)
+	{
+		cache->hits++;
+		next = entry->next;
+		memo_flip(netlist, unit, (unit->state ^ next) & inverter_mask, hash);
+	}
+	else
+	{
+		// Evaluate it gate by gate, the delays only read their input, they latch with the rest
+		cache->misses++;
+		for(u32 g=unit->gate_start; g<unit->delay_start; ++g)
+		{
+			u8 state = net_drive[netlist->gate_input[g]] == 0;
+			if (state != netlist->gate_state[g])
+			{
+				netlist->gate_state[g] = state;
+				net_drive[netlist->gate_output[g]] += state ? 1 : -1;
+				*hash ^= netlist->gate_key[g];
+			}
+
+			next |= (u64)state << (g - unit->gate_start);
+		}
+
+		for(u32 g=unit->delay_start; g<unit->gate_end; ++g)
+			next |= (u64)(net_drive[netlist->gate_input[g]] != 0) << (g - unit->gate_start);
+
+		memo_cache_insert(cache, inputs, unit->state, next);
+	}
+
+	unit->quiet = next == unit->state;
+	unit->inputs = inputs;
+	unit->state = (unit->state & ~inverter_mask) | (next & inverter_mask);
+	unit->next = next;
+}
+
+// A gate was set outside of a tic, the unit it's in (if any) has to start from its new state
+void memo_set_gate(Netlist* netlist, u32 gate, u8 state)
+{
+	// Units are in gate order
+	u32 low = 0;
+	u32 high = netlist->memo_num;
+	while(low < high)
+	{
+		u32 mid = (low + high) / 2;
+		if (netlist->memos[mid].gate_end <= gate)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == netlist->memo_num || netlist->memos[low].gate_start > gate)
+		return;
+
+	Memo_Unit* unit = &netlist->memos[low];
+	u64 bit = 1ull << (gate - unit->gate_start);
+	unit->state = state ? unit->state | bit : unit->state & ~bit;
+	unit->next = state ? unit->next | bit : unit->next & ~bit;
+	unit->quiet = false;
+}
+
+void memo_latch(Netlist* netlist, Memo_Unit* unit, u64* hash)
+{
+	memo_flip(netlist, unit, unit->state ^ unit->next, hash);
+	unit->state = unit->next;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// Memoized chips
+// Small chip instances can be evaluated as a whole instead of gate by gate. A unit is a chip instance
+// whose gates only depend on its inputs (nets driven from outside of it) and on its own gate states,
+// so a tic of it is a function (inputs, state) -> next state, which is kept in a transition cache.
+// Instances wired up the same way (the same shape) share a cache, so every bit-slice of an ALU
+// feeds the same table. Caches are per island, islands can be ticked on different threads.
+// The entries are a budget for the whole netlist, split evenly between its caches. A cache whose
+// share is less than a set doesn't keep any, its units are evaluated gate by gate.
+// A unit is levelized as a single gate, so one on a path that leaves it and comes back in (through
+// gates outside, or through another unit) would see last tic's values where its gates alone wouldn't.
+// Those are evaluated gate by gate instead, see netlist_levelize.
+#define MEMO_MAX_GATES 64
+#define MEMO_WAYS 4
+#define MEMO_None (~0u)
+
+typedef struct Circuit Circuit;
+typedef struct Netlist Netlist;
+
+typedef struct
+{
+	u32 gate_start;
+	u32 delay_start;
+	u32 gate_end;
+
+	u32 input_start;
+	u32 input_num;
+	u32 cache;
+
+	// Packed gate states, bit b is gate gate_start + b. Delays wait in next until they latch
+	u64 state;
+	u64 next;
+
+	// Inputs of the last tic, and whether that tic didn't change anything
+	u64 inputs;
+	bool quiet;
+} Memo_Unit;
+
+typedef struct
+{
+	u64 inputs;
+	u64 state;
+	u64 next;
+	u64 used;
+} Memo_Entry;
+
+// Set associative, the least recently used entry of a set gets evicted
+typedef struct
+{
+	u64 shape;
+	u32 island;
+
+	// Allocated on the first miss, set_num is 0 if the budget had nothing left for it
+	Memo_Entry* entries;
+	u32 set_num;
+	u64 clock;
+
+	// Skips are units that were quiet with the same inputs, no lookup needed
+	u64 hits;
+	u64 misses;
+	u64 skips;
+	u64 evictions;
+} Memo_Cache;
+
+typedef struct
+{
+	u32 unit_num;
+	u32 cache_num;
+	u32 entry_num;
+	u64 hits;
+	u64 misses;
+	u64 skips;
+	u64 evictions;
+} Memo_Stats;
+
+// Entries of all transition caches of a netlist together, 0 turns memoization off. Used when a
+// netlist is next compiled
+void netlist_set_memo(u32 cache_entries);
+Memo_Stats netlist_memo_stats(Netlist* netlist);
+
+// Compiling, see netlist_compile
+bool memo_chip_candidate(Circuit* circ);
+void memo_validate(Netlist* netlist);
+bool memo_drop(Netlist* netlist, bool* dropped);
+u32 memo_order_unit(Netlist* netlist, bool* is_inverter, u32 first, u32 last, u32* order);
+void memo_build(Netlist* netlist);
+void memo_free(Netlist* netlist);
+
+// Ticking, eval runs at the unit's place in the level order, latch after the delays of its island
+void memo_eval(Netlist* netlist, Memo_Unit* unit, u64* hash);
+void memo_latch(Netlist* netlist, Memo_Unit* unit, u64* hash);
+
+// Setting gates outside of a tic, see netlist_set_gate
+void memo_set_gate(Netlist* netlist, u32 gate, u8 state);
@@ -0,0 +1,426 @@
+#include "net.h"
+#include "circuit.h"
+#include "netlist.h"
+
+Net_Table* net_table(Circuit* circ)
+{
+	return &circuit_root(circ)->nets;
+}
+
+void net_table_free(Net_Table* table)
+{
+	for(u32 i=1; i<table->net_num; ++i)
+	{
+		if (table->nets[i].members)
+			free(table->nets[i].members);
+	}
+
+	if (table->nets)
+		free(table->nets);
+	if (table->work)
+		free(table->work);
+
+	zero_t(*table);
+}
+
+Net_Id net_alloc(Net_Table* table)
+{
+	u32 index = 0;
+	if (table->free_head)
+	{
+		index = table->free_head;
+		table->free_head = table->nets[index].next_free;
+	}
+	else
+	{
+		if (table->net_num == 0)
+			table->net_num = 1;
+
+		if (table->net_num >= table->net_max)
+		{
+			u32 new_max = table->net_max == 0 ? 64 : (table->net_max << 1);
+			Net* prev_nets = table->nets;
+
+			table->nets = malloc(sizeof(Net) * new_max);
+			mem_zero(table->nets, sizeof(Net) * new_max);
+
+			if (prev_nets)
+			{
+				memcpy(table->nets, prev_nets, sizeof(Net) * table->net_max);
+				free(prev_nets);
+			}
+
+			table->net_max = new_max;
+		}
+
+		index = table->net_num++;
+	}
+
+	// Member lists are kept around when freed, so reuse the buffer
+	Net* net = &table->nets[index];
+	net->generation++;
+	net->valid = true;
+	net->resolved = false;
+	net->state = false;
+	net->drivers = 0;
+	net->member_num = 0;
+	net->next_free = 0;
+
+	Net_Id id;
+	id.generation = net->generation;
+	id.index = index;
+	return id;
+}
+
+void net_free(Net_Table* table, Net_Id id)
+{
+	Net* net = &table->nets[id.index];
+	net->valid = false;
+	net->member_num = 0;
+	net->next_free = table->free_head;
+	table->free_head = id.index;
+}
+
+Net* net_get(Circuit* circ, Net_Id id)
+{
+	if (id.generation == 0)
+		return NULL;
+
+	Net_Table* table = net_table(circ);
+	if (id.index >= table->net_num)
+		return NULL;
+
+	Net* net = &table->nets[id.index];
+	if (!net->valid || net->generation != id.generation)
+		return NULL;
+
+	return net;
+}
+
+Net_Id* node_net_id(Circuit* circ, Node* node)
+{
+	return &circ->thing_nets[thing_index(circ, (Thing*)node)];
+}
+
+bool node_is_driven(Circuit* circ, Node* node)
+{
+	return thing_flag_get(circ, (Thing*)node, FLAG_Driven);
+}
+
+void node_update_driven(Circuit* circ, Node* node)
+{
+	Thing* src = thing_find(circ, point_add(node->pos, point(-1, 0)), THING_All);
+	thing_flag_set(circ, (Thing*)node, FLAG_Driven, src && thing_powered(circ, src));
+}
+
+void circuit_update_driven(Circuit* circ)
+{
+	THINGS_FOREACH(circ, THING_Node)
+	{
+		thing_flag_set(circ, it, FLAG_Driven, false);
+	}
+
+	// Only the nodes right of a powered source can be driven
+	THINGS_FOREACH(circ, THING_Inverter | THING_Delay | THING_Chip)
+	{
+		if (it->type == THING_Chip)
+		{
+			circuit_update_driven(chip_circuit(circ, (Chip*)it));
+			continue;
+		}
+
+		if (!thing_powered(circ, it))
+			continue;
+
+		Node* target = node_find(circ, point_add(it->pos, point(1, 0)));
+		if (target)
+			node_update_driven(circ, target);
+	}
+}
+
+void net_add_member(Circuit* circ, Net* net, Net_Id id, Node* node)
+{
+	if (net->member_num >= net->member_max)
+	{
+		u32 new_max = net->member_max == 0 ? 8 : (net->member_max << 1);
+		Net_Member* prev_members = net->members;
+
+		net->members = malloc(sizeof(Net_Member) * new_max);
+		if (prev_members)
+		{
+			memcpy(net->members, prev_members, sizeof(Net_Member) * net->member_num);
+			free(prev_members);
+		}
+
+		net->member_max = new_max;
+	}
+
+	Net_Member* member = &net->members[net->member_num++];
+	member->circ = circ;
+	member->id = thing_id(circ, (Thing*)node);
+
+	*node_net_id(circ, node) = id;
+	if (node_is_driven(circ, node))
+		net->drivers++;
+}
+
+void net_break(Circuit* circ, Net_Id id)
+{
+	Net* net = net_get(circ, id);
+	if (!net)
+		return;
+
+	for(u32 i=0; i<net->member_num; ++i)
+	{
+		Net_Member* member = &net->members[i];
+		Node* node = node_get(member->circ, member->id);
+		if (node)
+			zero_t(*node_net_id(member->circ, node));
+	}
+
+	net_free(net_table(circ), id);
+}
+
+void node_break_net(Circuit* circ, Node* node)
+{
+	circuit_invalidate_netlist(circ);
+	Net_Id* id = node_net_id(circ, node);
+	net_break(circ, *id);
+	zero_t(*id);
+}
+
+// Epochs wrapped around, old stamps could look like new ones
+void circuit_clear_epochs(Circuit* circ)
+{
+	mem_zero(circ->thing_epochs, sizeof(u32) * circ->thing_max);
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		circuit_clear_epochs(chip_circuit(circ, (Chip*)it));
+	}
+}
+
+// Marks a node visited and pushes it on the work stack, if it wasn't already
+void net_work_push(Net_Table* table, Circuit* circ, Node* node)
+{
+	u32 index = thing_index(circ, (Thing*)node);
+	if (circ->thing_epochs[index] == table->epoch)
+		return;
+
+	circ->thing_epochs[index] = table->epoch;
+
+	if (table->work_num >= table->work_max)
+	{
+		u32 new_max = table->work_max == 0 ? 64 : (table->work_max << 1);
+		Net_Work* prev_work = table->work;
+
+		table->work = malloc(sizeof(Net_Work) * new_max);
+		if (prev_work)
+		{
+			memcpy(table->work, prev_work, sizeof(Net_Work) * table->work_num);
+			free(prev_work);
+		}
+
+		table->work_max = new_max;
+	}
+
+	Net_Work* work = &table->work[table->work_num++];
+	work->circ = circ;
+	work->node = node;
+}
+
+// Collect every node in a batch into a net, depth first. Nothing gets created while collecting,
+// so the nodes on the work stack stay where they are
+void node_batch_collect(Circuit* circ, Node* node, Net_Id id)
+{
+	Net_Table* table = net_table(circ);
+	Net* net = net_get(circ, id);
+
+	if (++table->epoch == 0)
+	{
+		circuit_clear_epochs(circuit_root(circ));
+		table->epoch = 1;
+	}
+
+	table->work_num = 0;
+	net_work_push(table, circ, node);
+
+	while(table->work_num > 0)
+	{
+		Net_Work work = table->work[--table->work_num];
+		circ = work.circ;
+		node = work.node;
+
+		// This node was part of an old net, which is now part of this one
+		Net_Id prev_id = *node_net_id(circ, node);
+		if (!net_id_eq(prev_id, id))
+			net_break(circ, prev_id);
+
+		net_add_member(circ, net, id, node);
+		STATS_ADD(net_collect_nodes, 1);
+
+		for(u32 i=0; i<4; ++i)
+		{
+			Node* other = node_get(circ, node->connections[i]);
+			if (other)
+				net_work_push(table, circ, other);
+		}
+
+		// Follow links
+		if (node->link_type != LINK_None)
+		{
+			Circuit* link_circ = NULL;
+			Thing_Id link_id = node->link_node;
+
+			// Get which circuit to follow
+			if (node->link_type == LINK_Chip)
+			{
+				Chip* chip = chip_get(circ, node->link_chip);
+				if (chip)
+					link_circ = chip_circuit(circ, chip);
+			}
+			else if (circ->parent)
+			{
+				// The layout of a chip is shared between its instances, so public nodes find their
+				// link node through the chip this instance belongs to
+				Chip* chip = chip_get(circ->parent, circ->parent_chip);
+				Thing_Id node_id = thing_id(circ, (Thing*)node);
+				for(u32 i=0; chip && i<MAX_PUBLIC_NODES; ++i)
+				{
+					if (!id_eq(circ->public_nodes[i], node_id))
+						continue;
+
+					link_circ = circ->parent;
+					link_id = chip->link_nodes[i];
+					break;
+				}
+			}
+
+			if (link_circ)
+			{
+				Node* other = node_get(link_circ, link_id);
+				if (other)
+					net_work_push(table, link_circ, other);
+
+				if (node->link_type == LINK_Chip)
+					STATS_ADD(link_chip_count, 1);
+				else
+					STATS_ADD(link_public_count, 1);
+			}
+		}
+	}
+
+	STATS_ADD(net_collect_count, 1);
+	STATS_MAX(net_collect_longest, net->member_num);
+}
+
+Net* node_net(Circuit* circ, Node* node)
+{
+	Net* net = net_get(circ, *node_net_id(circ, node));
+	if (net)
+		return net;
+
+	// No valid net, extract a new one from the batch this node is in
+	Net_Id id = net_alloc(net_table(circ));
+	node_batch_collect(circ, node, id);
+
+	return net_get(circ, id);
+}
+
+void node_union_nets(Circuit* circ, Node* a, Node* b)
+{
+	// Extracting b's net might grow the table, so fetch the nets again afterwards
+	node_net(circ, a);
+	node_net(circ, b);
+
+	Net_Id a_id = *node_net_id(circ, a);
+	Net_Id b_id = *node_net_id(circ, b);
+	if (net_id_eq(a_id, b_id))
+		return;
+
+	circuit_invalidate_netlist(circ);
+	Net* a_net = net_get(circ, a_id);
+	Net* b_net = net_get(circ, b_id);
+
+	// Move the members of the smaller net into the bigger one
+	if (a_net->member_num < b_net->member_num)
+	{
+		Net* tmp_net = a_net; a_net = b_net; b_net = tmp_net;
+		Net_Id tmp_id = a_id; a_id = b_id; b_id = tmp_id;
+	}
+
+	for(u32 i=0; i<b_net->member_num; ++i)
+	{
+		Net_Member* member = &b_net->members[i];
+		Node* node = node_get(member->circ, member->id);
+		if (!node)
+			continue;
+
+		// Drivers are re-counted when added
+		net_add_member(member->circ, a_net, a_id, node);
+	}
+
+	// The states might differ, so re-apply it to all members
+	a_net->resolved = false;
+	net_free(net_table(circ), b_id);
+}
+
+void net_resolve(Circuit* circ, Net* net)
+{
+	bool active = net->drivers > 0;
+	if (net->resolved && net->state == active)
+		return;
+
+	net->state = active;
+	net->resolved = true;
+	STATS_ADD(net_resolve_nodes, net->member_num);
+
+	for(u32 i=0; i<net->member_num; ++i)
+	{
+		Net_Member* member = &net->members[i];
+		Node* node = node_get(member->circ, member->id);
+		if (!node || thing_active(member->circ, node) == active)
+			continue;
+
+		// If the state will change, make output things dirty!
+		thing_set_active(member->circ, node, active);
+		thing_dirty_at(member->circ, point_add(node->pos, point(1, 0)));
+	}
+}
+
+void net_set_source_powered(Circuit* circ, Thing* source, bool powered)
+{
+	if (thing_powered(circ, source) == powered)
+		return;
+
+	thing_set_powered(circ, source, powered);
+
+	Node* target = node_find(circ, point_add(source->pos, point(1, 0)));
+	if (!target)
+		return;
+
+	thing_flag_set(circ, (Thing*)target, FLAG_Driven, powered);
+
+	// If the target doesn't have a net, the drivers will be counted when it's extracted
+	Net* net = net_get(circ, *node_net_id(circ, target));
+	if (!net)
+		return;
+
+	if (powered)
+		net->drivers++;
+	else
+		net->drivers--;
+}
+
+void circuit_forget_nets(Circuit* circ)
+{
+	if (circ->thing_nets)
+		mem_zero(circ->thing_nets, sizeof(Net_Id) * circ->thing_max);
+}
+
+void circuit_break_nets(Circuit* circ)
+{
+	THINGS_FOREACH(circ, THING_Node)
+	{
+		node_break_net(circ, (Node*)it);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "thing.h"
+
+// Nets
+// A net is a connected batch of nodes, including nodes linked across chip boundaries.
+// Nets are owned by the root circuit and keep track of how many powered sources (things to
+// the left of a node) are feeding them, so resolving the power of a net is O(1).
+// Connecting nodes unions their nets, disconnecting or deleting breaks the net, and it gets
+// rebuilt by the next node that asks for it.
+typedef struct
+{
+	Circuit* circ;
+	Thing_Id id;
+} Net_Member;
+
+typedef struct
+{
+	u32 generation;
+	bool valid;
+
+	// State is only applied to the member nodes once resolved
+	bool resolved;
+	bool state;
+	u32 drivers;
+
+	Net_Member* members;
+	u32 member_num;
+	u32 member_max;
+
+	u32 next_free;
+} Net;
+
+// A node waiting to be visited while collecting a batch
+typedef struct
+{
+	Circuit* circ;
+	Node* node;
+} Net_Work;
+
+typedef struct
+{
+	// Nets are 1-indexed, net 0 is never used
+	Net* nets;
+	u32 net_num;
+	u32 net_max;
+	u32 free_head;
+
+	// Every batch collection gets a new epoch, nodes are visited once they carry it in thing_epochs.
+	// The work stack is kept around between collections
+	u32 epoch;
+	Net_Work* work;
+	u32 work_num;
+	u32 work_max;
+} Net_Table;
+
+void net_table_free(Net_Table* table);
+
+Net* net_get(Circuit* circ, Net_Id id);
+// The id of the net a node is in, which is kept per circuit instance
+Net_Id* node_net_id(Circuit* circ, Node* node);
+Net* node_net(Circuit* circ, Node* node);
+void node_break_net(Circuit* circ, Node* node);
+void node_union_nets(Circuit* circ, Node* a, Node* b);
+void net_resolve(Circuit* circ, Net* net);
+
+// Sets the powered state of a source (inverter, delay), updating the driver count of the net it feeds
+void net_set_source_powered(Circuit* circ, Thing* source, bool powered);
+
+// Whether a node is fed by a powered source, from FLAG_Driven. Nodes keep it up to date as long as
+// their sources are powered through net_set_source_powered, update is for when flags come from
+// somewhere else (merges, loading)
+bool node_is_driven(Circuit* circ, Node* node);
+void node_update_driven(Circuit* circ, Node* node);
+// Same for every node of a circuit and of the chips in it
+void circuit_update_driven(Circuit* circ);
+
+// Forget about all nets in a circuit, used when the nodes come from somewhere else (copies, loading)
+void circuit_forget_nets(Circuit* circ);
+// Break all nets in a circuit, used when the layout changed in bulk (merges)
+void circuit_break_nets(Circuit* circ);
@@ -0,0 +1,903 @@
+#include "netlist.h"
+#include "circuit.h"
+#include "thread.h"
+#include "trace.h"
+
+// Connected gates are batched into islands of at least this many gates
+#define NETLIST_ISLAND_GATES 1024
+
+Thread_Pool* netlist_pool = NULL;
+
+void netlist_free(Netlist* netlist)
+{
+	if (netlist->net_drive)
+		free(netlist->net_drive);
+	if (netlist->gate_input)
+		free(netlist->gate_input);
+	if (netlist->gate_output)
+		free(netlist->gate_output);
+	if (netlist->gate_state)
+		free(netlist->gate_state);
+	if (netlist->gate_circ)
+		free(netlist->gate_circ);
+	if (netlist->gate_id)
+		free(netlist->gate_id);
+	if (netlist->island_start)
+		free(netlist->island_start);
+	if (netlist->island_delay_start)
+		free(netlist->island_delay_start);
+	if (netlist->gate_key)
+		free(netlist->gate_key);
+	if (netlist->island_hash)
+		free(netlist->island_hash);
+
+	memo_free(netlist);
+	zero_t(*netlist);
+}
+
+void circuit_invalidate_netlist(Circuit* circ)
+{
+	circuit_root(circ)->netlist.valid = false;
+}
+
+// Makes sure every node in the hierarchy has an up-to-date net, and counts the gates
+u32 netlist_prepare(Circuit* circ)
+{
+	u32 gate_num = 0;
+	THINGS_FOREACH(circ, THING_All)
+	{
+		switch(it->type)
+		{
+			case THING_Node: node_net(circ, (Node*)it); break;
+			case THING_Inverter:
+			case THING_Delay: gate_num++; break;
+			case THING_Chip: gate_num += netlist_prepare(chip_circuit(circ, (Chip*)it)); break;
+		}
+	}
+
+	return gate_num;
+}
+
+// Collects all gates of a circuit (and its chips), resolving which nets they read and drive.
+// Gates of a chip that's a candidate memo unit all get that unit, gates of one unit end up next to each other
+void netlist_collect(Netlist* netlist, Circuit* circ, u32* gate_index, u32 unit)
+{
+	// Maps thing index -> gate index + 1, so gates can find gates next to them
+	u32* gate_of = malloc(sizeof(u32) * (circ->thing_num + 1));
+	mem_zero(gate_of, sizeof(u32) * (circ->thing_num + 1));
+
+	u32 first = *gate_index;
+	THINGS_FOREACH(circ, THING_Inverter | THING_Delay)
+	{
+		u32 g = (*gate_index)++;
+		netlist->gate_circ[g] = circ;
+		netlist->gate_id[g] = thing_id(circ, it);
+		netlist->gate_state[g] = thing_active(circ, it);
+		netlist->gate_memo[g] = unit;
+
+		gate_of[it->index] = g + 1;
+	}
+
+	for(u32 g=first; g<*gate_index; ++g)
+	{
+		Thing* thing = thing_get(circ, netlist->gate_id[g]);
+
+		// Output, the net of the node to the right, otherwise our private net
+		Thing* dst = thing_find(circ, point_add(thing->pos, point(1, 0)), THING_All);
+		if (dst && dst->type == THING_Node)
+			netlist->gate_output[g] = node_net_id(circ, (Node*)dst)->index;
+		else
+			netlist->gate_output[g] = netlist->table_net_num + g;
+
+		// Input, the thing to the left. Gates next to gates read their private net
+		Thing* src = thing_find(circ, point_add(thing->pos, point(-1, 0)), THING_All);
+		if (src && src->type == THING_Node)
+			netlist->gate_input[g] = node_net_id(circ, (Node*)src)->index;
+		else if (src && gate_of[src->index])
+			netlist->gate_input[g] = netlist->table_net_num + gate_of[src->index] - 1;
+		else
+			netlist->gate_input[g] = 0;
+	}
+
+	free(gate_of);
+
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		Circuit* chip_circ = chip_circuit(circ, (Chip*)it);
+		if (unit == MEMO_None && memo_chip_candidate(chip_circ))
+			netlist_collect(netlist, chip_circ, gate_index, netlist->memo_num++);
+		else
+			netlist_collect(netlist, chip_circ, gate_index, unit);
+	}
+}
+
+// Sorts the inverters by level (Kahn's algorithm), so every inverter is evaluated after the inverters driving it.
+// Cycles are broken by forcing an inverter of a cycle (a strongly connected component, found with Tarjan's
+// algorithm) that nothing outside the cycle is still waiting on, which will then read last tic's values.
+// A memo unit is sorted as a single node, after everything driving the nets it reads from outside.
+// Such a node can be on a cycle where the gates of the unit aren't, the units that are get set in on_cycle.
+// Returns the evaluation order of all gates, delays are put last.
+u32* netlist_levelize(Netlist* netlist, bool* on_cycle)
+{
+	u32 gate_num = netlist->gate_num;
+	u32 net_num = netlist->net_num;
+	u32 memo_num = netlist->memo_num;
+	u32* gate_memo = netlist->gate_memo;
+
+	// Gates are nodes [0, gate_num), units are nodes after that
+	u32 node_num = gate_num + memo_num;
+
+	bool* is_inverter = malloc(gate_num + 1);
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		Thing* thing = thing_get(netlist->gate_circ[g], netlist->gate_id[g]);
+		is_inverter[g] = thing->type == THING_Inverter;
+	}
+
+	u32* memo_first = malloc(sizeof(u32) * (memo_num + 1));
+	u32* memo_last = malloc(sizeof(u32) * (memo_num + 1));
+	memset(memo_first, 0xFF, sizeof(u32) * (memo_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u32 unit = gate_memo[g];
+		if (unit == MEMO_None)
+			continue;
+
+		if (memo_first[unit] == MEMO_None)
+			memo_first[unit] = g;
+		memo_last[unit] = g + 1;
+	}
+
+	// Which nets every node reads, and which nets its inverters drive (in CSR form).
+	// A unit reads the nets it doesn't drive itself, counting every net once
+	u32* read_net = malloc(sizeof(u32) * (gate_num + 1));
+	u32* read_node = malloc(sizeof(u32) * (gate_num + 1));
+	u32* drive_start = malloc(sizeof(u32) * (node_num + 1));
+	u32* drive_nets = malloc(sizeof(u32) * (gate_num + 1));
+	u32* driven_mark = malloc(sizeof(u32) * net_num);
+	u32* listed_mark = malloc(sizeof(u32) * net_num);
+	u32* read_mark = malloc(sizeof(u32) * net_num);
+	memset(driven_mark, 0xFF, sizeof(u32) * net_num);
+	memset(listed_mark, 0xFF, sizeof(u32) * net_num);
+	memset(read_mark, 0xFF, sizeof(u32) * net_num);
+
+	u32 read_num = 0;
+	u32 drive_num = 0;
+	u32 sortable_num = 0;
+	for(u32 node=0; node<node_num; ++node)
+	{
+		drive_start[node] = drive_num;
+		if (node < gate_num)
+		{
+			if (gate_memo[node] != MEMO_None || !is_inverter[node])
+				continue;
+
+			read_net[read_num] = netlist->gate_input[node];
+			read_node[read_num++] = node;
+			drive_nets[drive_num++] = netlist->gate_output[node];
+		}
+		else
+		{
+			u32 unit = node - gate_num;
+			for(u32 g=memo_first[unit]; g<memo_last[unit]; ++g)
+				driven_mark[netlist->gate_output[g]] = unit;
+
+			for(u32 g=memo_first[unit]; g<memo_last[unit]; ++g)
+			{
+				u32 in = netlist->gate_input[g];
+				u32 out = netlist->gate_output[g];
+				if (is_inverter[g] && listed_mark[out] != unit)
+				{
+					listed_mark[out] = unit;
+					drive_nets[drive_num++] = out;
+				}
+
+				if (driven_mark[in] != unit && read_mark[in] != unit)
+				{
+					read_mark[in] = unit;
+					read_net[read_num] = in;
+					read_node[read_num++] = node;
+				}
+			}
+		}
+
+		sortable_num++;
+	}
+	drive_start[node_num] = drive_num;
+
+	free(read_mark);
+	free(listed_mark);
+	free(driven_mark);
+
+	// Readers of every net, in CSR form
+	u32* reader_start = malloc(sizeof(u32) * (net_num + 1));
+	u32* readers = malloc(sizeof(u32) * (read_num + 1));
+	u32* in_degree = malloc(sizeof(u32) * (node_num + 1));
+	u32* level = malloc(sizeof(u32) * (node_num + 1));
+	u32* inv_drivers = malloc(sizeof(u32) * net_num);
+	mem_zero(reader_start, sizeof(u32) * (net_num + 1));
+	mem_zero(inv_drivers, sizeof(u32) * net_num);
+	mem_zero(in_degree, sizeof(u32) * (node_num + 1));
+	mem_zero(level, sizeof(u32) * (node_num + 1));
+
+	for(u32 i=0; i<drive_num; ++i)
+		inv_drivers[drive_nets[i]]++;
+
+	for(u32 r=0; r<read_num; ++r)
+	{
+		reader_start[read_net[r] + 1]++;
+		in_degree[read_node[r]] += inv_drivers[read_net[r]];
+	}
+
+	for(u32 n=0; n<net_num; ++n)
+		reader_start[n + 1] += reader_start[n];
+
+	u32* reader_fill = malloc(sizeof(u32) * (net_num + 1));
+	memcpy(reader_fill, reader_start, sizeof(u32) * (net_num + 1));
+	for(u32 r=0; r<read_num; ++r)
+		readers[reader_fill[read_net[r]]++] = read_node[r];
+
+	free(reader_fill);
+
+	// Strongly connected components, without recursion. A node's edges go to the readers of the nets it
+	// drives, the cursor of a node on the stack is the drive and the reader it got to
+	u32* scc = malloc(sizeof(u32) * (node_num + 1));
+	u32* scc_size = malloc(sizeof(u32) * (node_num + 1));
+	u32* visit = malloc(sizeof(u32) * (node_num + 1));
+	u32* low = malloc(sizeof(u32) * (node_num + 1));
+	u32* scc_stack = malloc(sizeof(u32) * (node_num + 1));
+	u32* call_stack = malloc(sizeof(u32) * (node_num + 1));
+	u32* cursor_drive = malloc(sizeof(u32) * (node_num + 1));
+	u32* cursor_read = malloc(sizeof(u32) * (node_num + 1));
+	bool* on_stack = malloc(node_num + 1);
+	mem_zero(visit, sizeof(u32) * (node_num + 1));
+	mem_zero(on_stack, node_num + 1);
+
+	u32 visit_num = 0;
+	u32 scc_num = 0;
+	u32 scc_top = 0;
+	for(u32 root=0; root<node_num; ++root)
+	{
+		bool sortable = root >= gate_num || (is_inverter[root] && gate_memo[root] == MEMO_None);
+		if (!sortable || visit[root])
+			continue;
+
+		u32 call_top = 0;
+		call_stack[call_top++] = root;
+		visit[root] = low[root] = ++visit_num;
+		scc_stack[scc_top++] = root;
+		on_stack[root] = true;
+		cursor_drive[root] = drive_start[root];
+		cursor_read[root] = drive_start[root] < drive_start[root + 1] ? reader_start[drive_nets[drive_start[root]]] : 0;
+
+		while(call_top > 0)
+		{
+			u32 node = call_stack[call_top - 1];
+			u32 d = cursor_drive[node];
+			while(d < drive_start[node + 1] && cursor_read[node] >= reader_start[drive_nets[d] + 1])
+			{
+				if (++d < drive_start[node + 1])
+					cursor_read[node] = reader_start[drive_nets[d]];
+			}
+			cursor_drive[node] = d;
+
+			if (d < drive_start[node + 1])
+			{
+				u32 reader = readers[cursor_read[node]++];
+				if (!visit[reader])
+				{
+					call_stack[call_top++] = reader;
+					visit[reader] = low[reader] = ++visit_num;
+					scc_stack[scc_top++] = reader;
+					on_stack[reader] = true;
+					cursor_drive[reader] = drive_start[reader];
+					cursor_read[reader] = drive_start[reader] < drive_start[reader + 1] ? reader_start[drive_nets[drive_start[reader]]] : 0;
+				}
+				else if (on_stack[reader])
+				{
+					low[node] = min(low[node], visit[reader]);
+				}
+
+				continue;
+			}
+
+			// Done with the node, it's the root of a component if nothing below reaches further up
+			if (low[node] == visit[node])
+			{
+				u32 member;
+				scc_size[scc_num] = 0;
+				do
+				{
+					member = scc_stack[--scc_top];
+					on_stack[member] = false;
+					scc[member] = scc_num;
+					scc_size[scc_num]++;
+				} while(member != node);
+
+				scc_num++;
+			}
+
+			call_top--;
+			if (call_top > 0)
+			{
+				u32 parent = call_stack[call_top - 1];
+				low[parent] = min(low[parent], low[node]);
+			}
+		}
+	}
+
+	free(on_stack);
+	free(cursor_read);
+	free(cursor_drive);
+	free(call_stack);
+	free(scc_stack);
+	free(low);
+	free(visit);
+
+	for(u32 unit=0; unit<memo_num; ++unit)
+		on_cycle[unit] = scc_size[scc[gate_num + unit]] > 1;
+
+	free(scc_size);
+
+	// What every node still waits on from outside its component. Once that's nothing and Kahn's algorithm
+	// is stuck, the node is on a cycle that only waits on itself and can be forced
+	u32* outside_in = malloc(sizeof(u32) * (node_num + 1));
+	mem_zero(outside_in, sizeof(u32) * (node_num + 1));
+	for(u32 node=0; node<node_num; ++node)
+	{
+		for(u32 d=drive_start[node]; d<drive_start[node + 1]; ++d)
+		{
+			for(u32 r=reader_start[drive_nets[d]]; r<reader_start[drive_nets[d] + 1]; ++r)
+			{
+				if (scc[readers[r]] != scc[node])
+					outside_in[readers[r]]++;
+			}
+		}
+	}
+
+	// Only inverters (and units) are ordered, delays only change at the end of a tic
+	u32* queue = malloc(sizeof(u32) * (node_num + 1));
+	u32* ready = malloc(sizeof(u32) * (node_num + 1));
+	bool* sorted = malloc(node_num + 1);
+	mem_zero(sorted, node_num + 1);
+	u32 queue_head = 0;
+	u32 queue_tail = 0;
+	u32 ready_head = 0;
+	u32 ready_tail = 0;
+
+	for(u32 node=0; node<node_num; ++node)
+	{
+		bool sortable = node >= gate_num || (is_inverter[node] && gate_memo[node] == MEMO_None);
+		if (sortable && in_degree[node] == 0)
+		{
+			queue[queue_tail++] = node;
+			sorted[node] = true;
+		}
+		else if (sortable && outside_in[node] == 0)
+		{
+			ready[ready_tail++] = node;
+		}
+	}
+
+	while(queue_tail < sortable_num || queue_head < queue_tail)
+	{
+		// Stuck on cycles, force a node of one that doesn't wait on anything else
+		if (queue_head == queue_tail)
+		{
+			while(ready_head < ready_tail && sorted[ready[ready_head]])
+				ready_head++;
+
+			assert(ready_head < ready_tail);
+			u32 node = ready[ready_head++];
+			queue[queue_tail++] = node;
+			sorted[node] = true;
+		}
+
+		u32 node = queue[queue_head++];
+		for(u32 d=drive_start[node]; d<drive_start[node + 1]; ++d)
+		{
+			u32 out = drive_nets[d];
+			for(u32 r=reader_start[out]; r<reader_start[out + 1]; ++r)
+			{
+				u32 reader = readers[r];
+				if (sorted[reader])
+					continue;
+
+				level[reader] = max(level[reader], level[node] + 1);
+				if (--in_degree[reader] == 0)
+				{
+					queue[queue_tail++] = reader;
+					sorted[reader] = true;
+				}
+				else if (scc[reader] != scc[node] && --outside_in[reader] == 0)
+				{
+					ready[ready_tail++] = reader;
+				}
+			}
+		}
+	}
+
+	// Bucket the inverters and units by level, then append the delays
+	u32 level_num = 0;
+	for(u32 i=0; i<sortable_num; ++i)
+		level_num = max(level_num, level[queue[i]] + 1);
+
+	u32* level_start = malloc(sizeof(u32) * (level_num + 1));
+	mem_zero(level_start, sizeof(u32) * (level_num + 1));
+	for(u32 i=0; i<sortable_num; ++i)
+		level_start[level[queue[i]] + 1]++;
+	for(u32 l=0; l<level_num; ++l)
+		level_start[l + 1] += level_start[l];
+
+	u32* level_order = malloc(sizeof(u32) * (sortable_num + 1));
+	for(u32 i=0; i<sortable_num; ++i)
+		level_order[level_start[level[queue[i]]]++] = queue[i];
+
+	u32* order = malloc(sizeof(u32) * (gate_num + 1));
+	u32 order_num = 0;
+	for(u32 i=0; i<sortable_num; ++i)
+	{
+		u32 node = level_order[i];
+		if (node < gate_num)
+			order[order_num++] = node;
+		else
+			order_num += memo_order_unit(netlist, is_inverter, memo_first[node - gate_num], memo_last[node - gate_num], order + order_num);
+	}
+
+	netlist->inverter_num = order_num;
+	netlist->level_num = level_num;
+
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		if (!is_inverter[g] && gate_memo[g] == MEMO_None)
+			order[order_num++] = g;
+	}
+
+	assert(order_num == gate_num);
+
+	free(level_order);
+	free(level_start);
+	free(sorted);
+	free(ready);
+	free(queue);
+	free(outside_in);
+	free(scc);
+	free(inv_drivers);
+	free(level);
+	free(in_degree);
+	free(readers);
+	free(reader_start);
+	free(drive_nets);
+	free(drive_start);
+	free(read_node);
+	free(read_net);
+	free(memo_last);
+	free(memo_first);
+	free(is_inverter);
+
+	return order;
+}
+
+// Reorders a gate array into evaluation order
+void netlist_reorder(void** array, u32 elem_size, u32* order, u32 num)
+{
+	u8* src = *array;
+	u8* dst = malloc(elem_size * (num + 1));
+	for(u32 i=0; i<num; ++i)
+		memcpy(dst + i * elem_size, src + order[i] * elem_size, elem_size);
+
+	free(src);
+	*array = dst;
+}
+
+void netlist_reorder_gates(Netlist* netlist, u32* order)
+{
+	u32 gate_num = netlist->gate_num;
+	netlist_reorder((void**)&netlist->gate_input, sizeof(u32), order, gate_num);
+	netlist_reorder((void**)&netlist->gate_output, sizeof(u32), order, gate_num);
+	netlist_reorder((void**)&netlist->gate_state, sizeof(u8), order, gate_num);
+	netlist_reorder((void**)&netlist->gate_circ, sizeof(Circuit*), order, gate_num);
+	netlist_reorder((void**)&netlist->gate_id, sizeof(Thing_Id), order, gate_num);
+	netlist_reorder((void**)&netlist->gate_memo, sizeof(u32), order, gate_num);
+}
+
+u32 island_find(u32* parent, u32 net)
+{
+	while(parent[net] != net)
+	{
+		parent[net] = parent[parent[net]];
+		net = parent[net];
+	}
+
+	return net;
+}
+
+// Groups the (levelized) gates into islands, batches of gates connected through nets.
+// Gates keep their relative order within an island, so an island still has its inverters in level order first.
+// Returns the new order of the gates
+u32* netlist_partition(Netlist* netlist)
+{
+	u32 gate_num = netlist->gate_num;
+	u32 net_num = netlist->net_num;
+
+	// Union the nets every gate reads and drives. Net 0 is never driven, so it doesn't connect anything
+	u32* parent = malloc(sizeof(u32) * net_num);
+	for(u32 n=0; n<net_num; ++n)
+		parent[n] = n;
+
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u32 input = netlist->gate_input[g];
+		if (input == 0)
+			continue;
+
+		u32 a = island_find(parent, input);
+		u32 b = island_find(parent, netlist->gate_output[g]);
+		if (a != b)
+			parent[a] = b;
+	}
+
+	// Memo units are ticked as a whole, so keep them in one island even if the chip has parts that aren't connected
+	u32* memo_net = malloc(sizeof(u32) * (netlist->memo_num + 1));
+	memset(memo_net, 0xFF, sizeof(u32) * (netlist->memo_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u32 unit = netlist->gate_memo[g];
+		if (unit == MEMO_None)
+			continue;
+
+		if (memo_net[unit] == MEMO_None)
+		{
+			memo_net[unit] = netlist->gate_output[g];
+			continue;
+		}
+
+		u32 a = island_find(parent, memo_net[unit]);
+		u32 b = island_find(parent, netlist->gate_output[g]);
+		if (a != b)
+			parent[a] = b;
+	}
+
+	free(memo_net);
+
+	// Number the groups of connected gates in order of their first gate, so the layout of the netlist is deterministic
+	u32* group_of_net = malloc(sizeof(u32) * net_num);
+	u32* island_of_gate = malloc(sizeof(u32) * (gate_num + 1));
+	memset(group_of_net, 0xFF, sizeof(u32) * net_num);
+
+	u32 group_num = 0;
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u32 root = island_find(parent, netlist->gate_output[g]);
+		if (group_of_net[root] == ~0u)
+			group_of_net[root] = group_num++;
+
+		island_of_gate[g] = group_of_net[root];
+	}
+
+	// Batch groups into islands, ticking tiny islands one by one costs more than ticking them
+	u32* group_size = malloc(sizeof(u32) * (group_num + 1));
+	mem_zero(group_size, sizeof(u32) * (group_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+		group_size[island_of_gate[g]]++;
+
+	u32 island_num = 0;
+	u32 island_gates = NETLIST_ISLAND_GATES;
+	for(u32 i=0; i<group_num; ++i)
+	{
+		if (island_gates >= NETLIST_ISLAND_GATES)
+		{
+			island_num++;
+			island_gates = 0;
+		}
+
+		island_gates += group_size[i];
+		group_size[i] = island_num - 1;
+	}
+
+	for(u32 g=0; g<gate_num; ++g)
+		island_of_gate[g] = group_size[island_of_gate[g]];
+
+	u32* island_start = malloc(sizeof(u32) * (island_num + 1));
+	u32* island_delay_start = malloc(sizeof(u32) * (island_num + 1));
+	mem_zero(island_start, sizeof(u32) * (island_num + 1));
+	mem_zero(island_delay_start, sizeof(u32) * (island_num + 1));
+
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		island_start[island_of_gate[g] + 1]++;
+		if (g < netlist->inverter_num)
+			island_delay_start[island_of_gate[g]]++;
+	}
+
+	for(u32 i=0; i<island_num; ++i)
+	{
+		island_start[i + 1] += island_start[i];
+		island_delay_start[i] += island_start[i];
+	}
+
+	u32* island_fill = malloc(sizeof(u32) * (island_num + 1));
+	memcpy(island_fill, island_start, sizeof(u32) * (island_num + 1));
+
+	u32* order = malloc(sizeof(u32) * (gate_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+		order[island_fill[island_of_gate[g]]++] = g;
+
+	netlist->island_num = island_num;
+	netlist->island_start = island_start;
+	netlist->island_delay_start = island_delay_start;
+
+	free(island_fill);
+	free(group_size);
+	free(island_of_gate);
+	free(group_of_net);
+	free(parent);
+
+	return order;
+}
+
+u32 netlist_generation = 0;
+
+void netlist_compile(Netlist* netlist, Circuit* circ)
+{
+	netlist_free(netlist);
+	netlist->circ = circ;
+	netlist->generation = ++netlist_generation;
+
+	// Extract all nets first, since that might shuffle the net table around.
+	// Re-extracting a net can break nets prepared earlier, so go again until nothing changes
+	u32 gate_num = 0;
+	u32 prev_epoch = 0;
+	do
+	{
+		prev_epoch = circ->nets.epoch;
+		gate_num = netlist_prepare(circ);
+	} while(circ->nets.epoch != prev_epoch);
+
+	netlist->table_net_num = max(circ->nets.net_num, 1);
+	netlist->gate_num = gate_num;
+	netlist->net_num = netlist->table_net_num + gate_num;
+
+	netlist->net_drive = malloc(sizeof(u32) * netlist->net_num);
+	mem_zero(netlist->net_drive, sizeof(u32) * netlist->net_num);
+
+	netlist->gate_input = malloc(sizeof(u32) * (gate_num + 1));
+	netlist->gate_output = malloc(sizeof(u32) * (gate_num + 1));
+	netlist->gate_state = malloc(gate_num + 1);
+	netlist->gate_circ = malloc(sizeof(Circuit*) * (gate_num + 1));
+	netlist->gate_id = malloc(sizeof(Thing_Id) * (gate_num + 1));
+	netlist->gate_memo = malloc(sizeof(u32) * (gate_num + 1));
+
+	u32 gate_index = 0;
+	netlist_collect(netlist, circ, &gate_index, MEMO_None);
+	assert(gate_index == gate_num);
+	memo_validate(netlist);
+
+	// Units on a cycle go back to being gates, which can't put any of the others on one
+	bool* on_cycle = malloc(netlist->memo_num + 1);
+	u32* order = netlist_levelize(netlist, on_cycle);
+	if (memo_drop(netlist, on_cycle))
+	{
+		free(order);
+		order = netlist_levelize(netlist, on_cycle);
+	}
+
+	free(on_cycle);
+	netlist_reorder_gates(netlist, order);
+	free(order);
+
+	order = netlist_partition(netlist);
+	netlist_reorder_gates(netlist, order);
+	free(order);
+
+	// Drive the nets with the current state of the gates
+	for(u32 g=0; g<gate_num; ++g)
+		netlist->net_drive[netlist->gate_output[g]] += netlist->gate_state[g];
+
+	// Keys are made from the gate index with splitmix64
+	netlist->gate_key = malloc(sizeof(u64) * (gate_num + 1));
+	netlist->island_hash = malloc(sizeof(u64) * (netlist->island_num + 1));
+	mem_zero(netlist->island_hash, sizeof(u64) * (netlist->island_num + 1));
+	for(u32 g=0; g<gate_num; ++g)
+	{
+		u64 key = (g + 1) * 0x9E3779B97F4A7C15ull;
+		key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+		key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+		netlist->gate_key[g] = key ^ (key >> 31);
+	}
+
+	for(u32 i=0; i<netlist->island_num; ++i)
+	{
+		for(u32 g=netlist->island_start[i]; g<netlist->island_start[i + 1]; ++g)
+		{
+			if (netlist->gate_state[g])
+				netlist->island_hash[i] ^= netlist->gate_key[g];
+		}
+	}
+
+	memo_build(netlist);
+	free(netlist->gate_memo);
+	netlist->gate_memo = NULL;
+
+	netlist->valid = true;
+	netlist->synced = true;
+}
+
+// Inverters [first, last), in level order
+void netlist_tic_inverters(Netlist* netlist, u32 first, u32 last, u64* hash)
+{
+	u32* net_drive = netlist->net_drive;
+	u32* gate_input = netlist->gate_input;
+	u32* gate_output = netlist->gate_output;
+	u8* gate_state = netlist->gate_state;
+
+	for(u32 g=first; g<last; ++g)
+	{
+		u8 state = net_drive[gate_input[g]] == 0;
+		if (state != gate_state[g])
+		{
+			gate_state[g] = state;
+			net_drive[gate_output[g]] += state ? 1 : -1;
+			*hash ^= netlist->gate_key[g];
+		}
+	}
+}
+
+void netlist_tic_islands(Netlist* netlist, u32 first, u32 last)
+{
+	u32* net_drive = netlist->net_drive;
+	u32* gate_input = netlist->gate_input;
+	u32* gate_output = netlist->gate_output;
+	u8* gate_state = netlist->gate_state;
+	u64* gate_key = netlist->gate_key;
+
+	for(u32 i=first; i<last; ++i)
+	{
+		u32 delay_start = netlist->island_delay_start[i];
+		u32 end = netlist->island_start[i + 1];
+		u32 memo_start = netlist->island_memo_start[i];
+		u32 memo_end = netlist->island_memo_start[i + 1];
+		u64 hash = netlist->island_hash[i];
+
+		// Inverters and memo units, in level order
+		u32 g = netlist->island_start[i];
+		for(u32 m=memo_start; m<memo_end; ++m)
+		{
+			Memo_Unit* unit = &netlist->memos[m];
+			netlist_tic_inverters(netlist, g, unit->gate_start, &hash);
+			memo_eval(netlist, unit, &hash);
+			g = unit->gate_end;
+		}
+
+		netlist_tic_inverters(netlist, g, delay_start, &hash);
+
+		// Delays latch their input at the end of the tic, read everything before changing anything
+		// so chained delays don't ripple through in one tic
+		for(u32 g=delay_start; g<end; ++g)
+			gate_state[g] |= (net_drive[gate_input[g]] != 0) << 1;
+
+		for(u32 g=delay_start; g<end; ++g)
+		{
+			u8 state = gate_state[g] >> 1;
+			u8 prev_state = gate_state[g] & 1;
+			gate_state[g] = state;
+
+			if (state != prev_state)
+			{
+				net_drive[gate_output[g]] += state ? 1 : -1;
+				hash ^= gate_key[g];
+			}
+		}
+
+		for(u32 m=memo_start; m<memo_end; ++m)
+			memo_latch(netlist, &netlist->memos[m], &hash);
+
+		netlist->island_hash[i] = hash;
+	}
+}
+
+void netlist_tic_job(void* data, u32 island)
+{
+	TRACE_BEGIN(begin);
+	netlist_tic_islands(data, island, island + 1);
+	TRACE_END("island", begin);
+}
+
+void netlist_tic(Netlist* netlist)
+{
+	if (netlist_pool && netlist->island_num > 1)
+		thread_pool_run(netlist_pool, netlist_tic_job, netlist, netlist->island_num);
+	else
+		netlist_tic_islands(netlist, 0, netlist->island_num);
+
+	netlist->eval_count += netlist->gate_num;
+	STATS_ADD(gate_evals, netlist->gate_num);
+	netlist->synced = false;
+}
+
+// Sets a gate from outside of a tic, keeping the nets it drives and the hash of its island right
+void netlist_set_gate(Netlist* netlist, u32 gate, u8 state)
+{
+	if (netlist->gate_state[gate] == state)
+		return;
+
+	// Last island starting at or before the gate
+	u32 low = 0;
+	u32 high = netlist->island_num;
+	while(high - low > 1)
+	{
+		u32 mid = (low + high) / 2;
+		if (netlist->island_start[mid] <= gate)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	netlist->gate_state[gate] = state;
+	netlist->net_drive[netlist->gate_output[gate]] += state ? 1 : -1;
+	netlist->island_hash[low] ^= netlist->gate_key[gate];
+	netlist->synced = false;
+	memo_set_gate(netlist, gate, state);
+}
+
+u64 netlist_hash(Netlist* netlist)
+{
+	u64 hash = 0;
+	for(u32 i=0; i<netlist->island_num; ++i)
+		hash ^= netlist->island_hash[i];
+
+	return hash;
+}
+
+void netlist_set_thread_num(u32 thread_num)
+{
+	if (netlist_pool)
+	{
+		if (thread_pool_thread_num(netlist_pool) == thread_num)
+			return;
+
+		thread_pool_free(netlist_pool);
+		netlist_pool = NULL;
+	}
+
+	if (thread_num > 1)
+		netlist_pool = thread_pool_make(thread_num);
+}
+
+void netlist_sync(Netlist* netlist)
+{
+	if (!netlist->valid || netlist->synced)
+		return;
+
+	for(u32 g=0; g<netlist->gate_num; ++g)
+	{
+		Circuit* gate_circ = netlist->gate_circ[g];
+		Thing* thing = thing_get(gate_circ, netlist->gate_id[g]);
+		if (!thing)
+			continue;
+
+		thing_set_active(gate_circ, thing, netlist->gate_state[g]);
+		net_set_source_powered(gate_circ, thing, netlist->gate_state[g]);
+	}
+
+	Net_Table* table = &netlist->circ->nets;
+	for(u32 n=1; n<netlist->table_net_num && n<table->net_num; ++n)
+	{
+		Net* net = &table->nets[n];
+		if (!net->valid)
+			continue;
+
+		net->state = netlist->net_drive[n] != 0;
+		net->resolved = true;
+
+		for(u32 i=0; i<net->member_num; ++i)
+		{
+			Circuit* member_circ = net->members[i].circ;
+			Node* node = node_get(member_circ, net->members[i].id);
+			if (node)
+				thing_set_active(member_circ, node, net->state);
+		}
+	}
+
+	netlist->synced = true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "net.h"
+#include "memo.h"
+
+// Netlist
+// A flattened, compiled version of a circuit and all of its chips, used for ticking.
+// Net 0 is always off, nets [1, table_net_num) are the nets of the root net table,
+// and every gate owns a private output net after that, for when it doesn't drive a node.
+// Gates are grouped into islands, sets of gates that never share a net with another island.
+// Small groups of connected gates are batched together, so islands are at least a few hundred gates.
+// Within an island gates are stored in evaluation order: inverters sorted by level, followed by delays.
+// Islands don't affect each other, so they can be ticked in any order, or at the same time.
+// Memo units (see memo.h) are a block of gates in the inverter section of their island, evaluated as a whole.
+// The editor keeps working on things, the netlist is recompiled whenever the layout changes.
+typedef struct Netlist
+{
+	bool valid;
+	bool synced;
+
+	Circuit* circ;
+	u32 table_net_num;
+
+	u32 net_num;
+	u32* net_drive;
+
+	u32 gate_num;
+	u32 inverter_num;  // Gates in the inverter sections, including all gates of memo units
+	u32* gate_input;
+	u32* gate_output;
+	u8* gate_state;
+
+	// Cold data, used to write state back into things
+	Circuit** gate_circ;
+	Thing_Id* gate_id;
+
+	// Gates of island i are [island_start[i], island_start[i + 1]), delays start at island_delay_start[i]
+	u32 island_num;
+	u32* island_start;
+	u32* island_delay_start;
+
+	// Zobrist hash of the gate states, every gate has a random key which is xor'ed in while it's on.
+	// Kept per island, so islands can update theirs while being ticked on different threads
+	u64* gate_key;
+	u64* island_hash;
+
+	// Units of island i are [island_memo_start[i], island_memo_start[i + 1]), in gate order
+	u32 memo_num;
+	Memo_Unit* memos;
+	u32* island_memo_start;
+	u32* memo_inputs;
+	u32 memo_cache_num;
+	Memo_Cache* memo_caches;
+
+	// Unit of every gate while compiling, MEMO_None if it's evaluated on its own
+	u32* gate_memo;
+
+	u32 level_num;
+	u64 eval_count;
+
+	// Different for every compile, so whatever caches net indices can tell when they moved
+	u32 generation;
+} Netlist;
+
+void netlist_free(Netlist* netlist);
+void netlist_compile(Netlist* netlist, Circuit* circ);
+void netlist_tic(Netlist* netlist);
+
+// Ticks islands on this many threads, 1 ticks on the calling thread only
+void netlist_set_thread_num(u32 thread_num);
+
+// Hash of the full simulation state, equal states have equal hashes
+u64 netlist_hash(Netlist* netlist);
+
+// Sets the state of a gate between tics, for restoring a recorded state
+void netlist_set_gate(Netlist* netlist, u32 gate, u8 state);
+
+// Writes the state of the netlist back into the things, so they can be drawn, saved or subticed
+void netlist_sync(Netlist* netlist);
+
+void circuit_invalidate_netlist(Circuit* circ);
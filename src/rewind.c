@@ -0,0 +1,444 @@
+#include "rewind.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+// See memo.c
+#ifdef _MSC_VER
+u32 bit_index(u64 bits);
+#else
+#define bit_index(bits) ((u32)__builtin_ctzll(bits))
+#endif
+
+void rewind_init(Rewind* rewind, u32 budget, u32 keyframe_interval)
+{
+	mem_zero(rewind, sizeof(Rewind));
+	rewind->keyframe_interval = max(keyframe_interval, 1);
+
+	// Three quarters of the budget for records, the rest for entries, both rounded down to a power of two
+	rewind->data_size = 1;
+	while(rewind->data_size * 2 <= budget / 4 * 3)
+		rewind->data_size <<= 1;
+
+	rewind->entry_max = 1;
+	while(rewind->entry_max * 2 * sizeof(Rewind_Entry) <= budget / 4)
+		rewind->entry_max <<= 1;
+
+	rewind->data = malloc(rewind->data_size);
+	rewind->entries = malloc(sizeof(Rewind_Entry) * rewind->entry_max);
+}
+
+void rewind_free(Rewind* rewind)
+{
+	if (rewind->state)
+		free(rewind->state);
+	if (rewind->data)
+		free(rewind->data);
+	if (rewind->entries)
+		free(rewind->entries);
+	if (rewind->scratch)
+		free(rewind->scratch);
+	if (rewind->touched)
+		free(rewind->touched);
+
+	zero_t(*rewind);
+}
+
+void rewind_clear_history(Rewind* rewind)
+{
+	rewind->data_begin = 0;
+	rewind->data_end = 0;
+	rewind->entry_first = 0;
+	rewind->entry_num = 0;
+}
+
+void rewind_reset(Rewind* rewind)
+{
+	rewind_clear_history(rewind);
+	rewind->generation = 0;
+	rewind->gate_num = 0;
+	rewind->gate_hash = 0;
+}
+
+Rewind_Entry* rewind_entry(Rewind* rewind, u32 tic)
+{
+	return &rewind->entries[(rewind->entry_first + (tic - rewind->first_tic)) & (rewind->entry_max - 1)];
+}
+
+u32 rewind_first_tic(Rewind* rewind)
+{
+	return rewind->entry_num ? rewind->first_tic : tic;
+}
+
+u32 rewind_last_tic(Rewind* rewind)
+{
+	return rewind->entry_num ? rewind->first_tic + rewind->entry_num - 1 : tic;
+}
+
+u32 rewind_used_bytes(Rewind* rewind)
+{
+	return (rewind->data_end - rewind->data_begin) + rewind->entry_num * sizeof(Rewind_Entry);
+}
+
+// Drops the oldest keyframe and the tics after it up to the next one, so history always starts with a keyframe
+void rewind_drop_first(Rewind* rewind)
+{
+	do
+	{
+		Rewind_Entry* entry = rewind_entry(rewind, rewind->first_tic);
+		rewind->data_begin += entry->size;
+		rewind->entry_first++;
+		rewind->entry_num--;
+		rewind->first_tic++;
+	} while(rewind->entry_num && rewind_entry(rewind, rewind->first_tic)->size == rewind_entry(rewind, rewind->first_tic)->delta_size);
+}
+
+// Drops the tics after the one showing, they're about to be simulated again
+void rewind_drop_after(Rewind* rewind, u32 last)
+{
+	if (rewind->entry_num == 0 || last >= rewind_last_tic(rewind))
+		return;
+
+	Rewind_Entry* entry = rewind_entry(rewind, last);
+	rewind->data_end = entry->offset + entry->size;
+	rewind->entry_num = last - rewind->first_tic + 1;
+}
+
+// Hash of which gates the netlist has, in which order
+u64 rewind_gate_hash(Netlist* netlist)
+{
+	u64 hash = 14695981039346656037ull;
+	for(u32 g=0; g<netlist->gate_num; ++g)
+	{
+		hash = (hash ^ (u64)(uintptr_t)netlist->gate_circ[g]) * 1099511628211ull;
+		hash = (hash ^ ((u64)netlist->gate_id[g].generation << 32 | netlist->gate_id[g].index)) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Takes on a newly compiled netlist, history is kept if it has the same gates as the last one
+void rewind_adopt(Rewind* rewind, Netlist* netlist)
+{
+	u64 hash = rewind_gate_hash(netlist);
+	if (rewind->generation != 0 && hash == rewind->gate_hash && netlist->gate_num == rewind->gate_num)
+	{
+		rewind->generation = netlist->generation;
+		return;
+	}
+
+	rewind_reset(rewind);
+	rewind->generation = netlist->generation;
+	rewind->gate_hash = hash;
+	rewind->gate_num = netlist->gate_num;
+
+	if (rewind->state)
+		free(rewind->state);
+
+	rewind->state = malloc(max(netlist->gate_num, 1));
+	memcpy(rewind->state, netlist->gate_state, netlist->gate_num);
+}
+
+void rewind_scratch_reserve(Rewind* rewind, u32 size)
+{
+	if (size <= rewind->scratch_max)
+		return;
+
+	while(rewind->scratch_max < size)
+		rewind->scratch_max = rewind->scratch_max == 0 ? 256 : (rewind->scratch_max << 1);
+
+	rewind->scratch = realloc(rewind->scratch, rewind->scratch_max);
+	assert(rewind->scratch != NULL);
+}
+
+void rewind_touch(Rewind* rewind, u32 gate)
+{
+	if (rewind->touched_num >= rewind->touched_max)
+	{
+		rewind->touched_max = rewind->touched_max == 0 ? 256 : (rewind->touched_max << 1);
+		rewind->touched = realloc(rewind->touched, sizeof(u32) * rewind->touched_max);
+		assert(rewind->touched != NULL);
+	}
+
+	rewind->touched[rewind->touched_num++] = gate;
+}
+
+// Appends a flipped gate to the record in the scratch buffer
+u32 rewind_put_flip(Rewind* rewind, u32 size, u32 gate, u32* prev)
+{
+	rewind_scratch_reserve(rewind, size + 5);
+
+	u32 gap = gate - *prev;
+	*prev = gate;
+	while(gap >= 0x80)
+	{
+		rewind->scratch[size++] = (gap & 0x7F) | 0x80;
+		gap >>= 7;
+	}
+
+	rewind->scratch[size++] = gap;
+	return size;
+}
+
+// Delta between the recorded state and the gates, read from the netlist when it's valid and the things otherwise.
+// Returns the size of the delta, or false when a gate went away
+bool rewind_encode_delta(Rewind* rewind, Circuit* circ, u32* size)
+{
+	Netlist* netlist = &circ->netlist;
+	u8* state = rewind->state;
+	u32 prev = 0;
+	*size = 0;
+
+	if (netlist->valid)
+	{
+		// Compare eight gates at a time, most of them don't change
+		u8* gate_state = netlist->gate_state;
+		u32 g = 0;
+		for(; g + 8 <= rewind->gate_num; g += 8)
+		{
+			u64 a, b;
+			memcpy(&a, state + g, 8);
+			memcpy(&b, gate_state + g, 8);
+
+			// Go straight to the bytes that differ
+			for(u64 diff = a ^ b; diff; )
+			{
+				u32 byte = bit_index(diff) / 8;
+				diff &= ~(0xFFull << (byte * 8));
+				*size = rewind_put_flip(rewind, *size, g + byte, &prev);
+			}
+
+			memcpy(state + g, &b, 8);
+		}
+
+		for(; g<rewind->gate_num; ++g)
+		{
+			if (state[g] != gate_state[g])
+			{
+				*size = rewind_put_flip(rewind, *size, g, &prev);
+				state[g] = gate_state[g];
+			}
+		}
+
+		return true;
+	}
+
+	for(u32 g=0; g<rewind->gate_num; ++g)
+	{
+		Circuit* gate_circ = netlist->gate_circ[g];
+		Thing* thing = thing_get(gate_circ, netlist->gate_id[g]);
+		if (!thing)
+			return false;
+
+		u8 gate_state = thing_active(gate_circ, thing);
+		if (state[g] != gate_state)
+		{
+			*size = rewind_put_flip(rewind, *size, g, &prev);
+			state[g] = gate_state;
+		}
+	}
+
+	return true;
+}
+
+void rewind_record(Rewind* rewind, Circuit* circ)
+{
+	Netlist* netlist = &circ->netlist;
+	if (rewind->generation == 0 || netlist->generation != rewind->generation)
+	{
+		// Subtics don't compile the netlist, but it's what tells which gates there are
+		if (!netlist->valid)
+			netlist_compile(netlist, circ);
+
+		rewind_adopt(rewind, netlist);
+	}
+
+	// Stepped back and simulating again, or skipped ahead without recording
+	rewind_drop_after(rewind, rewind->tic);
+	if (rewind->entry_num && (rewind->tic != rewind_last_tic(rewind) || tic != rewind->tic + 1))
+		rewind_clear_history(rewind);
+
+	u32 delta_size;
+	if (!rewind_encode_delta(rewind, circ, &delta_size))
+	{
+		rewind_reset(rewind);
+		return;
+	}
+
+	rewind->tic = tic;
+
+	u32 keyframe_size = (rewind->gate_num + 7) / 8;
+	bool keyframe = rewind->entry_num == 0 || tic - rewind->keyframe_tic >= rewind->keyframe_interval;
+	if (delta_size + (keyframe ? keyframe_size : 0) > rewind->data_size)
+	{
+		rewind_clear_history(rewind);
+		return;
+	}
+
+	while(rewind->entry_num == rewind->entry_max ||
+		(rewind->data_end - rewind->data_begin) + delta_size + (keyframe ? keyframe_size : 0) > rewind->data_size)
+	{
+		rewind_drop_first(rewind);
+	}
+
+	// The first tic only has its keyframe, there's nothing before it to flip back to
+	if (rewind->entry_num == 0)
+	{
+		if (keyframe_size > rewind->data_size)
+			return;
+
+		keyframe = true;
+		delta_size = 0;
+		rewind->first_tic = tic;
+	}
+
+	u32 size = delta_size;
+	if (keyframe)
+	{
+		rewind_scratch_reserve(rewind, size + keyframe_size);
+		for(u32 b=0; b<keyframe_size; ++b)
+		{
+			u8 bits = 0;
+			for(u32 i=0; i<8 && b * 8 + i < rewind->gate_num; ++i)
+				bits |= rewind->state[b * 8 + i] << i;
+
+			rewind->scratch[size++] = bits;
+		}
+
+		rewind->keyframe_tic = tic;
+	}
+
+	Rewind_Entry* entry = rewind_entry(rewind, tic);
+	entry->offset = rewind->data_end;
+	entry->delta_size = delta_size;
+	entry->size = size;
+	rewind->entry_num++;
+
+	// At most two pieces, around the end of the ring
+	u32 at = rewind->data_end & (rewind->data_size - 1);
+	u32 first_part = min(size, rewind->data_size - at);
+	if (first_part > 0)
+		memcpy(rewind->data + at, rewind->scratch, first_part);
+	if (size > first_part)
+		memcpy(rewind->data, rewind->scratch + first_part, size - first_part);
+	rewind->data_end += size;
+}
+
+// Flips the gates of the delta of a tic
+void rewind_apply_delta(Rewind* rewind, Rewind_Entry* entry)
+{
+	u32 mask = rewind->data_size - 1;
+	u32 gate = 0;
+	u32 shift = 0;
+	u32 gap = 0;
+
+	for(u32 i=0; i<entry->delta_size; ++i)
+	{
+		u8 byte = rewind->data[(entry->offset + i) & mask];
+		gap |= (byte & 0x7F) << shift;
+		shift += 7;
+		if (byte & 0x80)
+			continue;
+
+		gate += gap;
+		rewind->state[gate] ^= 1;
+		rewind_touch(rewind, gate);
+		gap = 0;
+		shift = 0;
+	}
+}
+
+void rewind_apply_keyframe(Rewind* rewind, Rewind_Entry* entry)
+{
+	u32 mask = rewind->data_size - 1;
+	for(u32 g=0; g<rewind->gate_num; ++g)
+	{
+		u8 bits = rewind->data[(entry->offset + entry->delta_size + g / 8) & mask];
+		rewind->state[g] = (bits >> (g % 8)) & 1;
+	}
+}
+
+u32 rewind_seek(Rewind* rewind, Circuit* circ, u32 target)
+{
+	// The history has to end in the tic that's showing, and be about the gates there are
+	if (rewind->entry_num == 0 || rewind->tic != tic)
+		return tic;
+
+	target = min(max(target, rewind_first_tic(rewind)), rewind_last_tic(rewind));
+	if (target == rewind->tic)
+		return tic;
+
+	// After subtics the things are ahead of the netlist, get them in again
+	Netlist* netlist = &circ->netlist;
+	bool was_valid = netlist->valid;
+	if (!was_valid)
+	{
+		netlist_compile(netlist, circ);
+		rewind_adopt(rewind, netlist);
+		if (rewind->entry_num == 0)
+			return tic;
+	}
+
+	// Walking from here reads the deltas in between, starting over from a keyframe reads that and the ones after
+	u32 walk_first = min(target, rewind->tic) + 1;
+	u32 walk_last = max(target, rewind->tic);
+	u32 walk_cost = 0;
+	for(u32 t=walk_first; t<=walk_last; ++t)
+		walk_cost += rewind_entry(rewind, t)->delta_size;
+
+	u32 key = target;
+	while(key > rewind->first_tic && rewind_entry(rewind, key)->size == rewind_entry(rewind, key)->delta_size)
+		key--;
+
+	Rewind_Entry* key_entry = rewind_entry(rewind, key);
+	u32 key_cost = key_entry->size - key_entry->delta_size;
+	for(u32 t=key + 1; t<=target && key_cost < walk_cost; ++t)
+		key_cost += rewind_entry(rewind, t)->delta_size;
+
+	bool all_touched = !was_valid;
+	rewind->touched_num = 0;
+
+	if (key_entry->size > key_entry->delta_size && key_cost < walk_cost)
+	{
+		rewind_apply_keyframe(rewind, key_entry);
+		for(u32 t=key + 1; t<=target; ++t)
+			rewind_apply_delta(rewind, rewind_entry(rewind, t));
+
+		all_touched = true;
+	}
+	else
+	{
+		for(u32 t=walk_first; t<=walk_last; ++t)
+			rewind_apply_delta(rewind, rewind_entry(rewind, t));
+	}
+
+	if (all_touched)
+	{
+		for(u32 g=0; g<rewind->gate_num; ++g)
+			netlist_set_gate(netlist, g, rewind->state[g]);
+	}
+	else
+	{
+		for(u32 i=0; i<rewind->touched_num; ++i)
+			netlist_set_gate(netlist, rewind->touched[i], rewind->state[rewind->touched[i]]);
+	}
+
+	// The netlist ticks everything, but subtics need the things dirty to get going again
+	circuit_clear_dirty(circ);
+	if (!was_valid)
+	{
+		netlist_sync(netlist);
+		circuit_dirty_all(circ);
+	}
+
+	tic = target;
+	rewind->tic = target;
+	return tic;
+}
+
+u32 rewind_step(Rewind* rewind, Circuit* circ, i32 amount)
+{
+	if (amount < 0 && (u32)-amount > tic)
+		return rewind_seek(rewind, circ, 0);
+
+	return rewind_seek(rewind, circ, tic + amount);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "circuit.h"
+
+// Rewind
+// Keeps the recent history of a root circuit, so it can be stepped back or seeked to an earlier tic
+// without simulating again from the start. The state of a circuit at the end of a tic is the state
+// of its gates, nodes and nets follow from them. Every recorded tic stores which gates flipped since
+// the tic before it (gaps between gate indices, as varints), and every keyframe_interval tics also
+// the state of all gates as bits. Records go in a byte ring that drops the oldest tics when the
+// memory budget is used up.
+// Stepping back flips the gates of the tics in between, seeking far away starts from the nearest
+// keyframe instead, whichever reads less. Gates are the gates of the netlist: edits that keep them
+// (moving wires) keep the history, edits that change them start over.
+// circuit_tic and circuit_subtic record into the rewind of their circuit, see Circuit::rewind. Subtics
+// start again from a fully dirty circuit after a seek, like after loading.
+typedef struct
+{
+	u32 offset;
+	u32 delta_size;
+	u32 size; // Delta and keyframe, if it has one
+} Rewind_Entry;
+
+typedef struct Rewind
+{
+	u32 keyframe_interval;
+
+	// The netlist the gate indices belong to, 0 when there's none yet
+	u32 generation;
+	u64 gate_hash;
+	u32 gate_num;
+
+	// Gate states at tic, which is the tic that's showing
+	u8* state;
+	u32 tic;
+
+	// Byte ring, a power of two in size
+	u8* data;
+	u32 data_size;
+	u32 data_begin;
+	u32 data_end;
+
+	// Entry of first_tic + i is entries[(entry_first + i) & (entry_max - 1)]
+	Rewind_Entry* entries;
+	u32 entry_max;
+	u32 entry_first;
+	u32 entry_num;
+	u32 first_tic;
+	u32 keyframe_tic;
+
+	// Record being encoded, and gates touched by a seek
+	u8* scratch;
+	u32 scratch_max;
+	u32* touched;
+	u32 touched_num;
+	u32 touched_max;
+} Rewind;
+
+void rewind_init(Rewind* rewind, u32 budget, u32 keyframe_interval);
+void rewind_free(Rewind* rewind);
+
+// Forgets all history, and the gates it was recorded for
+void rewind_reset(Rewind* rewind);
+
+// Records the state at the end of the current tic
+void rewind_record(Rewind* rewind, Circuit* circ);
+
+// Restores the state of a recorded tic, as close to target as the history goes. Returns the tic it got to
+u32 rewind_seek(Rewind* rewind, Circuit* circ, u32 target);
+u32 rewind_step(Rewind* rewind, Circuit* circ, i32 amount);
+
+// Oldest and newest tic that can be seeked to
+u32 rewind_first_tic(Rewind* rewind);
+u32 rewind_last_tic(Rewind* rewind);
+u32 rewind_used_bytes(Rewind* rewind);
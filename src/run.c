@@ -0,0 +1,179 @@
+#include "run.h"
+#include <stdio.h>
+
+// Open addressing table from state hash to the tic it was seen at
+typedef struct
+{
+	u64* hashes;
+	u32* tics;
+	bool* used;
+	u32 max;
+	u32 num;
+} Run_History;
+
+void run_history_free(Run_History* history)
+{
+	if (history->hashes)
+		free(history->hashes);
+	if (history->tics)
+		free(history->tics);
+	if (history->used)
+		free(history->used);
+
+	zero_t(*history);
+}
+
+void run_history_insert(Run_History* history, u64 hash, u32 at_tic);
+
+void run_history_grow(Run_History* history)
+{
+	Run_History old = *history;
+
+	history->max = old.max ? old.max * 2 : 1024;
+	history->num = 0;
+	history->hashes = malloc(sizeof(u64) * history->max);
+	history->tics = malloc(sizeof(u32) * history->max);
+	history->used = malloc(sizeof(bool) * history->max);
+	mem_zero(history->used, sizeof(bool) * history->max);
+
+	for(u32 i=0; i<old.max; ++i)
+	{
+		if (old.used[i])
+			run_history_insert(history, old.hashes[i], old.tics[i]);
+	}
+
+	run_history_free(&old);
+}
+
+void run_history_insert(Run_History* history, u64 hash, u32 at_tic)
+{
+	// Keep it at most half full
+	if ((history->num + 1) * 2 > history->max)
+		run_history_grow(history);
+
+	u32 mask = history->max - 1;
+	u32 index = (u32)hash & mask;
+	while(history->used[index])
+		index = (index + 1) & mask;
+
+	history->hashes[index] = hash;
+	history->tics[index] = at_tic;
+	history->used[index] = true;
+	history->num++;
+}
+
+bool run_history_find(Run_History* history, u64 hash, u32* at_tic)
+{
+	if (history->max == 0)
+		return false;
+
+	u32 mask = history->max - 1;
+	u32 index = (u32)hash & mask;
+	while(history->used[index])
+	{
+		if (history->hashes[index] == hash)
+		{
+			*at_tic = history->tics[index];
+			return true;
+		}
+
+		index = (index + 1) & mask;
+	}
+
+	return false;
+}
+
+// Whether the state comes back after period tics. Equal hashes can still be different states, so a
+// cycle found through them is simulated once before it's skipped
+bool run_confirm_period(Circuit* circ, u32 period, u8* snapshot, Run_Result* result)
+{
+	Netlist* netlist = &circ->netlist;
+	memcpy(snapshot, netlist->gate_state, netlist->gate_num);
+	for(u32 i=0; i<period; ++i)
+	{
+		circuit_tic(circ);
+		result->simulated++;
+	}
+
+	return memcmp(snapshot, netlist->gate_state, netlist->gate_num) == 0;
+}
+
+Run_Result circuit_run_to(Circuit* circ, u32 target_tic)
+{
+	Run_Result result;
+	zero_t(result);
+
+	Netlist* netlist = &circ->netlist;
+	if (!netlist->valid)
+		netlist_compile(netlist, circ);
+
+	Run_History history;
+	zero_t(history);
+	run_history_insert(&history, netlist_hash(netlist), tic);
+	u8* snapshot = NULL;
+
+	while(tic < target_tic)
+	{
+		circuit_tic(circ);
+		result.simulated++;
+
+		u64 hash = netlist_hash(netlist);
+		u32 seen_tic;
+		if (run_history_find(&history, hash, &seen_tic) && tic + (tic - seen_tic) <= target_tic)
+		{
+			u32 period = tic - seen_tic;
+			if (!snapshot)
+				snapshot = malloc(max(netlist->gate_num, 1));
+
+			// A collision, the run goes on from wherever confirming it got to
+			if (!run_confirm_period(circ, period, snapshot, &result))
+				continue;
+
+			result.period = period;
+			result.cycle_start = seen_tic;
+
+			// Skip the whole periods, the state at the end of them is the state we're in now
+			tic = target_tic - (target_tic - tic) % result.period;
+			while(tic < target_tic)
+			{
+				circuit_tic(circ);
+				result.simulated++;
+			}
+			break;
+		}
+
+		// Long transients or periods would eat all memory, past this it's just a plain run
+		if (history.num < RUN_MAX_HISTORY)
+			run_history_insert(&history, hash, tic);
+	}
+
+	if (snapshot)
+		free(snapshot);
+
+	run_history_free(&history);
+	return result;
+}
+
+void run_file(const char* path, u32 target_tic)
+{
+	Circuit* circ = circuit_make("RUN");
+	if (!circuit_load(circ, path))
+	{
+		circuit_free(circ);
+		return;
+	}
+
+	Run_Result result = circuit_run_to(circ, target_tic);
+	if (result.period)
+	{
+		printf("%s: at tic %u, simulated %u tics, cycle of %u tics from tic %u\n",
+			path, tic, result.simulated, result.period, result.cycle_start);
+	}
+	else
+	{
+		printf("%s: at tic %u, simulated %u tics, no cycle found\n", path, tic, result.simulated);
+	}
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "circuit.h"
+
+// Run
+// Runs a circuit forward to some tic. The state is hashed after every tic, and once a state
+// comes back the circuit is known to be periodic from there on, so whole periods are skipped
+// and only what is left of the last period is simulated.
+// Equal hashes could still be different states, so one period is simulated and the gate states
+// compared before anything is skipped. A cycle that doesn't fit before the target isn't skipped.
+#define RUN_MAX_HISTORY (1 << 20)
+
+typedef struct
+{
+	u32 simulated;
+
+	// Period of the cycle and the first tic of it, period is 0 if no cycle was found
+	u32 period;
+	u32 cycle_start;
+} Run_Result;
+
+Run_Result circuit_run_to(Circuit* circ, u32 target_tic);
+
+// Loads a saved circuit and runs it, for headless use
+void run_file(const char* path, u32 target_tic);
@@ -0,0 +1,166 @@
+#include "spatial.h"
+
+#define SPATIAL_FREE ((u32)~0)
+
+u32 spatial_bucket(Spatial_Hash* hash, Point cell)
+{
+	u32 h = ((u32)cell.x * 73856093u) ^ ((u32)cell.y * 19349663u);
+	h ^= h >> 15;
+	return h & (hash->bucket_max - 1);
+}
+
+// Copies the arrays out of the file they're mapped from
+void spatial_own(Spatial_Hash* hash)
+{
+	if (!hash->mapped)
+		return;
+
+	u32* buckets = malloc(sizeof(u32) * hash->bucket_max);
+	memcpy(buckets, hash->buckets, sizeof(u32) * hash->bucket_max);
+	hash->buckets = buckets;
+
+	Spatial_Entry* entries = malloc(sizeof(Spatial_Entry) * hash->entry_max);
+	memcpy(entries, hash->entries, sizeof(Spatial_Entry) * hash->entry_max);
+	hash->entries = entries;
+
+	hash->mapped = false;
+}
+
+void spatial_rehash(Spatial_Hash* hash, u32 bucket_max)
+{
+	spatial_own(hash);
+	if (hash->buckets)
+		free(hash->buckets);
+
+	hash->buckets = malloc(sizeof(u32) * bucket_max);
+	mem_zero(hash->buckets, sizeof(u32) * bucket_max);
+	hash->bucket_max = bucket_max;
+
+	// Re-link all the live entries into their new buckets
+	for(u32 i=1; i<hash->entry_num; ++i)
+	{
+		Spatial_Entry* entry = &hash->entries[i];
+		if (entry->thing == SPATIAL_FREE)
+			continue;
+
+		u32 bucket = spatial_bucket(hash, entry->cell);
+		entry->next = hash->buckets[bucket];
+		hash->buckets[bucket] = i;
+	}
+}
+
+u32 spatial_alloc_entry(Spatial_Hash* hash)
+{
+	if (hash->free_head)
+	{
+		u32 index = hash->free_head;
+		hash->free_head = hash->entries[index].next;
+		return index;
+	}
+
+	if (hash->entry_num == 0)
+		hash->entry_num = 1;
+
+	if (hash->entry_num >= hash->entry_max)
+	{
+		// Realloc can usually grow big arrays in place, without a second copy
+		spatial_own(hash);
+		u32 new_max = hash->entry_max == 0 ? 64 : (hash->entry_max << 1);
+		hash->entries = realloc(hash->entries, sizeof(Spatial_Entry) * new_max);
+		assert(hash->entries != NULL);
+
+		hash->entry_max = new_max;
+	}
+
+	return hash->entry_num++;
+}
+
+void spatial_free(Spatial_Hash* hash)
+{
+	// Mapped arrays go with the file
+	if (hash->buckets && !hash->mapped)
+		free(hash->buckets);
+	if (hash->entries && !hash->mapped)
+		free(hash->entries);
+
+	zero_t(*hash);
+}
+
+void spatial_insert(Spatial_Hash* hash, Rect bbox, u32 thing)
+{
+	for(i32 y=bbox.min.y; y<=bbox.max.y; ++y)
+	{
+		for(i32 x=bbox.min.x; x<=bbox.max.x; ++x)
+		{
+			// Keep the load factor at or below 1
+			if (hash->count >= hash->bucket_max)
+				spatial_rehash(hash, hash->bucket_max == 0 ? 64 : (hash->bucket_max << 1));
+
+			u32 index = spatial_alloc_entry(hash);
+			Spatial_Entry* entry = &hash->entries[index];
+			entry->cell = point(x, y);
+			entry->thing = thing;
+
+			u32 bucket = spatial_bucket(hash, entry->cell);
+			entry->next = hash->buckets[bucket];
+			hash->buckets[bucket] = index;
+
+			hash->count++;
+		}
+	}
+}
+
+void spatial_remove(Spatial_Hash* hash, Rect bbox, u32 thing)
+{
+	if (hash->bucket_max == 0)
+		return;
+
+	for(i32 y=bbox.min.y; y<=bbox.max.y; ++y)
+	{
+		for(i32 x=bbox.min.x; x<=bbox.max.x; ++x)
+		{
+			Point cell = point(x, y);
+			u32* link = &hash->buckets[spatial_bucket(hash, cell)];
+
+			while(*link)
+			{
+				Spatial_Entry* entry = &hash->entries[*link];
+				if (entry->thing == thing && point_eq(entry->cell, cell))
+				{
+					u32 index = *link;
+					*link = entry->next;
+
+					entry->thing = SPATIAL_FREE;
+					entry->next = hash->free_head;
+					hash->free_head = index;
+
+					hash->count--;
+					break;
+				}
+
+				link = &entry->next;
+			}
+		}
+	}
+}
+
+u32 spatial_seek(Spatial_Hash* hash, u32 index, Point cell)
+{
+	while(index && !point_eq(hash->entries[index].cell, cell))
+		index = hash->entries[index].next;
+
+	return index;
+}
+
+u32 spatial_first(Spatial_Hash* hash, Point cell)
+{
+	if (hash->bucket_max == 0)
+		return 0;
+
+	return spatial_seek(hash, hash->buckets[spatial_bucket(hash, cell)], cell);
+}
+
+u32 spatial_next(Spatial_Hash* hash, u32 entry)
+{
+	return spatial_seek(hash, hash->entries[entry].next, hash->entries[entry].cell);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Spatial hash
+// Maps cells to the indices of the things covering them, things bigger than one cell
+// (chips) have one entry for every cell they cover.
+typedef struct
+{
+	Point cell;
+	u32 thing;
+
+	// Next entry in the same bucket (or free list), 0 ends the chain
+	u32 next;
+} Spatial_Entry;
+
+typedef struct
+{
+	u32* buckets;
+	u32 bucket_max;
+
+	// Entries are 1-indexed, entry 0 is never used
+	Spatial_Entry* entries;
+	u32 entry_num;
+	u32 entry_max;
+	u32 free_head;
+
+	u32 count;
+
+	// Buckets and entries point into a mapped file, they're copied before they grow
+	bool mapped;
+} Spatial_Hash;
+
+void spatial_free(Spatial_Hash* hash);
+void spatial_insert(Spatial_Hash* hash, Rect bbox, u32 thing);
+void spatial_remove(Spatial_Hash* hash, Rect bbox, u32 thing);
+
+// Iterate all entries in a cell, returns 0 when there are no more entries
+u32 spatial_first(Spatial_Hash* hash, Point cell);
+u32 spatial_next(Spatial_Hash* hash, u32 entry);
+inline u32 spatial_thing(Spatial_Hash* hash, u32 entry) { return hash->entries[entry].thing; }
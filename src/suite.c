@@ -0,0 +1,403 @@
+#include "suite.h"
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+extern u32 tic_pop_count;
+
+Suite_Workload suite_workloads[] =
+{
+	{ "ripple_adder", suite_build_adder, 8 },
+	{ "ripple_adder", suite_build_adder, 64 },
+	{ "ripple_adder", suite_build_adder, 256 },
+	{ "ripple_adder", suite_build_adder, 1024 },
+	{ "ring_oscillators", suite_build_rings, 10000 },
+	{ "lfsr32", suite_build_lfsrs, 256 },
+	{ "counter_chain", suite_build_counters, 64 },
+	{ "chip_hierarchy", suite_build_hierarchy, 10 },
+	{ "fan_out_bus", suite_build_bus, 100000 },
+};
+
+// Wires node into the net of from, through a node of the net that has a connection to spare
+void suite_connect(Circuit* circ, Node* from, Node* node)
+{
+	while(true)
+	{
+		for(u32 i=0; i<4; ++i)
+		{
+			if (!node_get(circ, from->connections[i]))
+			{
+				node_connect(circ, from, node);
+				return;
+			}
+		}
+
+		// The last connection was made last, so it leads away from where we came from
+		from = node_get(circ, from->connections[3]);
+	}
+}
+
+// Takes up 3x1 cells, the input node, the inverter and the output node
+Node* suite_not(Circuit* circ, Point pos, Node* in)
+{
+	suite_connect(circ, in, node_create(circ, pos));
+	inverter_create(circ, point_add(pos, point(1, 0)));
+	return node_create(circ, point_add(pos, point(2, 0)));
+}
+
+// Two inverters driving the same net, which is on when either of them is. Takes up 3x2 cells
+Node* suite_nand(Circuit* circ, Point pos, Node* a, Node* b)
+{
+	Node* out = suite_not(circ, pos, a);
+	node_connect(circ, out, suite_not(circ, point_add(pos, point(0, 1)), b));
+	return out;
+}
+
+// Takes up 12x2 cells
+Node* suite_xor(Circuit* circ, Point pos, Node* a, Node* b)
+{
+	Node* both = suite_nand(circ, pos, a, b);
+	Node* not_b = suite_nand(circ, point_add(pos, point(3, 0)), a, both);
+	Node* not_a = suite_nand(circ, point_add(pos, point(6, 0)), b, both);
+	return suite_nand(circ, point_add(pos, point(9, 0)), not_b, not_a);
+}
+
+// Nine nands, takes up 27x2 cells
+Node* suite_full_adder(Circuit* circ, Point pos, Node* a, Node* b, Node* carry_in, Node** carry_out)
+{
+	Node* ab = suite_nand(circ, pos, a, b);
+	Node* half = suite_nand(circ, point_add(pos, point(9, 0)),
+		suite_nand(circ, point_add(pos, point(3, 0)), a, ab),
+		suite_nand(circ, point_add(pos, point(6, 0)), b, ab));
+
+	Node* hc = suite_nand(circ, point_add(pos, point(12, 0)), half, carry_in);
+	Node* sum = suite_nand(circ, point_add(pos, point(21, 0)),
+		suite_nand(circ, point_add(pos, point(15, 0)), half, hc),
+		suite_nand(circ, point_add(pos, point(18, 0)), carry_in, hc));
+
+	*carry_out = suite_nand(circ, point_add(pos, point(24, 0)), ab, hc);
+	return sum;
+}
+
+// A delay between two nodes, q takes on d one tic later. Takes up 3x1 cells
+Node* suite_register(Circuit* circ, Point pos, Node** d)
+{
+	*d = node_create(circ, pos);
+	delay_create(circ, point_add(pos, point(1, 0)));
+	return node_create(circ, point_add(pos, point(2, 0)));
+}
+
+// An inverter with nothing in front of it is always on, returns the node it drives
+Node* suite_high(Circuit* circ, Point pos)
+{
+	inverter_create(circ, pos);
+	return node_create(circ, point_add(pos, point(1, 0)));
+}
+
+// Every bit adds two rings of different lengths, so carries ripple through all the time
+void suite_build_adder(Circuit* circ, u32 width)
+{
+	Node* carry = node_create(circ, point(32, 0));
+	for(u32 i=0; i<width; ++i)
+	{
+		Point a_pos = point(0, i * 2);
+		Point b_pos = point(18, i * 2);
+		bench_place_ring(circ, a_pos, i % 7 + 1);
+		bench_place_ring(circ, b_pos, i % 5 + 1);
+
+		suite_full_adder(circ, point(34, i * 2), node_find(circ, a_pos), node_find(circ, b_pos), carry, &carry);
+	}
+}
+
+void suite_build_rings(Circuit* circ, u32 ring_num)
+{
+	u32 cols = 1;
+	while(cols * cols < ring_num)
+		cols++;
+
+	for(u32 i=0; i<ring_num; ++i)
+		bench_place_ring(circ, point((i % cols) * 20, (i / cols) * 3), i % 8 + 1);
+}
+
+// Fibonacci LFSRs with taps 32, 22, 2 and 1. The feedback is inverted, so all zeroes is a valid start
+void suite_build_lfsrs(Circuit* circ, u32 lfsr_num)
+{
+	for(u32 l=0; l<lfsr_num; ++l)
+	{
+		i32 y = l * 4;
+		Node* d[32];
+		Node* q[32];
+		for(u32 i=0; i<32; ++i)
+		{
+			q[i] = suite_register(circ, point(i * 3, y), &d[i]);
+			if (i > 0)
+				suite_connect(circ, q[i - 1], d[i]);
+		}
+
+		Node* taps = suite_xor(circ, point(0, y + 2), q[31], q[21]);
+		taps = suite_xor(circ, point(12, y + 2), taps, q[1]);
+		taps = suite_xor(circ, point(24, y + 2), taps, q[0]);
+		suite_connect(circ, suite_not(circ, point(36, y + 2), taps), d[0]);
+	}
+}
+
+// Synchronous 16 bit counters, every one counting up when the one before it wraps around
+void suite_build_counters(Circuit* circ, u32 counter_num)
+{
+	Node* carry = suite_high(circ, point(-3, 0));
+	for(u32 k=0; k<counter_num * 16; ++k)
+	{
+		i32 x = (k % 16) * 18;
+		i32 y = (k / 16) * 2;
+
+		Node* d;
+		Node* q = suite_register(circ, point(x, y), &d);
+
+		// d = q xor carry, the carry moves on if both are on
+		Node* both = suite_nand(circ, point(x + 3, y), q, carry);
+		Node* not_carry = suite_nand(circ, point(x + 6, y), q, both);
+		Node* not_q = suite_nand(circ, point(x + 9, y), carry, both);
+		suite_connect(circ, suite_nand(circ, point(x + 12, y), not_carry, not_q), d);
+		carry = suite_not(circ, point(x + 15, y), both);
+	}
+}
+
+// A level is a public input, two chips of the level below in a row and an inverter to the public output
+void suite_build_level(Circuit* circ, u32 depth)
+{
+	Node* in = node_create(circ, point(0, 0));
+	node_toggle_public(circ, in);
+
+	Node* prev = in;
+	for(u32 i=0; depth > 0 && i<2; ++i)
+	{
+		Chip* chip = chip_create(circ, point(2 + i * 6, 0));
+		suite_build_level(chip_circuit(circ, chip), depth - 1);
+		chip_update(circ, chip);
+
+		suite_connect(circ, prev, node_get(circ, chip->link_nodes[0]));
+		prev = node_get(circ, chip->link_nodes[1]);
+	}
+
+	node_toggle_public(circ, suite_not(circ, point(12, 0), prev));
+}
+
+// Levels of chips in chips, driven by a ring
+void suite_build_hierarchy(Circuit* circ, u32 depth)
+{
+	suite_build_level(circ, depth);
+
+	bench_place_ring(circ, point(0, 6), 2);
+	suite_connect(circ, node_find(circ, point(0, 6)), node_find(circ, point(0, 0)));
+}
+
+// A ring driving one long net, every node of it is read by an inverter
+void suite_build_bus(Circuit* circ, u32 fan_out)
+{
+	bench_place_ring(circ, point(0, 0), 1);
+
+	Node* prev = node_find(circ, point(0, 0));
+	for(u32 i=0; i<fan_out; ++i)
+	{
+		Node* node = node_create(circ, point(8, i));
+		node_connect(circ, prev, node);
+		inverter_create(circ, point(9, i));
+		node_create(circ, point(10, i));
+		prev = node;
+	}
+}
+
+// Things in the circuit and every chip circuit in it
+u32 suite_thing_count(Circuit* circ, u32* chip_num)
+{
+	u32 count = circ->thing_num;
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		(*chip_num)++;
+		count += suite_thing_count(chip_circuit(circ, (Chip*)it), chip_num);
+	}
+
+	return count;
+}
+
+#ifdef _WIN32
+// Windows can't reset the peak, so there it's the peak of the whole run so far
+u64 suite_memory(bool peak)
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+}
+
+void suite_reset_peak_memory()
+{
+}
+#else
+u64 suite_memory(bool peak)
+{
+	const char* field = peak ? "VmHWM:" : "VmRSS:";
+	u64 kb = 0;
+
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file)
+	{
+		char line[256];
+		while(fgets(line, sizeof(line), file))
+		{
+			if (strncmp(line, field, strlen(field)) == 0)
+			{
+				kb = strtoull(line + strlen(field), NULL, 10);
+				break;
+			}
+		}
+
+		fclose(file);
+	}
+
+	// No procfs, the peak of the whole run is the best there is
+	if (kb == 0)
+	{
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		kb = usage.ru_maxrss;
+	}
+
+	return kb * 1024;
+}
+
+// Writing 5 to clear_refs sets the peak back to what's resident now
+void suite_reset_peak_memory()
+{
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (file)
+	{
+		fputs("5", file);
+		fclose(file);
+	}
+}
+#endif
+
+void suite_measure(FILE* out, Suite_Workload* workload)
+{
+	suite_reset_peak_memory();
+	u64 base_memory = suite_memory(false);
+
+	d32 begin = bench_time();
+	Circuit* circ = circuit_make("SUITE");
+	workload->build(circ, workload->size);
+	d32 edit_time = bench_time() - begin;
+
+	u32 chip_num = 0;
+	u32 thing_num = suite_thing_count(circ, &chip_num);
+
+	// Events first, building left everything dirty and the first tic cleans all of it
+	u32 start_tic = tic;
+	while(tic == start_tic && circ->dirty_queues[circ->queue_index].count != 0)
+		circuit_subtic(circ);
+
+	u32 event_tic_num = 0;
+	u32 pop_begin = tic_pop_count;
+	begin = bench_time();
+	while(event_tic_num < SUITE_MAX_EVENT_TICS && bench_time() - begin < SUITE_MIN_SECONDS)
+	{
+		// Nothing is dirty, nothing will ever happen again
+		if (circ->dirty_queues[circ->queue_index].count == 0)
+			break;
+
+		start_tic = tic;
+		while(tic == start_tic && circ->dirty_queues[circ->queue_index].count != 0)
+			circuit_subtic(circ);
+
+		event_tic_num++;
+	}
+	u32 event_num = tic_pop_count - pop_begin;
+
+	// Then the netlist, compiled from where the events left off
+	Netlist* netlist = &circ->netlist;
+	begin = bench_time();
+	netlist_compile(netlist, circ);
+	d32 compile_time = bench_time() - begin;
+
+	u32 tic_num = 0;
+	u64 eval_begin = netlist->eval_count;
+	begin = bench_time();
+	d32 elapsed = 0.0;
+	while(elapsed < SUITE_MIN_SECONDS)
+	{
+		circuit_tic(circ);
+		tic_num++;
+		elapsed = bench_time() - begin;
+	}
+
+	u64 eval_num = netlist->eval_count - eval_begin;
+	u64 peak_memory = suite_memory(true);
+
+	fprintf(out, "    {\n");
+	fprintf(out, "      \"name\": \"%s\",\n", workload->name);
+	fprintf(out, "      \"size\": %u,\n", workload->size);
+	fprintf(out, "      \"things\": %u,\n", thing_num);
+	fprintf(out, "      \"chips\": %u,\n", chip_num);
+	fprintf(out, "      \"edit_seconds\": %.6f,\n", edit_time);
+	fprintf(out, "      \"edit_ns_per_thing\": %.1f,\n", thing_num ? edit_time * 1000000000.0 / thing_num : 0.0);
+	fprintf(out, "      \"compile_seconds\": %.6f,\n", compile_time);
+	fprintf(out, "      \"gates\": %u,\n", netlist->gate_num);
+	fprintf(out, "      \"islands\": %u,\n", netlist->island_num);
+	fprintf(out, "      \"tics\": %u,\n", tic_num);
+	fprintf(out, "      \"tics_per_second\": %.1f,\n", tic_num / elapsed);
+	fprintf(out, "      \"gate_evals_per_tic\": %.1f,\n", (d32)eval_num / tic_num);
+	fprintf(out, "      \"event_tics\": %u,\n", event_tic_num);
+	fprintf(out, "      \"events_per_tic\": %.1f,\n", event_tic_num ? (d32)event_num / event_tic_num : 0.0);
+	fprintf(out, "      \"base_memory_bytes\": %llu,\n", (unsigned long long)base_memory);
+	fprintf(out, "      \"peak_memory_bytes\": %llu\n", (unsigned long long)peak_memory);
+	fprintf(out, "    }");
+
+	circuit_clear(circ);
+	circuit_free(circ);
+}
+
+void suite_run(i32 argc, char** argv)
+{
+	FILE* out = stdout;
+	if (argc > 0)
+	{
+		out = fopen(argv[0], "w");
+		if (!out)
+		{
+			printf("suite: can't open %s\n", argv[0]);
+			return;
+		}
+	}
+
+	u32 workload_num = sizeof(suite_workloads) / sizeof(Suite_Workload);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"suite\": \"reference\",\n");
+	fprintf(out, "  \"version\": 1,\n");
+	fprintf(out, "  \"min_seconds\": %.2f,\n", SUITE_MIN_SECONDS);
+	fprintf(out, "  \"workloads\": [\n");
+	for(u32 i=0; i<workload_num; ++i)
+	{
+		// Progress only goes to the console when the results don't
+		if (out != stdout)
+			printf("suite: %s %u\n", suite_workloads[i].name, suite_workloads[i].size);
+
+		suite_measure(out, &suite_workloads[i]);
+		fprintf(out, i + 1 < workload_num ? ",\n" : "\n");
+		fflush(out);
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+
+	if (out != stdout)
+		fclose(out);
+}
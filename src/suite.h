@@ -0,0 +1,41 @@
+#pragma once
+#include "circuit.h"
+
+// Reference suite
+// Builds a fixed set of reference circuits through the same calls the editor makes, and measures
+// every one of them: how long building it took, how fast the netlist tics it, how many events a tic
+// takes on the event-driven engine and how much memory it all peaked at. The results are written as
+// JSON, to compare runs on different machines or commits.
+// Run with 'game.exe -suite [file.json]' or 'build/sim -suite [file.json]', without a file it goes to stdout
+#define SUITE_MIN_SECONDS 0.5
+#define SUITE_MAX_EVENT_TICS 256
+
+typedef void (*Suite_Build_Proc)(Circuit* circ, u32 size);
+
+typedef struct
+{
+	const char* name;
+	Suite_Build_Proc build;
+	u32 size;
+} Suite_Workload;
+
+// Gates, every one returns its output node and wires its inputs into the nets of the given nodes
+Node* suite_not(Circuit* circ, Point pos, Node* in);
+Node* suite_nand(Circuit* circ, Point pos, Node* a, Node* b);
+Node* suite_xor(Circuit* circ, Point pos, Node* a, Node* b);
+Node* suite_full_adder(Circuit* circ, Point pos, Node* a, Node* b, Node* carry_in, Node** carry_out);
+Node* suite_register(Circuit* circ, Point pos, Node** d);
+
+// Workloads, size is what's scaled: bits, rings, registers or levels
+void suite_build_adder(Circuit* circ, u32 width);
+void suite_build_rings(Circuit* circ, u32 ring_num);
+void suite_build_lfsrs(Circuit* circ, u32 lfsr_num);
+void suite_build_counters(Circuit* circ, u32 counter_num);
+void suite_build_hierarchy(Circuit* circ, u32 depth);
+void suite_build_bus(Circuit* circ, u32 fan_out);
+
+// Resident memory of the process in bytes, its peak since the last reset or what it is now
+u64 suite_memory(bool peak);
+void suite_reset_peak_memory();
+
+void suite_run(i32 argc, char** argv);
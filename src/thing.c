@@ -1,6 +1,10 @@
 #include "thing.h"
 #include "circuit.h"
 #include "tic.h"
+#include "net.h"
+#include "netlist.h"
+#include "rewind.h"
+#include "mapfile.h"
 
 Thing_Type_Data type_data[] =
 {
@@ -39,6 +43,34 @@ bool id_null(Thing_Id id)
 	return false;
 }
 
+// Files only have 16 bits for a generation, wrap them around without ever hitting 0 (null)
+u16 id_record_generation(u32 generation)
+{
+	if (generation == 0)
+		return 0;
+
+	return (u16)((generation - 1) % 0xFFFF + 1);
+}
+
+Thing_Id_Record id_to_record(Thing_Id id)
+{
+	// The legacy format can't address more things than that, only circuit_fwrite still writes it
+	assert(id.index <= 0xFFFF);
+
+	Thing_Id_Record record;
+	record.generation = id_record_generation(id.generation);
+	record.index = (u16)id.index;
+	return record;
+}
+
+Thing_Id id_from_record(Thing_Id_Record record)
+{
+	Thing_Id id;
+	id.generation = record.generation;
+	id.index = record.index;
+	return id;
+}
+
 u8 get_direction(Point from, Point to)
 {
 	if (from.y == to.y)
@@ -56,54 +88,224 @@ u8 get_direction(Point from, Point to)
 }
 
 /* THINGS */
+#ifdef _MSC_VER
+#include <intrin.h>
+u32 bit_highest(u32 bits)
+{
+	unsigned long index;
+	_BitScanReverse(&index, bits);
+	return index;
+}
+#else
+#define bit_highest(bits) ((u32)(31 - __builtin_clz(bits)))
+#endif
+
+u32 thing_page_size(u32 page)
+{
+	return page == 0 ? (1 << THING_PAGE_SHIFT) : (1 << (THING_PAGE_SHIFT + page - 1));
+}
+
+// Pages after the first start at a power of two, which is also their size
+u32 thing_page(u32 index)
+{
+	return bit_highest(index | ((1 << THING_PAGE_SHIFT) - 1)) + 1 - THING_PAGE_SHIFT;
+}
+
+Thing* thing_at(Circuit* circ, u32 index)
+{
+	u32 page = thing_page(index);
+	return &circ->thing_pages[page][index & (thing_page_size(page) - 1)];
+}
+
+// Grows an array indexed by thing index, the new elements are zeroed.
+// Realloc can usually grow big arrays in place, without a second copy
+void* things_array_grow(void* prev, u32 elem_size, u32 prev_num, u32 num)
+{
+	u8* arr = realloc(prev, (u64)elem_size * num);
+	assert(arr != NULL);
+
+	mem_zero(arr + (u64)elem_size * prev_num, (u64)elem_size * (num - prev_num));
+	return arr;
+}
+
 void things_reserve(Circuit* circ, u32 num)
 {
 	if (circ->thing_max >= num)
 		return;
 
-	Thing* prev_things = circ->things;
-
-	circ->things = malloc(sizeof(Thing) * num);
-	mem_zero(circ->things, sizeof(Thing) * num);
+	// Shared layouts are immutable
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
 
-	if (prev_things)
+	// New pages are only written when their things get created
+	u32 prev_max = circ->thing_max;
+	while(circ->thing_max < num)
 	{
-		memcpy(circ->things, prev_things, sizeof(Thing) * circ->thing_max);
-		free(prev_things);
+		assert(circ->page_num < THING_PAGE_MAX);
+		circ->thing_pages[circ->page_num] = malloc(sizeof(Thing) * thing_page_size(circ->page_num));
+		circ->thing_max += thing_page_size(circ->page_num);
+		circ->page_num++;
 	}
 
-	circ->thing_max = num;
+	num = circ->thing_max;
+	circ->thing_flags = things_array_grow(circ->thing_flags, sizeof(u8), prev_max, num);
+	circ->thing_tics = things_array_grow(circ->thing_tics, sizeof(u32), prev_max, num);
+	circ->thing_nets = things_array_grow(circ->thing_nets, sizeof(Net_Id), prev_max, num);
+	circ->thing_epochs = things_array_grow(circ->thing_epochs, sizeof(u32), prev_max, num);
+	circ->thing_circuits = things_array_grow(circ->thing_circuits, sizeof(Circuit*), prev_max, num);
+
 	log("RESERVE %d", num);
 }
 
-Thing* thing_create(Circuit* circ, u8 type, Point pos)
+// Fills the pages of an empty circuit with num things stored the way they are in memory. Pages the
+// things fill up point right at them and keep the file mapped, the rest is copied. Without a file
+// everything is copied
+void things_map(Circuit* circ, Thing* things, u32 num, Mapped_File* file)
 {
-	Thing* thing = NULL;
-	for(u32 i=0; i<circ->thing_max; ++i)
+	assert(circ->page_num == 0);
+
+	u32 start = 0;
+	while(file && circ->page_num < THING_PAGE_MAX && start + thing_page_size(circ->page_num) <= num)
+	{
+		circ->thing_pages[circ->page_num] = things + start;
+		start += thing_page_size(circ->page_num);
+		circ->page_num++;
+	}
+
+	if (circ->page_num)
+	{
+		circ->map = file;
+		circ->mapped_pages = circ->page_num;
+		mapped_file_retain(file);
+	}
+
+	// Instance state is never mapped
+	circ->thing_max = start;
+	things_alloc_state(circ);
+	things_reserve(circ, num);
+
+	for(u32 p=circ->mapped_pages; start<num; ++p)
+	{
+		u32 size = min(num - start, thing_page_size(p));
+		memcpy(circ->thing_pages[p], things + start, sizeof(Thing) * size);
+		start += size;
+	}
+}
+
+// Gives the circuit its own copy of the pages it's pointing to
+void things_copy_pages(Circuit* circ)
+{
+	u32 left = circ->thing_num;
+	for(u32 p=0; p<circ->page_num; ++p)
+	{
+		u32 size = thing_page_size(p);
+		Thing* page = malloc(sizeof(Thing) * size);
+		memcpy(page, circ->thing_pages[p], sizeof(Thing) * min(left, size));
+		circ->thing_pages[p] = page;
+		left -= min(left, size);
+	}
+
+	// Whoever the pages were copied from keeps the file mapped
+	circ->map = NULL;
+	circ->mapped_pages = 0;
+}
+
+void things_free_pages(Circuit* circ)
+{
+	for(u32 p=circ->mapped_pages; p<circ->page_num; ++p)
+		free(circ->thing_pages[p]);
+
+	if (circ->map)
+		mapped_file_release(circ->map);
+}
+
+// Free slots are chained through the data of the deleted things
+u32* thing_free_next(Thing* thing)
+{
+	return (u32*)thing->data;
+}
+
+// Chains up every deleted slot below thing_num again, lowest index first
+void things_rebuild_free(Circuit* circ)
+{
+	circ->free_slot = 0;
+	for(u32 i=circ->thing_num; i>0; --i)
 	{
-		if (circ->things[i].valid)
+		Thing* thing = thing_at(circ, i - 1);
+		if (thing->valid)
 			continue;
 
-		thing = &circ->things[i];
-		break;
+		*thing_free_next(thing) = circ->free_slot;
+		circ->free_slot = i;
 	}
+}
+
+void things_alloc_state(Circuit* circ)
+{
+	u32 num = circ->thing_max;
+	circ->thing_flags = things_array_grow(NULL, sizeof(u8), 0, num);
+	circ->thing_tics = things_array_grow(NULL, sizeof(u32), 0, num);
+	circ->thing_nets = things_array_grow(NULL, sizeof(Net_Id), 0, num);
+	circ->thing_epochs = things_array_grow(NULL, sizeof(u32), 0, num);
+	circ->thing_circuits = things_array_grow(NULL, sizeof(Circuit*), 0, num);
+}
 
-	// Uh oh, we've ran out of things
-	if (!thing)
+void things_free_state(Circuit* circ)
+{
+	if (circ->thing_flags)
+		free(circ->thing_flags);
+	if (circ->thing_tics)
+		free(circ->thing_tics);
+	if (circ->thing_nets)
+		free(circ->thing_nets);
+	if (circ->thing_epochs)
+		free(circ->thing_epochs);
+	if (circ->thing_circuits)
+		free(circ->thing_circuits);
+}
+
+Thing* thing_create(Circuit* circ, u8 type, Point pos)
+{
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+
+	// Reuse a deleted slot, otherwise take the next one after all used slots
+	Thing* thing = NULL;
+	if (circ->free_slot)
 	{
-		things_reserve(circ, circ->thing_max == 0 ? 2 : (circ->thing_max << 1));
-		return thing_create(circ, type, pos);
+		thing = thing_at(circ, circ->free_slot - 1);
+		assert(!thing->valid);
+		circ->free_slot = *thing_free_next(thing);
+	}
+	else
+	{
+		// Uh oh, we've ran out of things
+		if (circ->thing_num == circ->thing_max)
+			things_reserve(circ, circ->thing_max == 0 ? 2 : (circ->thing_max << 1));
+
+		thing = thing_at(circ, circ->thing_num);
+		thing->index = circ->thing_num++;
 	}
 
+	u32 index = thing->index;
+	mem_zero(thing, sizeof(Thing));
+	thing->index = index;
+
+	// Generations are 32 bit and never reused, so an id of a deleted thing can't match a new one
 	thing->generation = ++circ->gen_num;
 	thing->type = type;
 	thing->valid = true;
 	thing->pos = pos;
 	thing->size = point(1, 1);
 
-	u32 index = thing - circ->things;
-	if (index >= circ->thing_num)
-		circ->thing_num = index + 1;
+	circ->thing_flags[index] = 0;
+	circ->thing_tics[index] = 0;
+	zero_t(circ->thing_nets[index]);
+	circ->thing_epochs[index] = 0;
+	circ->thing_circuits[index] = NULL;
+
+	spatial_insert(&circ->spatial, thing_get_bbox(thing), index);
+	circuit_invalidate_netlist(circ);
 
 	// Created things are always dirty
 	thing_set_dirty(circ, thing);
@@ -113,29 +315,54 @@ Thing* thing_create(Circuit* circ, u8 type, Point pos)
 
 void thing_delete(Circuit* circ, Thing* thing)
 {
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+	assert(thing->valid);
+
 	if (type_data[thing->type].on_delete)
 		type_data[thing->type].on_delete(circ, thing);
 
+	u32 index = thing->index;
+	spatial_remove(&circ->spatial, thing_get_bbox(thing), index);
+	circuit_invalidate_netlist(circ);
+
 	mem_zero(thing, sizeof(Thing));
+	thing->index = index;
+	circ->thing_flags[index] = 0;
+	circ->thing_tics[index] = 0;
+	zero_t(circ->thing_nets[index]);
+	circ->thing_epochs[index] = 0;
+	circ->thing_circuits[index] = NULL;
+
+	*thing_free_next(thing) = circ->free_slot;
+	circ->free_slot = index + 1;
 }
 
 Thing* thing_find(Circuit* circ, Point pos, u8 type_mask)
 {
-	THINGS_FOREACH(circ, type_mask)
+	Spatial_Hash* hash = &circ->spatial;
+	Thing* found = NULL;
+
+	for(u32 entry = spatial_first(hash, pos); entry; entry = spatial_next(hash, entry))
 	{
-		if (point_in_rect(pos, thing_get_bbox(it)))
-			return it;
+		Thing* thing = thing_at(circ, spatial_thing(hash, entry));
+		if (!thing->valid || !(thing->type & type_mask))
+			continue;
+
+		// Things can overlap mid-merge, return the first one like a linear search would
+		if (!found || thing->index < found->index)
+			found = thing;
 	}
 
-	return NULL;
+	return found;
 }
 
 Thing* thing_get(Circuit* circ, Thing_Id id)
 {
-	if (id.generation == 0)
+	if (id.generation == 0 || id.index >= circ->thing_num)
 		return NULL;
 
-	Thing* thing = &circ->things[id.index];
+	Thing* thing = thing_at(circ, id.index);
 	if (!thing->valid)
 		return NULL;
 
@@ -155,41 +382,75 @@ Thing_Id thing_id(Circuit* circ, Thing* thing)
 	}
 	else
 	{
-		id.index = thing - circ->things;
+		id.index = thing->index;
 		id.generation = thing->generation;
 	}
 
 	return id;
 }
 
-bool _thing_it_inc(Circuit* circ, Thing** thing, u8 type_mask)
+Thing* _thing_it_next(Circuit* circ, u32 index, u8 type_mask)
 {
-	if (*thing == NULL)
-		return false;
-
-	u32 index = *thing - circ->things;
+	// Walk the rest of a page directly, only look up the next page when crossing into it
 	while(index < circ->thing_num)
 	{
-		if ((*thing)->valid && ((*thing)->type & type_mask))
-			return true;
+		Thing* thing = thing_at(circ, index);
+		u32 page_end = (index | (thing_page_size(thing_page(index)) - 1)) + 1;
+		u32 end = min(page_end, circ->thing_num);
 
-		(*thing)++;
-		index++;
+		for(; index < end; ++index, ++thing)
+		{
+			if (thing->valid && (thing->type & type_mask))
+				return thing;
+		}
 	}
 
-	return false;
+	return NULL;
 }
 
 u32 things_find(Circuit* circ, Rect rect, Thing** out_arr, u32 arr_size)
 {
 	u32 index = 0;
-	THINGS_FOREACH(circ, THING_All)
+
+	// For huge rects, just testing every thing is cheaper than probing every cell
+	u64 area = (u64)(rect.max.x - rect.min.x + 1) * (u64)(rect.max.y - rect.min.y + 1);
+	if (area > circ->thing_num)
 	{
-		if (rect_rect_intersect(thing_get_bbox(it), rect))
-			out_arr[index++] = it;
+		THINGS_FOREACH(circ, THING_All)
+		{
+			if (rect_rect_intersect(thing_get_bbox(it), rect))
+				out_arr[index++] = it;
 
-		if (index >= arr_size)
-			break;
+			if (index >= arr_size)
+				break;
+		}
+
+		return index;
+	}
+
+	Spatial_Hash* hash = &circ->spatial;
+	for(i32 y=rect.min.y; y<=rect.max.y; ++y)
+	{
+		for(i32 x=rect.min.x; x<=rect.max.x; ++x)
+		{
+			Point cell = point(x, y);
+			for(u32 entry = spatial_first(hash, cell); entry; entry = spatial_next(hash, entry))
+			{
+				Thing* thing = thing_at(circ, spatial_thing(hash, entry));
+				if (!thing->valid)
+					continue;
+
+				// Things covering several cells are only reported in the first cell they overlap the rect with
+				Rect bbox = thing_get_bbox(thing);
+				Point first = point(max(bbox.min.x, rect.min.x), max(bbox.min.y, rect.min.y));
+				if (!point_eq(first, cell))
+					continue;
+
+				out_arr[index++] = thing;
+				if (index >= arr_size)
+					return index;
+			}
+		}
 	}
 
 	return index;
@@ -208,17 +469,35 @@ Rect thing_get_bbox(Thing* thing)
 	return rect(thing->pos, point_add(thing->pos, point_add(thing->size, point(-1, -1))));
 }
 
-bool thing_flag_get(Thing* thing, u8 flag)
+void thing_resize(Circuit* circ, Thing* thing, Point size)
+{
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
+
+	u32 index = thing->index;
+
+	spatial_remove(&circ->spatial, thing_get_bbox(thing), index);
+	thing->size = size;
+	spatial_insert(&circ->spatial, thing_get_bbox(thing), index);
+}
+
+u32 thing_index(Circuit* circ, Thing* thing)
+{
+	return thing->index;
+}
+
+bool thing_flag_get(Circuit* circ, Thing* thing, u8 flag)
 {
-	return !!(thing->flags & flag);
+	return !!(circ->thing_flags[thing->index] & flag);
 }
 
-void thing_flag_set(Thing* thing, u8 flag, bool value)
+void thing_flag_set(Circuit* circ, Thing* thing, u8 flag, bool value)
 {
+	u8* flags = &circ->thing_flags[thing->index];
 	if (value)
-		thing->flags |= flag;
+		*flags |= flag;
 	else
-		thing->flags &= ~flag;
+		*flags &= ~flag;
 }
 
 /* NODES */
@@ -236,6 +515,7 @@ Node* node_create(Circuit* circ, Point pos)
 {
 	assert(sizeof(Node) <= sizeof(Thing));
 	Node* node = (Node*)thing_create(circ, THING_Node, pos);
+	node_update_driven(circ, node);
 
 	// Dirty up close-by inverters
 	Inverter* inv = inverter_find(circ, point_sub(pos, point(1, 0)));
@@ -247,14 +527,19 @@ Node* node_create(Circuit* circ, Point pos)
 
 void node_on_deleted(Circuit* circ, Node* node)
 {
+	Thing_Id node_id = thing_id(circ, (Thing*)node);
 	node->valid = false;
+	node_break_net(circ, node);
 
 	// Deleting node will dirty its connections!
 	for(u32 i=0; i<4; ++i)
 	{
 		Node* other = node_get(circ, node->connections[i]);
-		if (other)
-			thing_set_dirty(circ, (Thing*)other);
+		if (!other)
+			continue;
+
+		wire_remove(&circ->wires, node->pos, other->pos, node_id, node->connections[i]);
+		thing_set_dirty(circ, (Thing*)other);
 	}
 
 	// Also dirty whatever this node may be sourcing
@@ -263,30 +548,64 @@ void node_on_deleted(Circuit* circ, Node* node)
 
 void node_on_merge(Circuit* circ, Node* node, Node* other)
 {
+	Thing_Id node_id = thing_id(circ, (Thing*)node);
+
 	// When merging nodes, merge the connections!
 	for(u32 other_index = 0; other_index < 4; ++other_index)
 	{
-		// Not a valid connection, skip..
-		if (id_null(other->connections[other_index]))
+		Thing_Id connection = other->connections[other_index];
+
+		// Not a valid connection, or one back to us, skip..
+		if (id_null(connection) || id_eq(connection, node_id))
 			continue;
 
+		// Take the first free slot, unless we're already connected
+		u32 free_index = 4;
 		for(u32 our_index = 0; our_index < 4; ++our_index)
 		{
-			// Cant copy into this slot! Its busy!
-			if (!id_null(node->connections[our_index]))
-				continue;
+			if (id_eq(node->connections[our_index], connection))
+			{
+				free_index = 4;
+				break;
+			}
 
-			node->connections[our_index] = other->connections[other_index];
+			if (free_index == 4 && id_null(node->connections[our_index]))
+				free_index = our_index;
 		}
+
+		if (free_index < 4)
+			node->connections[free_index] = connection;
+	}
+
+	node_insert_wires(circ, node);
+	node_break_net(circ, node);
+}
+
+// Adds the wires of all connections of a node to the wire index, the ones already in there are skipped
+void node_insert_wires(Circuit* circ, Node* node)
+{
+	Thing_Id node_id = thing_id(circ, (Thing*)node);
+	for(u32 i=0; i<4; ++i)
+	{
+		Node* other = node_get(circ, node->connections[i]);
+		if (other)
+			wire_insert(&circ->wires, node->pos, other->pos, node_id, node->connections[i]);
 	}
 }
 
 void node_connect(Circuit* circ, Node* a, Node* b)
 {
 	assert(a != b);
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
 	Thing_Id a_id = thing_id(circ, (Thing*)a);
 	Thing_Id b_id = thing_id(circ, (Thing*)b);
 
+	// Extract both nets while they aren't connected yet, otherwise extracting b's net
+	// walks through the new connection and collects all of a's net as well
+	node_net(circ, a);
+	node_net(circ, b);
+
 	// First check if there already is a connection in some direction...
 	bool a_conn_b = false;
 	bool b_conn_a = false;
@@ -304,6 +623,7 @@ void node_connect(Circuit* circ, Node* a, Node* b)
 			if (!node_get(circ, a->connections[i]))
 			{
 				a->connections[i] = b_id;
+				a_conn_b = true;
 				break;
 			}
 		}
@@ -317,11 +637,18 @@ void node_connect(Circuit* circ, Node* a, Node* b)
 			if (!node_get(circ, b->connections[i]))
 			{
 				b->connections[i] = a_id;
+				b_conn_a = true;
 				break;
 			}
 		}
 	}
 
+	// Both of them might be out of connection slots
+	if (a_conn_b || b_conn_a)
+		wire_insert(&circ->wires, a->pos, b->pos, a_id, b_id);
+
+	node_union_nets(circ, a, b);
+
 	// After a connection is made, the batch is invalidated
 	// (since a and b are now connected, they will both be made dirty)
 	thing_set_dirty(circ, (Thing*)a);
@@ -330,6 +657,8 @@ void node_connect(Circuit* circ, Node* a, Node* b)
 void node_disconnect(Circuit* circ, Node* a, Node* b)
 {
 	assert(a != b);
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
 	Thing_Id a_id = thing_id(circ, (Thing*)a);
 	Thing_Id b_id = thing_id(circ, (Thing*)b);
 
@@ -340,157 +669,74 @@ void node_disconnect(Circuit* circ, Node* a, Node* b)
 		if (id_eq(b->connections[i], a_id))
 			zero_t(b->connections[i]);
 	}
-}
-
-i32 recurse_num = 0;
-// Check if this node batch contains a powered node
-bool node_batch_contains_power(Circuit* circ, Node* node, i32 recurse_id)
-{
-	if (recurse_id < 0)
-		recurse_id = ++recurse_num;
-
-	if (node->recurse_id == recurse_id)
-		return false;
 
-	node->recurse_id = recurse_id;
+	wire_remove(&circ->wires, a->pos, b->pos, a_id, b_id);
 
-	// Check if the source (left) is powered
-	Thing* src = thing_find(circ, point_add(node->pos, point(-1, 0)), THING_All);
-	if (src && thing_powered(src))
-		return true;
+	// The net might be split in two now, it will be re-extracted when they're cleaned
+	node_break_net(circ, a);
+	thing_set_dirty(circ, (Thing*)a);
+	thing_set_dirty(circ, (Thing*)b);
+}
 
-	// Otherwise, keep searching...
-	for(u32 i=0; i<4; ++i)
-	{
-		Node* other = node_get(circ, node->connections[i]);
-		if (other && node_batch_contains_power(circ, other, recurse_id))
-			return true;
-	}
+void node_on_clean(Circuit* circ, Node* node)
+{
+	// Every node in the net shares the same state, so the first dirty node resolves all of them
+	Net* net = node_net(circ, node);
+	net_resolve(circ, net);
+}
 
-	// Follow links
-	if (node->link_type != LINK_None)
+u32 node_public_slot(Circuit* circ, Node* node)
+{
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
 	{
-		Node* link_node_ptr = NULL;
-		Circuit* link_circ = NULL;
-
-		// Get which circuit to poll
-		if (node->link_type == LINK_Chip)
-		{
-			Chip* chip = chip_get(circ, node->link_chip);
-			assert(chip);
-
-			link_circ = chip->circuit;
-		}
-	 	else
-		{
-			link_circ = circ->parent;
-		}
-
-		// Then poll the link node
-		if (link_circ)
-		{
-			Node* other = node_get(link_circ, node->link_node);
-			if (other && node_batch_contains_power(link_circ, other, recurse_id))
-				return true;
-		}
+		if (node_get(circ, circ->public_nodes[i]) == node)
+			return i;
 	}
 
-	return false;
+	return MAX_PUBLIC_NODES;
 }
 
-// Returns if state was set
-void node_batch_set_state(Circuit* circ, Node* node, bool active, i32 recurse_id)
+void node_set_public(Circuit* circ, Node* node, u32 slot)
 {
-	if (recurse_id < 0)
-		recurse_id = ++recurse_num;
+	assert(!circuit_is_shared(circ));
+	circuit_edited(circ);
 
-	if (node->recurse_id == recurse_id)
+	if (node->link_type == LINK_Chip)
 		return;
 
-	// If the state will change, make output inverters as dirty!
-	if (thing_active(node) != active)
-	{
-		thing_dirty_at(circ, point_add(node->pos, point(1, 0)));
-	}
+	u32 prev_slot = node_public_slot(circ, node);
+	if (prev_slot < MAX_PUBLIC_NODES)
+		zero_t(circ->public_nodes[prev_slot]);
 
-	node->recurse_id = recurse_id;
-	thing_set_active(node, active);
-
-	// Spread the state
-	for(u32 i=0; i<4; ++i)
+	node->link_type = LINK_None;
+	if (slot < MAX_PUBLIC_NODES)
 	{
-		Node* other = node_get(circ, node->connections[i]);
-		if (other)
-			node_batch_set_state(circ, other, active, recurse_id);
+		assert(!node_get(circ, circ->public_nodes[slot]));
+		circ->public_nodes[slot] = thing_id(circ, (Thing*)node);
+		node->link_type = LINK_Public;
 	}
 
-
-	// Follow links
-	if (node->link_type != LINK_None)
-	{
-		Circuit* link_circ = NULL;
-
-		// Get which circuit to poll
-		if (node->link_type == LINK_Chip)
-		{
-			Chip* chip = chip_get(circ, node->link_chip);
-			assert(chip);
-
-			link_circ = chip->circuit;
-		}
-	 	else
-		{
-			link_circ = circ->parent;
-		}
-
-		// Then poll the link node
-		if (link_circ)
-		{
-			Node* other = node_get(link_circ, node->link_node);
-			if (other)
-				node_batch_set_state(link_circ, other, active, recurse_id);
-		}
-	}
-}
-
-void node_on_clean(Circuit* circ, Node* node)
-{
-	bool has_power = node_batch_contains_power(circ, node, -1);
-	node_batch_set_state(circ, node, has_power, -1);
+	node_break_net(circ, node);
+	thing_set_dirty(circ, (Thing*)node);
 }
 
 void node_toggle_public(Circuit* circ, Node* node)
 {
-	if (node->link_type == LINK_Chip)
-		return;
-
 	if (node->link_type == LINK_Public)
 	{
-		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
-		{
-			if (node_get(circ, circ->public_nodes[i]) == node)
-			{
-				zero_t(circ->public_nodes[i]);
-				break;
-			}
-		}
-
-		node->link_type = LINK_None;
+		node_set_public(circ, node, MAX_PUBLIC_NODES);
+		return;
 	}
-	else
+
+	// Take the first free slot, if there is one
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
 	{
-		for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		if (!node_get(circ, circ->public_nodes[i]))
 		{
-			if (node_get(circ, circ->public_nodes[i]))
-				continue;
-
-			circ->public_nodes[i] = thing_id(circ, (Thing*)node);
-			node->link_type = LINK_Public;
-			break;
+			node_set_public(circ, node, i);
+			return;
 		}
 	}
-
-	thing_set_dirty(circ, (Thing*)node);
 }
 
 /* CONNECTIONS */
@@ -499,24 +745,18 @@ Connection connection_find(Circuit* circ, Point pos)
 	Connection conn;
 	mem_zero(&conn, sizeof(conn));
 
-	THINGS_FOREACH(circ, THING_Node)
+	Wire* wires[4];
+	u32 wire_num = wires_find(&circ->wires, pos, wires, 4);
+	for(u32 i=0; i<wire_num; ++i)
 	{
-		Node* node = (Node*)it;
-
-		for(u32 c=0; c<4; ++c)
-		{
-			Node* other = node_get(circ, node->connections[c]);
-			if (!other)
-				continue;
+		Node* a = node_get(circ, wires[i]->a);
+		Node* b = node_get(circ, wires[i]->b);
+		if (!a || !b)
+			continue;
 
-			Rect con_rect = rect(node->pos, other->pos);
-			if (point_in_rect(pos, con_rect))
-			{
-				conn.a = node;
-				conn.b = other;
-				return conn;
-			}
-		}
+		conn.a = a;
+		conn.b = b;
+		break;
 	}
 
 	return conn;
@@ -540,29 +780,32 @@ void inverter_on_deleted(Circuit* circ, Inverter* inv)
 {
 	inv->valid = false;
 
+	// Stop driving the net we were powering
+	net_set_source_powered(circ, (Thing*)inv, false);
+
 	// If there is a target-node to this inverter, update it
 	Thing* target = thing_find(circ, point_add(inv->pos, point(1, 0)), THING_All);
 	if (target)
 	{
-		thing_set_powered(target, false);
+		net_set_source_powered(circ, target, false);
 		thing_set_dirty(circ, target);
 	}
 }
 
 void inverter_on_clean(Circuit* circ, Inverter* inv)
 {
-	bool prev_active = thing_active(inv);
+	bool prev_active = thing_active(circ, inv);
 	bool new_active = prev_active;
 
 	// Update state
 	Thing* src = thing_find(circ, point_add(inv->pos, point(-1, 0)), THING_All);
 	if (src)
-		new_active = !thing_active(src);
+		new_active = !thing_active(circ, src);
 	else
 		new_active = true;
 
-	thing_set_active(inv, new_active);
-	thing_set_powered(inv, new_active);
+	thing_set_active(circ, inv, new_active);
+	net_set_source_powered(circ, (Thing*)inv, new_active);
 
 	if (new_active != prev_active)
 		thing_dirty_at(circ, point_add(inv->pos, point(1, 0)));
@@ -583,55 +826,99 @@ Chip* chip_create(Circuit* circ, Point pos)
 	assert(sizeof(Chip) <= sizeof(Thing));
 	Chip* chip = (Chip*)thing_create(circ, THING_Chip, pos);
 
-	chip->size = point(3, 5);
-	chip->circuit = circuit_make("CHIP");
-	chip->circuit->parent = circ;
+	thing_resize(circ, (Thing*)chip, point(3, 5));
 	chip->link_nodes = malloc(sizeof(Thing_Id) * MAX_PUBLIC_NODES);
 	mem_zero(chip->link_nodes, sizeof(Thing_Id) * MAX_PUBLIC_NODES);
 
+	Circuit* chip_circ = circuit_make("CHIP");
+	chip_circ->parent = circ;
+	chip_circ->parent_chip = thing_id(circ, (Thing*)chip);
+	circ->thing_circuits[thing_index(circ, (Thing*)chip)] = chip_circ;
+
 	return chip;
 }
 
+Circuit* chip_circuit(Circuit* circ, Chip* chip)
+{
+	return circ->thing_circuits[thing_index(circ, (Thing*)chip)];
+}
+
+// Gives a chip its own link nodes, when the layout it's in was copied
+void chip_copy_links(Chip* chip)
+{
+	Thing_Id* links = malloc(sizeof(Thing_Id) * MAX_PUBLIC_NODES);
+	memcpy(links, chip->link_nodes, sizeof(Thing_Id) * MAX_PUBLIC_NODES);
+	chip->link_nodes = links;
+}
+
 void chip_on_deleted(Circuit* circ, Chip* chip)
 {
+	// Recorded gates might be in the chip
+	Circuit* root = circuit_root(circ);
+	if (root->rewind)
+		rewind_reset(root->rewind);
 
+	Circuit* chip_circ = chip_circuit(circ, chip);
+	if (chip_circ)
+	{
+		circuit_clear(chip_circ);
+		circuit_free(chip_circ);
+	}
+
+	free(chip->link_nodes);
 }
 
 void circuit_fwrite(Circuit* circ, FILE* file);
 void circuit_fread(Circuit* circ, FILE* file);
 void chip_on_save(Circuit* circ, Chip* chip, FILE* file)
 {
-	circuit_fwrite(chip->circuit, file);
-	fwrite(chip->link_nodes, sizeof(Thing_Id), MAX_PUBLIC_NODES, file);
+	circuit_fwrite(chip_circuit(circ, chip), file);
+
+	Thing_Id_Record records[MAX_PUBLIC_NODES];
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		records[i] = id_to_record(chip->link_nodes[i]);
+
+	fwrite(records, sizeof(Thing_Id_Record), MAX_PUBLIC_NODES, file);
 }
 
 void chip_on_load(Circuit* circ, Chip* chip, FILE* file)
 {
-	chip->circuit = circuit_make("CHIP");
-	circuit_fread(chip->circuit, file);
-	chip->circuit->parent = circ;
+	Circuit* chip_circ = circuit_make("CHIP");
+	circuit_fread(chip_circ, file);
+	chip_circ->parent = circ;
+	chip_circ->parent_chip = thing_id(circ, (Thing*)chip);
+	circ->thing_circuits[thing_index(circ, (Thing*)chip)] = chip_circ;
+
+	Thing_Id_Record records[MAX_PUBLIC_NODES];
+	fread(records, sizeof(Thing_Id_Record), MAX_PUBLIC_NODES, file);
 
 	chip->link_nodes = malloc(sizeof(Thing_Id) * MAX_PUBLIC_NODES);
-	fread(chip->link_nodes, sizeof(Thing_Id), MAX_PUBLIC_NODES, file);
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+		chip->link_nodes[i] = id_from_record(records[i]);
 }
 
-void chip_on_copy(Circuit* circ, Chip* chip, Chip* other)
+void chip_on_copy(Circuit* circ, Chip* chip, Circuit* other_circ, Chip* other)
 {
-	chip->circuit = circuit_make("CHIP");
-	circuit_copy(chip->circuit, other->circuit);
-	chip->circuit->parent = circ;
-
-	chip->link_nodes = malloc(sizeof(Thing_Id) * MAX_PUBLIC_NODES);
-	mem_zero(chip->link_nodes, sizeof(Thing_Id) * MAX_PUBLIC_NODES);
+	// The copy is just another instance of the same layout, until one of them is edited
+	Circuit* chip_circ = circuit_make("CHIP");
+	circuit_share(chip_circ, chip_circuit(other_circ, other));
+	chip_circ->parent = circ;
+	chip_circ->parent_chip = thing_id(circ, (Thing*)chip);
+	circ->thing_circuits[thing_index(circ, (Thing*)chip)] = chip_circ;
 }
 
 void chip_update(Circuit* circ, Chip* chip)
 {
+	Circuit* chip_circ = chip_circuit(circ, chip);
+	Thing_Id chip_id = thing_id(circ, (Thing*)chip);
 	u32 max_y = 2;
 
+	// Updating changes the layouts on both sides of the chip
+	circuit_unshare(chip_circ);
+
 	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
 	{
-		Node* pub_node = node_get(chip->circuit, chip->circuit->public_nodes[i]);
+		Node* pub_node = node_get(chip_circ, chip_circ->public_nodes[i]);
 		Node* chp_node = node_get(circ, chip->link_nodes[i]);
 
 		// Weird check, if they're not both NULL or not both some value
@@ -645,16 +932,24 @@ void chip_update(Circuit* circ, Chip* chip)
 				// Find or create a representative link node
 				chp_node = node_find(circ, chp_node_pos);
 				if (!chp_node)
+				{
+					// Creating might move the things around
 					chp_node = node_create(circ, chp_node_pos);
+					chip = chip_get(circ, chip_id);
+				}
 
 				chp_node->link_type = LINK_Chip;
-				chp_node->link_chip = thing_id(circ, (Thing*)chip);
-				chp_node->link_node = thing_id(chip->circuit, (Thing*)pub_node);
+				chp_node->link_chip = chip_id;
+				chp_node->link_node = thing_id(chip_circ, (Thing*)pub_node);
 
+				// Public nodes link back out through the link nodes of the chip they're in
 				pub_node->link_type = LINK_Public;
-				pub_node->link_node = thing_id(circ, (Thing*)chp_node);
 
 				chip->link_nodes[i] = thing_id(circ, (Thing*)chp_node);
+
+				// The link joins the nets on both sides of the chip
+				node_break_net(circ, chp_node);
+				node_break_net(chip_circ, pub_node);
 			}
 			// It was destroyed, so destroy the chip node as well
 			else
@@ -670,7 +965,7 @@ void chip_update(Circuit* circ, Chip* chip)
 		}
 	}
 
-	chip->size.y = max_y + 2;
+	thing_resize(circ, (Thing*)chip, point(chip->size.x, max_y + 2));
 }
 
 /* DELAY */
@@ -686,29 +981,32 @@ Delay* delay_create(Circuit* circ, Point pos)
 
 void delay_on_deleted(Circuit* circ, Delay* delay)
 {
+	// Stop driving the net we were powering
+	net_set_source_powered(circ, (Thing*)delay, false);
+
 	// If there is a target-node to this delay, update it
 	Thing* target = thing_find(circ, point_add(delay->pos, point(1, 0)), THING_All);
 	if (target)
 	{
-		thing_set_powered(target, false);
+		net_set_source_powered(circ, target, false);
 		thing_set_dirty(circ, target);
 	}
 }
 
 void delay_on_clean(Circuit* circ, Delay* delay)
 {
-	bool prev_active = thing_active(delay);
+	bool prev_active = thing_active(circ, delay);
 	bool new_active = prev_active;
 
 	// Update state
 	Thing* src = thing_find(circ, point_add(delay->pos, point(-1, 0)), THING_All);
 	if (src)
-		new_active = thing_active(src);
+		new_active = thing_active(circ, src);
 	else
 		new_active = false;
 
-	thing_set_active(delay, new_active);
-	thing_set_powered(delay, new_active);
+	thing_set_active(circ, delay, new_active);
+	net_set_source_powered(circ, (Thing*)delay, new_active);
 
 	if (new_active != prev_active)
 		thing_dirty_at(circ, point_add(delay->pos, point(1, 0)));
@@ -2,13 +2,31 @@
 #include "types.h"
 #include <stdio.h>
 typedef struct Circuit Circuit;
+typedef struct Mapped_File Mapped_File;
 
+typedef struct
+{
+	u32 generation;
+	u32 index;
+} Thing_Id;
+inline bool id_eq(Thing_Id a, Thing_Id b) { return a.generation == b.generation && a.index == b.index; }
+
+// Ids as they're stored in files, from back when they were 16 bit
 typedef struct
 {
 	u16 generation;
 	u16 index;
-} Thing_Id;
-inline bool id_eq(Thing_Id a, Thing_Id b) { return memcmp(&a, &b, sizeof(Thing_Id)) == 0; }
+} Thing_Id_Record;
+u16 id_record_generation(u32 generation);
+Thing_Id_Record id_to_record(Thing_Id id);
+Thing_Id id_from_record(Thing_Id_Record record);
+
+typedef struct
+{
+	u32 generation;
+	u32 index;
+} Net_Id;
+inline bool net_id_eq(Net_Id a, Net_Id b) { return a.generation == b.generation && a.index == b.index; }
 bool id_null(Thing_Id id);
 extern Thing_Id NULL_ID;
 
@@ -37,15 +55,21 @@ enum Thing_Flags
 {
 	FLAG_Active = 1 << 0,
 	FLAG_Powered = 1 << 1,
+	FLAG_Dirty = 1 << 2,
+
+	// Nodes whose source (the thing left of them) is powered, see net_set_source_powered
+	FLAG_Driven = 1 << 3,
 };
 
+// The simulation state of things (flags, last tic) isn't stored in the things themselves,
+// but in dense arrays in the circuit, indexed by thing index.
+// Every slot knows its own index, since pages can't be told apart by address.
+// Deleted things keep the index of the next free slot in their data, see Circuit::free_slot
 #define THING_IMPL()\
 u32 generation;\
+u32 index;\
 u8 type;\
 bool valid;\
-bool dirty;\
-u8 flags;\
-u32 tic;\
 \
 Point pos;\
 Point size\
@@ -58,7 +82,21 @@ typedef struct Thing
 	u8 data[64];
 } Thing;
 
+// Things are stored in pages that never move, so pointers to things stay valid while a circuit grows.
+// The first page holds 1 << THING_PAGE_SHIFT things, every next page as many as all pages before it
+#define THING_PAGE_SHIFT 3
+#define THING_PAGE_MAX 29
+
+u32 thing_page_size(u32 page);
+Thing* thing_at(Circuit* circ, u32 index);
 void things_reserve(Circuit* circ, u32 num);
+void things_map(Circuit* circ, Thing* things, u32 num, Mapped_File* file);
+void things_copy_pages(Circuit* circ);
+void things_free_pages(Circuit* circ);
+u32* thing_free_next(Thing* thing);
+void things_rebuild_free(Circuit* circ);
+void things_alloc_state(Circuit* circ);
+void things_free_state(Circuit* circ);
 Thing* thing_create(Circuit* circ, u8 type, Point pos);
 void thing_delete(Circuit* circ, Thing* thing);
 Thing* thing_find(Circuit* circ, Point pos, u8 type_mask);
@@ -67,23 +105,25 @@ Thing_Id thing_id(Circuit* circ, Thing* thing);
 u32 things_find(Circuit* circ, Rect rect, Thing** out_arr, u32 arr_size);
 const char* thing_get_name(Thing* thing);
 Rect thing_get_bbox(Thing* thing);
+void thing_resize(Circuit* circ, Thing* thing, Point size);
 
-bool thing_flag_get(Thing* thing, u8 flag);
-void thing_flag_set(Thing* thing, u8 flag, bool value);
-inline bool thing_active(void* thing) { return thing_flag_get(thing, FLAG_Active); }
-inline void thing_set_active(void* thing, bool active) { thing_flag_set(thing, FLAG_Active, active); }
-inline bool thing_powered(void* thing) { return thing_flag_get(thing, FLAG_Powered); }
-inline void thing_set_powered(void* thing, bool powered) { thing_flag_set(thing, FLAG_Powered, powered); }
+u32 thing_index(Circuit* circ, Thing* thing);
+bool thing_flag_get(Circuit* circ, Thing* thing, u8 flag);
+void thing_flag_set(Circuit* circ, Thing* thing, u8 flag, bool value);
+inline bool thing_active(Circuit* circ, void* thing) { return thing_flag_get(circ, thing, FLAG_Active); }
+inline void thing_set_active(Circuit* circ, void* thing, bool active) { thing_flag_set(circ, thing, FLAG_Active, active); }
+inline bool thing_powered(Circuit* circ, void* thing) { return thing_flag_get(circ, thing, FLAG_Powered); }
+inline void thing_set_powered(Circuit* circ, void* thing, bool powered) { thing_flag_set(circ, thing, FLAG_Powered, powered); }
 
-bool _thing_it_inc(Circuit* circ, Thing** thing, u8 type_mask);
+Thing* _thing_it_next(Circuit* circ, u32 index, u8 type_mask);
 
-#define THINGS_FOREACH(circ, type_mask) for(Thing* it = circ->things; _thing_it_inc(circ, &it, (type_mask)); it++)
+#define THINGS_FOREACH(circ, type_mask) for(Thing* it = _thing_it_next(circ, 0, (type_mask)); it; it = _thing_it_next(circ, it->index + 1, (type_mask)))
 
 // Thing data
 typedef void (*Thing_Delete_Proc)(Circuit* circ, void* thing);
 typedef void (*Thing_Save_Proc)(Circuit* circ, void* thing, FILE* file);
 typedef void (*Thing_Load_Proc)(Circuit* circ, void* thing, FILE* file);
-typedef void (*Thing_Copy_Proc)(Circuit* circ, void* thing, void* other);
+typedef void (*Thing_Copy_Proc)(Circuit* circ, void* thing, Circuit* other_circ, void* other);
 typedef void (*Thing_Merge_Proc)(Circuit* circ, void* thing, void* other);
 typedef void (*Thing_Dirty_Proc)(Circuit* circ, void* thing);
 typedef void (*Thing_Clean_Proc)(Circuit* circ, void* thing);
@@ -117,12 +157,11 @@ enum Node_Link_Type
 	LINK_Chip,
 };
 
+// The net a node is in is per-instance state, it's kept in the circuit (thing_nets)
 typedef struct
 {
 	THING_IMPL();
 
-	i32 recurse_id;
-
 	u8 link_type;
 	Thing_Id link_node;
 	Thing_Id link_chip;
@@ -135,13 +174,19 @@ Node* node_get(Circuit* circ, Thing_Id id);
 Node* node_create(Circuit* circ, Point pos);
 void node_on_deleted(Circuit* circ, Node* node);
 void node_on_merge(Circuit* circ, Node* node, Node* other);
-void node_on_copy(Circuit* circ, Node* node, Node* other);
+void node_on_copy(Circuit* circ, Node* node, Circuit* other_circ, Node* other);
 
 void node_set_powered(Circuit* circ, Node* node, bool powered);
 
 void node_update_state(Circuit* circ, Node* node);
 void node_toggle_public(Circuit* circ, Node* node);
 
+// Slot of a public node, or MAX_PUBLIC_NODES if it's not public. Setting it to MAX_PUBLIC_NODES makes it private
+u32 node_public_slot(Circuit* circ, Node* node);
+void node_set_public(Circuit* circ, Node* node, u32 slot);
+
+void node_insert_wires(Circuit* circ, Node* node);
+
 void node_connect(Circuit* circ, Node* a, Node* b);
 void node_disconnect(Circuit* circ, Node* a, Node* b);
 
@@ -169,11 +214,12 @@ void inverter_on_deleted(Circuit* circ, Inverter* inv);
 void inverter_on_clean(Circuit* circ, Inverter* inv);
 
 /* CHIP */
+// Chips are part of the layout, which can be shared between instances of the circuit they're in.
+// The circuit of every chip instance is kept in the circuit (thing_circuits), see chip_circuit
 typedef struct 
 {
 	THING_IMPL();
 
-	Circuit* circuit;
 	Thing_Id* link_nodes;
 } Chip;
 
@@ -183,7 +229,9 @@ Chip* chip_create(Circuit* circ, Point pos);
 void chip_on_deleted(Circuit* circ, Chip* chip);
 void chip_on_save(Circuit* circ, Chip* chip, FILE* file);
 void chip_on_load(Circuit* circ, Chip* chip, FILE* file);
-void chip_on_copy(Circuit* circ, Chip* chip, Chip* other);
+void chip_on_copy(Circuit* circ, Chip* chip, Circuit* other_circ, Chip* other);
+Circuit* chip_circuit(Circuit* circ, Chip* chip);
+void chip_copy_links(Chip* chip);
 Thing_Id chip_id(Circuit* circ, Chip* chip);
 void chip_delete(Circuit* circ, Chip* chip);
 
@@ -0,0 +1,361 @@
+#include "thread.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef HANDLE Thread_Handle;
+typedef CRITICAL_SECTION Thread_Mutex;
+typedef CONDITION_VARIABLE Thread_Cond;
+
+// Volatile accesses are acquire/release with MSVC
+#define atomic_load(ptr) (*(ptr))
+#define atomic_store(ptr, value) (*(ptr) = (value))
+#define atomic_cas64(ptr, expected, value) (InterlockedCompareExchange64((ptr), (value), (expected)))
+#define atomic_add32(ptr, value) (InterlockedExchangeAdd((volatile long*)(ptr), (value)) + (value))
+#define thread_yield() (SwitchToThread())
+
+#define thread_mutex_init(mutex) (InitializeCriticalSection(mutex))
+#define thread_mutex_free(mutex) (DeleteCriticalSection(mutex))
+#define thread_mutex_lock(mutex) (EnterCriticalSection(mutex))
+#define thread_mutex_unlock(mutex) (LeaveCriticalSection(mutex))
+#define thread_cond_init(cond) (InitializeConditionVariable(cond))
+#define thread_cond_free(cond)
+#define thread_cond_wait(cond, mutex) (SleepConditionVariableCS(cond, mutex, INFINITE))
+#define thread_cond_broadcast(cond) (WakeAllConditionVariable(cond))
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef pthread_t Thread_Handle;
+typedef pthread_mutex_t Thread_Mutex;
+typedef pthread_cond_t Thread_Cond;
+
+#define atomic_load(ptr) (__atomic_load_n((ptr), __ATOMIC_ACQUIRE))
+#define atomic_store(ptr, value) (__atomic_store_n((ptr), (value), __ATOMIC_RELEASE))
+#define atomic_cas64(ptr, expected, value) (__sync_val_compare_and_swap((ptr), (expected), (value)))
+#define atomic_add32(ptr, value) (__sync_add_and_fetch((ptr), (value)))
+#define thread_yield() (sched_yield())
+
+#define thread_mutex_init(mutex) (pthread_mutex_init(mutex, NULL))
+#define thread_mutex_free(mutex) (pthread_mutex_destroy(mutex))
+#define thread_mutex_lock(mutex) (pthread_mutex_lock(mutex))
+#define thread_mutex_unlock(mutex) (pthread_mutex_unlock(mutex))
+#define thread_cond_init(cond) (pthread_cond_init(cond, NULL))
+#define thread_cond_free(cond) (pthread_cond_destroy(cond))
+#define thread_cond_wait(cond, mutex) (pthread_cond_wait(cond, mutex))
+#define thread_cond_broadcast(cond) (pthread_cond_broadcast(cond))
+#endif
+
+// The jobs a worker has left are packed into one 64 bit value, [head, tail), so taking
+// a job and stealing jobs are both a single compare-exchange
+#define RANGE_PACK(head, tail) ((i64)(((u64)(tail) << 32) | (u64)(head)))
+#define RANGE_HEAD(range) ((u32)((u64)(range) & 0xFFFFFFFF))
+#define RANGE_TAIL(range) ((u32)((u64)(range) >> 32))
+
+typedef struct
+{
+	volatile i64 range;
+
+	Thread_Pool* pool;
+	u32 index;
+	Thread_Handle thread;
+
+	// Keep workers off each others cache lines
+	u8 padding[32];
+} Thread_Worker;
+
+struct Thread_Pool
+{
+	u32 thread_num;
+	Thread_Worker* workers;
+
+	Job_Proc proc;
+	void* data;
+
+	Thread_Mutex mutex;
+	Thread_Cond wake;
+	u32 generation;
+	bool quit;
+
+	// Workers that haven't finished the current batch yet
+	volatile i32 busy;
+};
+
+struct Thread_Task
+{
+	Job_Proc proc;
+	void* data;
+	Thread_Handle thread;
+	volatile i32 done;
+};
+
+bool worker_pop(Thread_Worker* worker, u32* job)
+{
+	while(true)
+	{
+		i64 range = atomic_load(&worker->range);
+		u32 head = RANGE_HEAD(range);
+		u32 tail = RANGE_TAIL(range);
+		if (head >= tail)
+			return false;
+
+		if (atomic_cas64(&worker->range, range, RANGE_PACK(head + 1, tail)) == range)
+		{
+			*job = head;
+			return true;
+		}
+	}
+}
+
+bool worker_steal(Thread_Worker* worker)
+{
+	Thread_Pool* pool = worker->pool;
+	for(u32 i=1; i<pool->thread_num; ++i)
+	{
+		Thread_Worker* victim = &pool->workers[(worker->index + i) % pool->thread_num];
+		while(true)
+		{
+			i64 range = atomic_load(&victim->range);
+			u32 head = RANGE_HEAD(range);
+			u32 tail = RANGE_TAIL(range);
+			if (head >= tail)
+				break;
+
+			// Take the back half, a single job left gets taken as a whole
+			u32 mid = head + (tail - head) / 2;
+			if (atomic_cas64(&victim->range, range, RANGE_PACK(head, mid)) == range)
+			{
+				// Our own range is empty, so nobody else is touching it
+				atomic_store(&worker->range, RANGE_PACK(mid, tail));
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void worker_work(Thread_Worker* worker)
+{
+	Thread_Pool* pool = worker->pool;
+	u32 job = 0;
+
+	do
+	{
+		while(worker_pop(worker, &job))
+			pool->proc(pool->data, job);
+	} while(worker_steal(worker));
+}
+
+void worker_loop(Thread_Worker* worker)
+{
+	Thread_Pool* pool = worker->pool;
+	u32 generation = 0;
+
+	while(true)
+	{
+		thread_mutex_lock(&pool->mutex);
+		while(pool->generation == generation && !pool->quit)
+			thread_cond_wait(&pool->wake, &pool->mutex);
+
+		generation = pool->generation;
+		bool quit = pool->quit;
+		thread_mutex_unlock(&pool->mutex);
+
+		if (quit)
+			return;
+
+		worker_work(worker);
+		atomic_add32(&pool->busy, -1);
+	}
+}
+
+void task_run(Thread_Task* task)
+{
+	task->proc(task->data, 0);
+	atomic_store(&task->done, 1);
+}
+
+#ifdef _WIN32
+DWORD WINAPI worker_entry(LPVOID worker)
+{
+	worker_loop(worker);
+	return 0;
+}
+
+void thread_start(Thread_Handle* thread, Thread_Worker* worker)
+{
+	*thread = CreateThread(NULL, 0, worker_entry, worker, 0, NULL);
+	assert(*thread != NULL);
+}
+
+DWORD WINAPI task_entry(LPVOID task)
+{
+	task_run(task);
+	return 0;
+}
+
+void task_start(Thread_Task* task)
+{
+	task->thread = CreateThread(NULL, 0, task_entry, task, 0, NULL);
+	assert(task->thread != NULL);
+}
+
+void thread_join(Thread_Handle thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+u32 thread_core_num()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+#else
+void* worker_entry(void* worker)
+{
+	worker_loop(worker);
+	return NULL;
+}
+
+void thread_start(Thread_Handle* thread, Thread_Worker* worker)
+{
+	i32 result = pthread_create(thread, NULL, worker_entry, worker);
+	assert(result == 0);
+}
+
+void* task_entry(void* task)
+{
+	task_run(task);
+	return NULL;
+}
+
+void task_start(Thread_Task* task)
+{
+	i32 result = pthread_create(&task->thread, NULL, task_entry, task);
+	assert(result == 0);
+}
+
+void thread_join(Thread_Handle thread)
+{
+	pthread_join(thread, NULL);
+}
+
+u32 thread_core_num()
+{
+	i64 num = sysconf(_SC_NPROCESSORS_ONLN);
+	return num > 0 ? (u32)num : 1;
+}
+#endif
+
+Thread_Pool* thread_pool_make(u32 thread_num)
+{
+	if (thread_num == 0)
+		thread_num = 1;
+
+	Thread_Pool* pool = malloc(sizeof(Thread_Pool));
+	mem_zero(pool, sizeof(Thread_Pool));
+
+	pool->thread_num = thread_num;
+	pool->workers = malloc(sizeof(Thread_Worker) * thread_num);
+	mem_zero(pool->workers, sizeof(Thread_Worker) * thread_num);
+
+	thread_mutex_init(&pool->mutex);
+	thread_cond_init(&pool->wake);
+
+	// Worker 0 is whoever calls thread_pool_run
+	for(u32 i=0; i<thread_num; ++i)
+	{
+		Thread_Worker* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+
+		if (i > 0)
+			thread_start(&worker->thread, worker);
+	}
+
+	return pool;
+}
+
+void thread_pool_free(Thread_Pool* pool)
+{
+	thread_mutex_lock(&pool->mutex);
+	pool->quit = true;
+	thread_cond_broadcast(&pool->wake);
+	thread_mutex_unlock(&pool->mutex);
+
+	for(u32 i=1; i<pool->thread_num; ++i)
+		thread_join(pool->workers[i].thread);
+
+	thread_mutex_free(&pool->mutex);
+	thread_cond_free(&pool->wake);
+
+	free(pool->workers);
+	free(pool);
+}
+
+u32 thread_pool_thread_num(Thread_Pool* pool)
+{
+	return pool->thread_num;
+}
+
+void thread_pool_run(Thread_Pool* pool, Job_Proc proc, void* data, u32 job_num)
+{
+	if (job_num == 0)
+		return;
+
+	pool->proc = proc;
+	pool->data = data;
+
+	u32 thread_num = pool->thread_num;
+	for(u32 i=0; i<thread_num; ++i)
+	{
+		u32 head = (u32)((u64)job_num * i / thread_num);
+		u32 tail = (u32)((u64)job_num * (i + 1) / thread_num);
+		atomic_store(&pool->workers[i].range, RANGE_PACK(head, tail));
+	}
+
+	if (thread_num == 1)
+	{
+		worker_work(&pool->workers[0]);
+		return;
+	}
+
+	atomic_store(&pool->busy, (i32)(thread_num - 1));
+
+	thread_mutex_lock(&pool->mutex);
+	pool->generation++;
+	thread_cond_broadcast(&pool->wake);
+	thread_mutex_unlock(&pool->mutex);
+
+	worker_work(&pool->workers[0]);
+
+	// Others might still be finishing the jobs they took
+	while(atomic_load(&pool->busy) > 0)
+		thread_yield();
+}
+
+Thread_Task* thread_task_start(Job_Proc proc, void* data)
+{
+	Thread_Task* task = malloc(sizeof(Thread_Task));
+	mem_zero(task, sizeof(Thread_Task));
+	task->proc = proc;
+	task->data = data;
+	task_start(task);
+	return task;
+}
+
+bool thread_task_done(Thread_Task* task)
+{
+	return atomic_load(&task->done) != 0;
+}
+
+void thread_task_join(Thread_Task* task)
+{
+	thread_join(task->thread);
+	free(task);
+}
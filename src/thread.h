@@ -0,0 +1,31 @@
+#pragma once
+
+// Thread pool
+// Runs batches of jobs on a fixed set of worker threads, the thread calling thread_pool_run works along.
+// Jobs are split evenly between the workers up front, a worker that runs out steals half of the
+// jobs another worker has left. Which thread runs which job isn't deterministic, so jobs shouldn't
+// touch each others data.
+typedef void (*Job_Proc)(void* data, u32 job);
+
+typedef struct Thread_Pool Thread_Pool;
+
+Thread_Pool* thread_pool_make(u32 thread_num);
+void thread_pool_free(Thread_Pool* pool);
+u32 thread_pool_thread_num(Thread_Pool* pool);
+
+// Cores the system runs threads on, more threads than this only add overhead
+u32 thread_core_num();
+
+// Runs proc for every job in [0, job_num), returns when all of them are done
+void thread_pool_run(Thread_Pool* pool, Job_Proc proc, void* data, u32 job_num);
+
+// Runs proc(data, 0) on a thread of its own, for work that takes longer than the caller can wait
+typedef struct Thread_Task Thread_Task;
+
+Thread_Task* thread_task_start(Job_Proc proc, void* data);
+
+// Whether proc returned, without waiting for it
+bool thread_task_done(Thread_Task* task);
+
+// Waits for proc to return, and frees the task
+void thread_task_join(Thread_Task* task);
@@ -1,98 +1,181 @@
 #include "tic.h"
 #include "circuit.h"
+#include "trace.h"
 
-// Dirty stack
+// Dirty queue
 u32 tic = 1;
 u32 tic_push_count = 0;
 u32 tic_pop_count = 0;
-void dirty_stack_push(Dirty_Stack* stack, Circuit* circ, Thing* thing)
+
+void dirty_queue_reserve(Dirty_Queue* queue, u32 num)
+{
+	if (queue->max >= num)
+		return;
+
+	// Always keep the size a power of two, so indices can be wrapped with a mask
+	u32 new_max = queue->max == 0 ? 64 : queue->max;
+	while(new_max < num)
+		new_max <<= 1;
+
+	Dirty_Entry* prev_list = queue->list;
+	queue->list = malloc(sizeof(Dirty_Entry) * new_max);
+
+	// Unwrap the old ring into the start of the new one
+	if (prev_list)
+	{
+		for(u32 i=0; i<queue->count; ++i)
+			queue->list[i] = prev_list[(queue->head + i) & (queue->max - 1)];
+
+		free(prev_list);
+	}
+
+	queue->head = 0;
+	queue->max = new_max;
+}
+
+void dirty_queue_free(Dirty_Queue* queue)
+{
+	if (queue->list)
+		free(queue->list);
+
+	zero_t(*queue);
+}
+
+void dirty_queue_clear(Dirty_Queue* queue)
+{
+	for(u32 i=0; i<queue->count; ++i)
+	{
+		Dirty_Entry* entry = &queue->list[(queue->head + i) & (queue->max - 1)];
+		Thing* thing = thing_get(entry->circ, entry->id);
+		if (thing)
+			thing_flag_set(entry->circ, thing, FLAG_Dirty, false);
+	}
+
+	queue->head = 0;
+	queue->count = 0;
+}
+
+void dirty_queue_push(Dirty_Queue* queue, Circuit* circ, Thing* thing)
 {
-	if (thing->dirty)
+	if (thing_flag_get(circ, thing, FLAG_Dirty))
 		return;
 
-	assert(stack->count < DIRTY_STACK_SIZE);
+	dirty_queue_reserve(queue, queue->count + 1);
+	u32 mask = queue->max - 1;
 	Dirty_Entry* entry = NULL;
 
 	Thing_Type_Data* type = thing_type_data(thing);
 	u8 push_type = type->push_type;
 	if (push_type == PUSH_Top)
 	{
-		entry = &stack->list[stack->count++];
+		queue->head = (queue->head - 1) & mask;
+		entry = &queue->list[queue->head];
 	}
 	else
 	{
-		// Move every entry in the stack upwards
-		memmove(stack->list + 1, stack->list, sizeof(Thing_Id) * stack->count);
-		stack->count++;
-
-		entry = &stack->list[0];
+		entry = &queue->list[(queue->head + queue->count) & mask];
 	}
 
-	entry->thing = thing;
+	queue->count++;
+
+	entry->id = thing_id(circ, thing);
 	entry->circ = circ;
 
 	tic_push_count++;
-	thing->dirty = true;
+	STATS_ADD(push_count, 1);
+	STATS_MAX(queue_high_water, queue->count);
+	thing_flag_set(circ, thing, FLAG_Dirty, true);
 }
 
-Dirty_Entry dirty_stack_pop(Dirty_Stack* stack)
+Dirty_Entry dirty_queue_pop(Dirty_Queue* queue)
 {
-	assert(stack->count > 0);
+	assert(queue->count > 0);
 
-	// Iterate through the stack to find a valid (if stuff was deleted mid-tic)
-	Dirty_Entry entry;
-	entry = stack->list[--stack->count];
-	entry.thing->dirty = false;
-	tic_pop_count++;
+	Dirty_Entry entry = queue->list[queue->head];
+	queue->head = (queue->head + 1) & (queue->max - 1);
+	queue->count--;
+
+	// The thing might have been deleted while it was queued
+	Thing* thing = thing_get(entry.circ, entry.id);
+	if (thing)
+		thing_flag_set(entry.circ, thing, FLAG_Dirty, false);
 
+	tic_pop_count++;
 	return entry;
 }
 
-Dirty_Entry dirty_stack_peek(Dirty_Stack* stack)
+Dirty_Entry dirty_queue_peek(Dirty_Queue* queue)
+{
+	return dirty_queue_get(queue, 0);
+}
+
+Dirty_Entry dirty_queue_get(Dirty_Queue* queue, u32 index)
 {
 	Dirty_Entry entry;
 	zero_t(entry);
 
-	if (stack->count == 0)
+	if (index >= queue->count)
 		return entry;
 
-	return stack->list[stack->count - 1];
+	return queue->list[(queue->head + index) & (queue->max - 1)];
 }
 
 void thing_set_dirty(Circuit* circ, Thing* thing)
 {
-	/*
-	Dirty_Stack* stack = &circ->dirty_stacks[circ->stack_index];
+	// Chips all share the queue of the circuit they are simulated in. Whatever a load left dirty goes
+	// in first, like it would have without waiting
+	Circuit* root = circuit_root(circ);
+	if (root->dirty_pending)
+		circuit_dirty_all(root);
 
-	// If this thing ticed this frame, push onto the next stack
-	if (thing->tic == tic)
-		stack = &circ->dirty_stacks[!circ->stack_index];
+	Dirty_Queue* queue = &root->dirty_queues[root->queue_index];
 
-	dirty_stack_push(stack, circ, thing);
+	// If this thing ticed this frame, push onto the next queue
+	if (circ->thing_tics[thing_index(circ, thing)] == tic)
+		queue = &root->dirty_queues[!root->queue_index];
+
+	dirty_queue_push(queue, circ, thing);
 
 	Thing_Type_Data* type = thing_type_data(thing);
 	if (type->on_dirty)
 		type->on_dirty(circ, thing);
-		*/
 }
 
 void thing_dirty_at(Circuit* circ, Point pos)
 {
-	/*
 	Thing* thing = thing_find(circ, pos, THING_All);
 	if (!thing)
 		return;
 
 	thing_set_dirty(circ, thing);
-	*/
 }
 
 void thing_clean(Circuit* circ, Thing* thing)
 {
-	/*
-	thing->tic = tic;
+	circ->thing_tics[thing_index(circ, thing)] = tic;
 	Thing_Type_Data* type = thing_type_data(thing);
 	if (type->on_clean)
+	{
+		STATS_BEGIN(begin);
 		type->on_clean(circ, thing);
-		*/
-}
\ No newline at end of file
+		STATS_END(clean_ns[thing->type], begin);
+	}
+
+	STATS_ADD(clean_count[thing->type], 1);
+}
+
+// Tic stats
+Tic_Stats tic_stats;
+Tic_Stats tic_stats_last;
+
+u64 stats_time_ns()
+{
+	return trace_now_ns();
+}
+
+void tic_stats_end()
+{
+	tic_stats.tic = tic;
+	tic_stats_last = tic_stats;
+	zero_t(tic_stats);
+}
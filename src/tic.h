@@ -2,26 +2,90 @@
 #include "thing.h"
 extern u32 tic;
 
-#define DIRTY_STACK_SIZE 128
-
 // Dirty entry
 typedef struct
 {
-	Thing* thing;
+	Thing_Id id;
 	Circuit* circ;
 } Dirty_Entry;
 
-// Dirty stack
+// Dirty queue
+// Growable ring buffer of dirty things, which can be pushed at either end.
+// Entries are popped from the front (top), so PUSH_Top things are cleaned before PUSH_Bottom things.
 typedef struct
 {
-	Dirty_Entry list[DIRTY_STACK_SIZE];
+	Dirty_Entry* list;
+	u32 head;
 	u32 count;
-} Dirty_Stack;
+	u32 max;
+} Dirty_Queue;
 
-void dirty_stack_push(Dirty_Stack* stack, Circuit* circ, Thing* thing);
-Dirty_Entry dirty_stack_pop(Dirty_Stack* stack);
-Dirty_Entry dirty_stack_peek(Dirty_Stack* stack);
+void dirty_queue_free(Dirty_Queue* queue);
+void dirty_queue_clear(Dirty_Queue* queue);
+void dirty_queue_push(Dirty_Queue* queue, Circuit* circ, Thing* thing);
+Dirty_Entry dirty_queue_pop(Dirty_Queue* queue);
+Dirty_Entry dirty_queue_peek(Dirty_Queue* queue);
+Dirty_Entry dirty_queue_get(Dirty_Queue* queue, u32 index);
 
 void thing_set_dirty(Circuit* circ, Thing* thing);
 void thing_dirty_at(Circuit* circ, Point pos);
 void thing_clean(Circuit* circ, Thing* thing);
+
+// Tic stats
+// Counters on the tic path, to see where the time of a tic goes. They're only built in when STATS is
+// set, which debug builds do by default, otherwise the macros below are empty and nothing is counted.
+// Counting goes on in tic_stats, and the end of every tic (circuit_tic, or the subtic that finishes
+// one) copies it to tic_stats_last, which is the one to read.
+#ifndef STATS
+#define STATS DEBUG
+#endif
+
+// Spaced like the thing type data, indexed by thing type
+#define STATS_TYPE_NUM (THING_Delay + 1)
+
+typedef struct
+{
+	u32 tic;
+	u64 tic_ns;
+
+	// Event-driven engine, cleans per thing type and the time spent in them
+	u32 clean_count[STATS_TYPE_NUM];
+	u64 clean_ns[STATS_TYPE_NUM];
+
+	u32 push_count;
+	u32 queue_high_water;
+
+	// Every net collection walks the whole batch a node is in, resolving walks all members of a net
+	u32 net_collect_count;
+	u32 net_collect_nodes;
+	u32 net_collect_longest;
+	u32 net_resolve_nodes;
+
+	// Links followed while walking nets, down into chips (LINK_Chip) and back up out of them (LINK_Public)
+	u32 link_chip_count;
+	u32 link_public_count;
+
+	// Netlist
+	u64 gate_evals;
+	u64 compile_ns;
+} Tic_Stats;
+
+extern Tic_Stats tic_stats;
+extern Tic_Stats tic_stats_last;
+
+u64 stats_time_ns();
+void tic_stats_end();
+
+#if STATS
+#define STATS_ADD(field, n) (tic_stats.field += (n))
+#define STATS_MAX(field, n) (tic_stats.field = max(tic_stats.field, (n)))
+#define STATS_BEGIN(var) u64 var = stats_time_ns()
+#define STATS_END(field, var) (tic_stats.field += stats_time_ns() - (var))
+#define STATS_END_TIC() tic_stats_end()
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_MAX(field, n) ((void)0)
+#define STATS_BEGIN(var)
+#define STATS_END(field, var) ((void)0)
+#define STATS_END_TIC() ((void)0)
+#endif
@@ -0,0 +1,127 @@
+#include "trace.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#define atomic_load(ptr) (*(ptr))
+#define atomic_store(ptr, value) (*(ptr) = (value))
+#define atomic_add32(ptr, value) (InterlockedExchangeAdd((volatile long*)(ptr), (value)) + (value))
+#else
+#include <time.h>
+
+#define TRACE_THREAD_LOCAL __thread
+#define atomic_load(ptr) (__atomic_load_n((ptr), __ATOMIC_ACQUIRE))
+#define atomic_store(ptr, value) (__atomic_store_n((ptr), (value), __ATOMIC_RELEASE))
+#define atomic_add32(ptr, value) (__sync_add_and_fetch((ptr), (value)))
+#endif
+
+Trace_Ring* trace_rings[TRACE_MAX_THREADS];
+volatile u32 trace_ring_num = 0;
+TRACE_THREAD_LOCAL Trace_Ring* trace_ring = NULL;
+
+#ifdef _WIN32
+u64 trace_now_ns()
+{
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+
+	// Split up so the multiply doesn't overflow
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (u64)(now.QuadPart / freq.QuadPart) * 1000000000 + (u64)(now.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+}
+#else
+u64 trace_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (u64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+// The ring of the calling thread, made the first time it records anything
+Trace_Ring* trace_thread_ring()
+{
+	if (trace_ring)
+		return trace_ring;
+
+	u32 index = atomic_add32(&trace_ring_num, 1) - 1;
+	if (index >= TRACE_MAX_THREADS)
+		return NULL;
+
+	Trace_Ring* ring = malloc(sizeof(Trace_Ring));
+	ring->zones = malloc(sizeof(Trace_Zone) * TRACE_RING_SIZE);
+	ring->thread_index = index;
+	ring->head = 0;
+
+	atomic_store(&trace_rings[index], ring);
+	trace_ring = ring;
+	return ring;
+}
+
+void trace_end(const char* name, u64 begin_ns)
+{
+	u64 end_ns = trace_now_ns();
+	Trace_Ring* ring = trace_thread_ring();
+	if (!ring)
+		return;
+
+	// Only this thread writes the ring, the zone is published by moving the head past it
+	u32 head = ring->head;
+	Trace_Zone* zone = &ring->zones[head & (TRACE_RING_SIZE - 1)];
+	zone->name = name;
+	zone->begin_ns = begin_ns;
+	zone->end_ns = end_ns;
+	atomic_store(&ring->head, head + 1);
+}
+
+bool trace_dump(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	u32 ring_num = min(atomic_load(&trace_ring_num), TRACE_MAX_THREADS);
+
+	// Timestamps are from the earliest zone that's still around, so they start at 0. Zones are
+	// written when they end, so an outer zone comes after the zones in it
+	u64 epoch = ~0ull;
+	for(u32 r=0; r<ring_num; ++r)
+	{
+		Trace_Ring* ring = atomic_load(&trace_rings[r]);
+		u32 head = ring ? atomic_load(&ring->head) : 0;
+		u32 first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for(u32 i=first; i<head; ++i)
+			epoch = min(epoch, ring->zones[i & (TRACE_RING_SIZE - 1)].begin_ns);
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"console-game\"}}");
+
+	for(u32 r=0; r<ring_num; ++r)
+	{
+		Trace_Ring* ring = atomic_load(&trace_rings[r]);
+		if (!ring)
+			continue;
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			ring->thread_index, ring->thread_index);
+
+		u32 head = atomic_load(&ring->head);
+		u32 first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for(u32 i=first; i<head; ++i)
+		{
+			Trace_Zone* zone = &ring->zones[i & (TRACE_RING_SIZE - 1)];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				zone->name, ring->thread_index, (zone->begin_ns - epoch) / 1000.0, (zone->end_ns - zone->begin_ns) / 1000.0);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "types.h"
+
+// Trace
+// Zones timed with a monotonic clock, to find hitches in a trace viewer. Every thread records its zones
+// into a ring of its own, so recording takes no locks and nothing is shared but the list of rings. Full
+// rings overwrite their oldest zones. trace_dump writes every ring as Chrome trace event JSON, which
+// chrome://tracing and ui.perfetto.dev open. It should be called while no other thread is recording.
+// Zones are built in unless TRACE is set to 0, then the macros below are empty.
+#ifndef TRACE
+#define TRACE 1
+#endif
+
+#define TRACE_RING_SIZE (1 << 16)
+#define TRACE_MAX_THREADS 64
+
+typedef struct
+{
+	// Zone names are string literals, only the pointer is kept
+	const char* name;
+	u64 begin_ns;
+	u64 end_ns;
+} Trace_Zone;
+
+typedef struct
+{
+	Trace_Zone* zones;
+	u32 thread_index;
+
+	// Zones ever written, the ring index is this masked
+	volatile u32 head;
+} Trace_Ring;
+
+// Nanoseconds from some fixed point in the past, never goes backwards
+u64 trace_now_ns();
+void trace_end(const char* name, u64 begin_ns);
+bool trace_dump(const char* path);
+
+#if TRACE
+#define TRACE_BEGIN(var) u64 var = trace_now_ns()
+#define TRACE_END(name, var) trace_end(name, var)
+#else
+#define TRACE_BEGIN(var)
+#define TRACE_END(name, var) ((void)0)
+#endif
@@ -1,6 +1,15 @@
 #pragma once
 #include <stdlib.h>
 
+// MSVC's stdlib.h has these, and doesn't need a definition of inline functions outside of the header
+#ifndef _MSC_VER
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define inline static inline
+#endif
+
 typedef char bool;
 enum { false, true };
 
@@ -10,6 +19,8 @@ typedef signed short i16;
 typedef unsigned short u16;
 typedef signed int i32;
 typedef unsigned int u32;
+typedef signed long long i64;
+typedef unsigned long long u64;
 
 typedef float f32;
 typedef double d32;
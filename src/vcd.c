@@ -0,0 +1,336 @@
+#include "vcd.h"
+#include <string.h>
+
+// See memo.c
+#ifdef _MSC_VER
+u32 bit_index(u64 bits);
+#else
+#define bit_index(bits) ((u32)__builtin_ctzll(bits))
+#endif
+
+void vcd_flush(Vcd_Recorder* vcd)
+{
+	fwrite(vcd->buffer, 1, vcd->buffer_num, vcd->file);
+	vcd->buffer_num = 0;
+}
+
+void vcd_write(Vcd_Recorder* vcd, const char* str)
+{
+	u32 len = strlen(str);
+	if (vcd->buffer_num + len > VCD_BUFFER_SIZE)
+		vcd_flush(vcd);
+
+	memcpy(vcd->buffer + vcd->buffer_num, str, len);
+	vcd->buffer_num += len;
+}
+
+u32 vcd_add_scope(Vcd_Recorder* vcd, Circuit* circ, u32 parent, const char* name)
+{
+	if (vcd->scope_num >= vcd->scope_max)
+	{
+		vcd->scope_max = vcd->scope_max == 0 ? 16 : (vcd->scope_max << 1);
+		vcd->scopes = realloc(vcd->scopes, sizeof(Vcd_Scope) * vcd->scope_max);
+		assert(vcd->scopes != NULL);
+	}
+
+	Vcd_Scope* scope = &vcd->scopes[vcd->scope_num];
+	scope->circ = circ;
+	scope->parent = parent;
+	snprintf(scope->name, sizeof(scope->name), "%s", name);
+	return vcd->scope_num++;
+}
+
+void vcd_add_probe(Vcd_Recorder* vcd, Circuit* circ, Node* node, u32 scope, const char* name)
+{
+	if (vcd->probe_num >= vcd->probe_max)
+	{
+		vcd->probe_max = vcd->probe_max == 0 ? 64 : (vcd->probe_max << 1);
+		vcd->probes = realloc(vcd->probes, sizeof(Vcd_Probe) * vcd->probe_max);
+		assert(vcd->probes != NULL);
+	}
+
+	Vcd_Probe* probe = &vcd->probes[vcd->probe_num++];
+	mem_zero(probe, sizeof(Vcd_Probe));
+	probe->circ = circ;
+	probe->id = thing_id(circ, (Thing*)node);
+	probe->scope = scope;
+	snprintf(probe->name, sizeof(probe->name), "%s", name);
+}
+
+// A scope for the circuit and every chip in it, with their public nodes
+void vcd_add_circuit(Vcd_Recorder* vcd, Circuit* circ, u32 parent, const char* name)
+{
+	u32 scope = vcd_add_scope(vcd, circ, parent, name);
+
+	char probe_name[24];
+	for(u32 i=0; i<MAX_PUBLIC_NODES; ++i)
+	{
+		Node* node = node_get(circ, circ->public_nodes[i]);
+		if (!node)
+			continue;
+
+		sprintf(probe_name, "public_%u", i);
+		vcd_add_probe(vcd, circ, node, scope, probe_name);
+	}
+
+	// Chips can't overlap, so their position names them
+	char chip_name[32];
+	THINGS_FOREACH(circ, THING_Chip)
+	{
+		Circuit* chip_circ = chip_circuit(circ, (Chip*)it);
+		snprintf(chip_name, sizeof(chip_name), "%s_%d_%d", chip_circ->name, it->pos.x, it->pos.y);
+		vcd_add_circuit(vcd, chip_circ, scope, chip_name);
+	}
+}
+
+bool vcd_open(Vcd_Recorder* vcd, Circuit* root, const char* path)
+{
+	mem_zero(vcd, sizeof(Vcd_Recorder));
+	vcd->file = fopen(path, "w");
+	if (!vcd->file)
+		return false;
+
+	vcd->root = root;
+	vcd->buffer = malloc(VCD_BUFFER_SIZE);
+	vcd_add_circuit(vcd, root, 0, root->name);
+	return true;
+}
+
+void vcd_probe(Vcd_Recorder* vcd, Circuit* circ, Node* node)
+{
+	assert(!vcd->started);
+
+	u32 scope = 0;
+	for(u32 i=0; i<vcd->scope_num; ++i)
+	{
+		if (vcd->scopes[i].circ == circ)
+		{
+			scope = i;
+			break;
+		}
+	}
+
+	char name[24];
+	sprintf(name, "node_%d_%d", node->pos.x, node->pos.y);
+	vcd_add_probe(vcd, circ, node, scope, name);
+}
+
+i32 vcd_compare_probes(const void* a, const void* b)
+{
+	const Vcd_Probe* pa = a;
+	const Vcd_Probe* pb = b;
+	if (pa->scope != pb->scope)
+		return pa->scope < pb->scope ? -1 : 1;
+
+	return strcmp(pa->name, pb->name);
+}
+
+// Identifiers are the probe index in base 94, using every printable character
+void vcd_make_code(Vcd_Signal* signal, u32 index)
+{
+	mem_zero(signal->code, VCD_CODE_MAX);
+	signal->code_len = 0;
+	do
+	{
+		signal->code[signal->code_len++] = '!' + (index % 94);
+		index /= 94;
+	} while(index);
+
+	signal->code[signal->code_len] = '\n';
+}
+
+// Sampling more than once a tic (subtics) adds to the changes of that tic
+void vcd_stamp(Vcd_Recorder* vcd)
+{
+	if (vcd->stamp_tic == tic)
+		return;
+
+	char line[16];
+	sprintf(line, "#%u\n", tic);
+	vcd_write(vcd, line);
+	vcd->stamp_tic = tic;
+}
+
+// Most tics write a lot of these, so they skip the formatting and go straight into the buffer. The
+// buffer is flushed once for the whole word, then every change is a copy of the padded code
+void vcd_write_changes(Vcd_Recorder* vcd, u32 word, u64 changed)
+{
+	vcd_stamp(vcd);
+	if (vcd->buffer_num + 64 * (VCD_CODE_MAX + 2) > VCD_BUFFER_SIZE)
+		vcd_flush(vcd);
+
+	u64 state = vcd->states[word];
+	char* out = vcd->buffer + vcd->buffer_num;
+	for(; changed; changed &= changed - 1)
+	{
+		u32 bit = bit_index(changed);
+		Vcd_Signal* signal = &vcd->signals[word * 64 + bit];
+		out[0] = '0' + ((state >> bit) & 1);
+		memcpy(out + 1, signal->code, VCD_CODE_MAX);
+		out += signal->code_len + 2;
+	}
+
+	vcd->buffer_num = out - vcd->buffer;
+}
+
+// The first sample writes every probe of the word, after that only the ones that changed
+void vcd_update_word(Vcd_Recorder* vcd, u32 word, u64 state, bool all)
+{
+	u64 changed = state ^ vcd->states[word];
+	if (all)
+	{
+		u32 bit_num = min(vcd->probe_num - word * 64, 64);
+		changed = bit_num < 64 ? ((u64)1 << bit_num) - 1 : ~(u64)0;
+	}
+
+	if (!changed)
+		return;
+
+	vcd->states[word] = state;
+	vcd_write_changes(vcd, word, changed);
+}
+
+// Without a netlist the states are in the things. Deleted nodes keep their last value
+bool vcd_thing_state(Vcd_Recorder* vcd, u32 index)
+{
+	Vcd_Probe* probe = &vcd->probes[index];
+	Node* node = node_get(probe->circ, probe->id);
+	return node ? thing_active(probe->circ, node) : (vcd->states[index / 64] >> (index % 64)) & 1;
+}
+
+// Nets move whenever the netlist is recompiled, nodes without a net read net 0, which is always off
+void vcd_map_nets(Vcd_Recorder* vcd)
+{
+	Netlist* netlist = &vcd->root->netlist;
+	for(u32 i=0; i<vcd->probe_num; ++i)
+	{
+		Vcd_Probe* probe = &vcd->probes[i];
+		Node* node = node_get(probe->circ, probe->id);
+		u32 net = node ? node_net_id(probe->circ, node)->index : 0;
+		vcd->signals[i].net = net < netlist->table_net_num ? net : 0;
+	}
+
+	vcd->netlist_generation = netlist->generation;
+}
+
+// The header, with the scopes in pre-order and the initial value of everything
+void vcd_start(Vcd_Recorder* vcd)
+{
+	qsort(vcd->probes, vcd->probe_num, sizeof(Vcd_Probe), vcd_compare_probes);
+	vcd->signals = malloc(sizeof(Vcd_Signal) * (vcd->probe_num + 1));
+	mem_zero(vcd->signals, sizeof(Vcd_Signal) * (vcd->probe_num + 1));
+	for(u32 i=0; i<vcd->probe_num; ++i)
+		vcd_make_code(&vcd->signals[i], i);
+
+	u32 word_num = (vcd->probe_num + 63) / 64;
+	vcd->states = malloc(sizeof(u64) * (word_num + 1));
+	mem_zero(vcd->states, sizeof(u64) * (word_num + 1));
+
+	char line[128];
+	vcd_write(vcd, "$version console-game $end\n");
+	vcd_write(vcd, "$timescale 1ns $end\n");
+
+	// Open scopes, closed once a scope comes along that isn't in them
+	u32* open = malloc(sizeof(u32) * (vcd->scope_num + 1));
+	u32 open_num = 0;
+	u32 p = 0;
+	for(u32 s=0; s<vcd->scope_num; ++s)
+	{
+		Vcd_Scope* scope = &vcd->scopes[s];
+		while(open_num > 0 && open[open_num - 1] != scope->parent)
+		{
+			vcd_write(vcd, "$upscope $end\n");
+			open_num--;
+		}
+
+		snprintf(line, sizeof(line), "$scope module %s $end\n", scope->name);
+		vcd_write(vcd, line);
+		open[open_num++] = s;
+
+		for(; p<vcd->probe_num && vcd->probes[p].scope == s; ++p)
+		{
+			snprintf(line, sizeof(line), "$var wire 1 %.*s %s $end\n", vcd->signals[p].code_len, vcd->signals[p].code, vcd->probes[p].name);
+			vcd_write(vcd, line);
+		}
+	}
+
+	for(; open_num > 0; --open_num)
+		vcd_write(vcd, "$upscope $end\n");
+
+	free(open);
+	vcd_write(vcd, "$enddefinitions $end\n");
+	vcd->started = true;
+}
+
+void vcd_sample(Vcd_Recorder* vcd)
+{
+	Netlist* netlist = &vcd->root->netlist;
+	bool first = !vcd->started;
+	if (first)
+		vcd_start(vcd);
+
+	if (netlist->valid && netlist->generation != vcd->netlist_generation)
+		vcd_map_nets(vcd);
+
+	if (first)
+	{
+		char line[32];
+		sprintf(line, "#%u\n$dumpvars\n", tic);
+		vcd_write(vcd, line);
+		vcd->stamp_tic = tic;
+	}
+
+	// States are gathered 64 probes at a time and compared with the last written ones as a word. Split
+	// up so the netlist loop is just a load and a shift per probe
+	u32 word_num = (vcd->probe_num + 63) / 64;
+	if (netlist->valid)
+	{
+		u32* net_drive = netlist->net_drive;
+		Vcd_Signal* signal = vcd->signals;
+		for(u32 w=0; w<word_num; ++w)
+		{
+			u32 bit_num = min(vcd->probe_num - w * 64, 64);
+			u64 state = 0;
+			for(u32 b=0; b<bit_num; ++b, ++signal)
+				state |= (u64)(net_drive[signal->net] != 0) << b;
+
+			vcd_update_word(vcd, w, state, first);
+		}
+	}
+	else
+	{
+		for(u32 w=0; w<word_num; ++w)
+		{
+			u32 bit_num = min(vcd->probe_num - w * 64, 64);
+			u64 state = 0;
+			for(u32 b=0; b<bit_num; ++b)
+				state |= (u64)vcd_thing_state(vcd, w * 64 + b) << b;
+
+			vcd_update_word(vcd, w, state, first);
+		}
+	}
+
+	if (first)
+		vcd_write(vcd, "$end\n");
+}
+
+void vcd_close(Vcd_Recorder* vcd)
+{
+	if (!vcd->file)
+		return;
+
+	vcd_flush(vcd);
+	fclose(vcd->file);
+
+	free(vcd->buffer);
+	if (vcd->scopes)
+		free(vcd->scopes);
+	if (vcd->probes)
+		free(vcd->probes);
+	if (vcd->signals)
+		free(vcd->signals);
+	if (vcd->states)
+		free(vcd->states);
+
+	zero_t(*vcd);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "circuit.h"
+
+// VCD recorder
+// Streams the value changes of a set of nodes to a VCD file while the circuit is simulated, for
+// viewing in a waveform viewer like GTKWave. By default every public node of every circuit in the
+// hierarchy is recorded, scoped by the chip path it's in. More nodes can be probed until the first
+// sample. Call vcd_sample after every tic, it reads the netlist when it's valid and the things
+// otherwise. Changes go through a fixed size buffer, so memory doesn't grow with the run.
+// Timestamps are tics.
+#define VCD_BUFFER_SIZE (1 << 16)
+#define VCD_CODE_MAX 8
+
+typedef struct
+{
+	Circuit* circ;
+	char name[32];
+	u32 parent;
+} Vcd_Scope;
+
+typedef struct
+{
+	Circuit* circ;
+	Thing_Id id;
+	u32 scope;
+	char name[24];
+} Vcd_Probe;
+
+// What sampling a probe needs, kept apart so sampling runs through as little memory as possible
+typedef struct
+{
+	// Net in the netlist, cached per netlist generation
+	u32 net;
+	u8 code_len;
+	char code[VCD_CODE_MAX];
+} Vcd_Signal;
+
+typedef struct
+{
+	FILE* file;
+	Circuit* root;
+
+	// Scopes are in pre-order, scope 0 is the root circuit
+	Vcd_Scope* scopes;
+	u32 scope_num;
+	u32 scope_max;
+
+	// Signals are made for the probes when sampling starts, in the same order. The last written state
+	// of each probe is a bit in states, 64 to a word, so a word without changes costs one compare
+	Vcd_Probe* probes;
+	Vcd_Signal* signals;
+	u64* states;
+	u32 probe_num;
+	u32 probe_max;
+
+	u32 netlist_generation;
+	bool started;
+	u32 stamp_tic;
+
+	char* buffer;
+	u32 buffer_num;
+} Vcd_Recorder;
+
+bool vcd_open(Vcd_Recorder* vcd, Circuit* root, const char* path);
+void vcd_probe(Vcd_Recorder* vcd, Circuit* circ, Node* node);
+void vcd_sample(Vcd_Recorder* vcd);
+void vcd_close(Vcd_Recorder* vcd);
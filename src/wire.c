@@ -0,0 +1,348 @@
+#include "wire.h"
+#include <limits.h>
+
+void wire_span(Point a, Point b, i32* coord, bool* vertical, i32* start, i32* end)
+{
+	*vertical = a.x == b.x && a.y != b.y;
+	if (*vertical)
+	{
+		*coord = a.x;
+		*start = min(a.y, b.y);
+		*end = max(a.y, b.y);
+	}
+	else
+	{
+		*coord = min(a.y, b.y);
+		*start = min(a.x, b.x);
+		*end = max(a.x, b.x);
+	}
+}
+
+// Slot the line is in, or the empty slot it would go in
+Wire_Line* wire_line_slot(Wire_Index* index, i32 coord, bool vertical)
+{
+	u32 h = ((u32)coord * 73856093u) ^ (vertical ? 19349663u : 0);
+	h ^= h >> 15;
+
+	u32 mask = index->line_max - 1;
+	for(u32 i = h & mask; ; i = (i + 1) & mask)
+	{
+		Wire_Line* line = &index->lines[i];
+		if (!line->used || (line->coord == coord && line->vertical == vertical))
+			return line;
+	}
+}
+
+Wire_Line* wire_line_find(Wire_Index* index, i32 coord, bool vertical)
+{
+	if (index->line_max == 0)
+		return NULL;
+
+	Wire_Line* line = wire_line_slot(index, coord, vertical);
+	return line->used ? line : NULL;
+}
+
+Wire_Line* wire_line_get(Wire_Index* index, i32 coord, bool vertical)
+{
+	// Keep the load factor at or below a half
+	if ((index->line_num + 1) * 2 > index->line_max)
+	{
+		Wire_Line* prev_lines = index->lines;
+		u32 prev_max = index->line_max;
+
+		index->line_max = prev_max == 0 ? 64 : (prev_max << 1);
+		index->lines = malloc(sizeof(Wire_Line) * index->line_max);
+		mem_zero(index->lines, sizeof(Wire_Line) * index->line_max);
+
+		for(u32 i=0; i<prev_max; ++i)
+		{
+			if (prev_lines[i].used)
+				*wire_line_slot(index, prev_lines[i].coord, prev_lines[i].vertical) = prev_lines[i];
+		}
+
+		if (prev_lines)
+			free(prev_lines);
+	}
+
+	Wire_Line* line = wire_line_slot(index, coord, vertical);
+	if (!line->used)
+	{
+		line->coord = coord;
+		line->vertical = vertical;
+		line->used = true;
+		index->line_num++;
+	}
+
+	return line;
+}
+
+// Wires are ordered by start, then end, then by their nodes, whichever way around those were given
+i32 wire_compare(Wire* wire, Wire* key)
+{
+	if (wire->start != key->start)
+		return wire->start < key->start ? -1 : 1;
+	if (wire->end != key->end)
+		return wire->end < key->end ? -1 : 1;
+
+	u64 wire_a = ((u64)wire->a.index << 32) | wire->a.generation;
+	u64 wire_b = ((u64)wire->b.index << 32) | wire->b.generation;
+	u64 key_a = ((u64)key->a.index << 32) | key->a.generation;
+	u64 key_b = ((u64)key->b.index << 32) | key->b.generation;
+	u64 wire_low = min(wire_a, wire_b), key_low = min(key_a, key_b);
+	u64 wire_high = max(wire_a, wire_b), key_high = max(key_a, key_b);
+	if (wire_low != key_low)
+		return wire_low < key_low ? -1 : 1;
+	if (wire_high != key_high)
+		return wire_high < key_high ? -1 : 1;
+
+	return 0;
+}
+
+Wire* wire_at(Wire_Line* line, u32 ref)
+{
+	return &line->wires[ref - 1];
+}
+
+// Furthest end of a wire and everything below it
+i32 wire_reach(Wire_Line* line, u32 ref)
+{
+	if (!ref)
+		return INT_MIN;
+
+	Wire* wire = wire_at(line, ref);
+	return max(wire->end, max(wire->left_reach, wire->right_reach));
+}
+
+void wire_update(Wire_Line* line, u32 ref)
+{
+	Wire* wire = wire_at(line, ref);
+	wire->left_reach = wire_reach(line, wire->left);
+	wire->right_reach = wire_reach(line, wire->right);
+}
+
+u32 wire_rotate_right(Wire_Line* line, u32 ref)
+{
+	u32 left = wire_at(line, ref)->left;
+	wire_at(line, ref)->left = wire_at(line, left)->right;
+	wire_at(line, left)->right = ref;
+	wire_update(line, ref);
+	wire_update(line, left);
+	return left;
+}
+
+u32 wire_rotate_left(Wire_Line* line, u32 ref)
+{
+	u32 right = wire_at(line, ref)->right;
+	wire_at(line, ref)->right = wire_at(line, right)->left;
+	wire_at(line, right)->left = ref;
+	wire_update(line, ref);
+	wire_update(line, right);
+	return right;
+}
+
+// Returns the new root of the subtree
+u32 wire_tree_insert(Wire_Line* line, u32 root, u32 ref)
+{
+	if (!root)
+		return ref;
+
+	Wire* node = wire_at(line, root);
+	if (wire_compare(wire_at(line, ref), node) < 0)
+	{
+		node->left = wire_tree_insert(line, node->left, ref);
+		wire_update(line, root);
+		if (wire_at(line, node->left)->priority > node->priority)
+			root = wire_rotate_right(line, root);
+	}
+	else
+	{
+		node->right = wire_tree_insert(line, node->right, ref);
+		wire_update(line, root);
+		if (wire_at(line, node->right)->priority > node->priority)
+			root = wire_rotate_left(line, root);
+	}
+
+	return root;
+}
+
+// Joins two subtrees, every wire of left comes before every wire of right
+u32 wire_tree_join(Wire_Line* line, u32 left, u32 right)
+{
+	if (!left || !right)
+		return left ? left : right;
+
+	if (wire_at(line, left)->priority > wire_at(line, right)->priority)
+	{
+		wire_at(line, left)->right = wire_tree_join(line, wire_at(line, left)->right, right);
+		wire_update(line, left);
+		return left;
+	}
+
+	wire_at(line, right)->left = wire_tree_join(line, left, wire_at(line, right)->left);
+	wire_update(line, right);
+	return right;
+}
+
+u32 wire_tree_remove(Wire_Line* line, u32 root, Wire* key, u32* removed)
+{
+	if (!root)
+		return 0;
+
+	Wire* node = wire_at(line, root);
+	i32 order = wire_compare(key, node);
+	if (order == 0)
+	{
+		*removed = root;
+		return wire_tree_join(line, node->left, node->right);
+	}
+
+	if (order < 0)
+		node->left = wire_tree_remove(line, node->left, key, removed);
+	else
+		node->right = wire_tree_remove(line, node->right, key, removed);
+
+	wire_update(line, root);
+	return root;
+}
+
+// Where the tree points to the wire like key, NULL if it isn't there
+u32* wire_tree_link(Wire_Line* line, Wire* key)
+{
+	u32* link = &line->root;
+	while(*link)
+	{
+		Wire* node = wire_at(line, *link);
+		i32 order = wire_compare(key, node);
+		if (order == 0)
+			return link;
+
+		link = order < 0 ? &node->left : &node->right;
+	}
+
+	return NULL;
+}
+
+// Wires of a subtree covering pos, the ones starting last first
+u32 wire_tree_find(Wire_Line* line, u32 root, i32 pos, Wire** out_arr, u32 num, u32 arr_size)
+{
+	Wire* wire = wire_at(line, root);
+
+	// Everything right of a wire starting after pos does too
+	if (wire->start <= pos)
+	{
+		if (wire->right_reach >= pos)
+			num = wire_tree_find(line, wire->right, pos, out_arr, num, arr_size);
+
+		if (wire->end >= pos && num < arr_size)
+			out_arr[num++] = wire;
+	}
+
+	if (wire->left_reach >= pos && num < arr_size)
+		num = wire_tree_find(line, wire->left, pos, out_arr, num, arr_size);
+
+	return num;
+}
+
+void wire_index_free(Wire_Index* index)
+{
+	for(u32 i=0; i<index->line_max; ++i)
+	{
+		if (index->lines[i].wires && !index->lines[i].mapped)
+			free(index->lines[i].wires);
+	}
+
+	if (index->lines)
+		free(index->lines);
+
+	zero_t(*index);
+}
+
+void wire_insert(Wire_Index* index, Point a_pos, Point b_pos, Thing_Id a, Thing_Id b)
+{
+	i32 coord;
+	bool vertical;
+	Wire key;
+	mem_zero(&key, sizeof(key));
+	wire_span(a_pos, b_pos, &coord, &vertical, &key.start, &key.end);
+	key.a = a;
+	key.b = b;
+
+	// Both nodes of a connection share the same wire
+	Wire_Line* line = wire_line_get(index, coord, vertical);
+	if (wire_tree_link(line, &key))
+		return;
+
+	if (line->wire_num >= line->wire_max)
+	{
+		line->wire_max = line->wire_max == 0 ? 4 : (line->wire_max << 1);
+		if (line->mapped)
+		{
+			Wire* wires = malloc(sizeof(Wire) * line->wire_max);
+			memcpy(wires, line->wires, sizeof(Wire) * line->wire_num);
+			line->wires = wires;
+			line->mapped = false;
+		}
+		else
+		{
+			line->wires = realloc(line->wires, sizeof(Wire) * line->wire_max);
+		}
+
+		assert(line->wires != NULL);
+	}
+
+	// Priorities come from the wire, so the same wires always make the same tree
+	u32 priority = (u32)key.start * 0x9E3779B1u ^ (u32)key.end * 0x85EBCA77u ^ (a.index + b.index) * 0xC2B2AE3Du;
+	priority ^= priority >> 15;
+	priority *= 0x2C1B3C6Du;
+	priority ^= priority >> 12;
+
+	u32 ref = ++line->wire_num;
+	Wire* wire = wire_at(line, ref);
+	*wire = key;
+	wire->left_reach = INT_MIN;
+	wire->right_reach = INT_MIN;
+	wire->priority = priority;
+	line->root = wire_tree_insert(line, line->root, ref);
+}
+
+void wire_remove(Wire_Index* index, Point a_pos, Point b_pos, Thing_Id a, Thing_Id b)
+{
+	i32 coord;
+	bool vertical;
+	Wire key;
+	mem_zero(&key, sizeof(key));
+	wire_span(a_pos, b_pos, &coord, &vertical, &key.start, &key.end);
+	key.a = a;
+	key.b = b;
+
+	Wire_Line* line = wire_line_find(index, coord, vertical);
+	if (!line)
+		return;
+
+	u32 removed = 0;
+	line->root = wire_tree_remove(line, line->root, &key, &removed);
+	if (!removed)
+		return;
+
+	// The last wire fills the gap, whatever pointed to it points to the gap now
+	u32 last = line->wire_num--;
+	if (removed != last)
+	{
+		*wire_tree_link(line, wire_at(line, last)) = removed;
+		*wire_at(line, removed) = *wire_at(line, last);
+	}
+}
+
+u32 wires_find(Wire_Index* index, Point cell, Wire** out_arr, u32 arr_size)
+{
+	u32 num = 0;
+	for(u32 v=0; v<2; ++v)
+	{
+		Wire_Line* line = wire_line_find(index, v ? cell.x : cell.y, v);
+		i32 pos = v ? cell.y : cell.x;
+		if (line && num < arr_size && wire_reach(line, line->root) >= pos)
+			num = wire_tree_find(line, line->root, pos, out_arr, num, arr_size);
+	}
+
+	return num;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "thing.h"
+
+// Wire index
+// Maps rows and columns to the wires (connections between two nodes) running along them, so a cell
+// can be hit-tested without looking at every node. A wire is kept in the line it's drawn on: the row
+// of its nodes, the column if they're above each other, or the top row if they're not lined up at all.
+// The wires of a line form a treap ordered by where they start, in which every wire knows the furthest
+// end below it, so a hit-test skips whatever can't reach the cell. Inserting and removing a wire is
+// O(log n), a hit-test O(log n) per wire found. The tree lives in the array of the line, linked by
+// index, so it can be copied and mapped from a file as it is. Removing moves the last wire into the gap.
+typedef struct
+{
+	i32 start;
+	i32 end;
+
+	Thing_Id a;
+	Thing_Id b;
+
+	// Indices + 1 into the wires of the line, 0 for none. The reach of a side is the furthest end of
+	// the wires on it, kept here so a hit-test doesn't have to look at sides that can't reach the cell
+	u32 left;
+	u32 right;
+	i32 left_reach;
+	i32 right_reach;
+	u32 priority;
+} Wire;
+
+typedef struct
+{
+	i32 coord;
+	bool vertical;
+	bool used;
+
+	// The wires point into a mapped file, they're copied before they grow
+	bool mapped;
+
+	Wire* wires;
+	u32 wire_num;
+	u32 wire_max;
+	u32 root;
+} Wire_Line;
+
+typedef struct
+{
+	// Open addressing, lines are never removed
+	Wire_Line* lines;
+	u32 line_num;
+	u32 line_max;
+} Wire_Index;
+
+void wire_index_free(Wire_Index* index);
+void wire_insert(Wire_Index* index, Point a_pos, Point b_pos, Thing_Id a, Thing_Id b);
+void wire_remove(Wire_Index* index, Point a_pos, Point b_pos, Thing_Id a, Thing_Id b);
+
+// Wires covering a cell, at most arr_size of them
+u32 wires_find(Wire_Index* index, Point cell, Wire** out_arr, u32 arr_size);